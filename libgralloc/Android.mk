@@ -24,10 +24,11 @@ LOCAL_MODULE_PATH             := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE_TAGS             := optional
 LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
 LOCAL_SHARED_LIBRARIES        := $(common_libs) libmemalloc libgenlock
-LOCAL_SHARED_LIBRARIES        += libqdutils libGLESv1_CM
+LOCAL_SHARED_LIBRARIES        += libqdutils libGLESv1_CM libbinder
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"gralloc\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
-LOCAL_SRC_FILES               :=  gpu.cpp gralloc.cpp framebuffer.cpp mapper.cpp
+LOCAL_SRC_FILES               :=  gpu.cpp gralloc.cpp framebuffer.cpp mapper.cpp \
+                                 release_queue.cpp alloc_stats.cpp
 include $(BUILD_SHARED_LIBRARY)
 
 #MemAlloc Library
@@ -40,7 +41,8 @@ LOCAL_CFLAGS           := $(common_flags) -DLOG_TAG=\"memalloc\"
 LOCAL_SRC_FILES        :=  ionalloc.cpp alloc_controller.cpp
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdgralloc\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps) $(kernel_deps)
-LOCAL_SRC_FILES               := gpu.cpp gralloc.cpp framebuffer.cpp mapper.cpp
+LOCAL_SRC_FILES               := gpu.cpp gralloc.cpp framebuffer.cpp mapper.cpp \
+                                 release_queue.cpp alloc_stats.cpp
 LOCAL_COPY_HEADERS_TO         := $(common_header_export_path)
 LOCAL_COPY_HEADERS            := gralloc_priv.h 
 
@@ -64,5 +66,23 @@ ifeq ($(BOARD_USES_PMEM_ADSP),true)
     LOCAL_SRC_FILES           += pmemalloc.cpp
     LOCAL_CFLAGS              += -DUSE_PMEM_ADSP
 endif
+# Emulates ION heaps with shared memory, for tests and for targets
+# without /dev/ion
+LOCAL_SRC_FILES               += fakeionalloc.cpp
+ifeq ($(TARGET_USES_FAKE_ION),true)
+    LOCAL_CFLAGS              += -DUSE_FAKE_ION
+endif
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Checks allocation, failure injection and heap exhaustion in FakeIonAlloc
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := fake_ion_alloc_test
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(common_libs)
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdmemalloc_test\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps) $(kernel_deps)
+LOCAL_SRC_FILES               := fake_ion_alloc_test.cpp fakeionalloc.cpp
+
+include $(BUILD_EXECUTABLE)
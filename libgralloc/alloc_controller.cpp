@@ -42,6 +42,7 @@ using namespace gralloc;
 using namespace qdutils;
 
 #include <dlfcn.h>
+#include <string.h>
 #include <gralloc_priv.h>
 #include "alloc_controller.h"
 #include "memalloc.h"
@@ -49,6 +50,9 @@ using namespace qdutils;
 #ifdef USE_PMEM_ADSP
 #include "pmemalloc.h"
 #endif
+#ifdef USE_FAKE_ION
+#include "fakeionalloc.h"
+#endif
 #include "gr.h"
 #include "comptype.h"
 
@@ -109,9 +113,91 @@ static bool useUncached(int usage)
     return false;
 }
 
+//-------------- Format geometry-----------------------//
+// Size rules for the chroma planes, see getBufferSizeAndDimensions
+enum {
+    CHROMA_NONE,        // single plane
+    CHROMA_ADRENO_420,  // CbCr plane of 32 aligned half width and height
+    CHROMA_TILED_420,   // CbCr plane of full pitch, 32 aligned half height
+    CHROMA_PLANAR_420,  // Cb and Cr planes of 16 aligned half pitch
+    CHROMA_SP_422,      // CbCr plane of full pitch, full height
+    CHROMA_VENUS,       // sized by the venus macros
+};
+
+enum {
+    ODD_WIDTH  = 0x1,
+    ODD_HEIGHT = 0x2,
+};
+
+struct FormatGeometry {
+    int      format;
+    uint8_t  bpp;          // bytes per pixel of the first plane
+    uint8_t  planes;
+    uint8_t  chroma;       // CHROMA_* rule for the remaining planes
+    uint8_t  oddReject;    // ODD_* dimensions that are rejected
+    uint8_t  strideAlign;  // stride alignment in pixels, 0 for adreno padding
+    uint8_t  heightAlign;
+    uint16_t lumaAlign;    // byte alignment of the first plane
+    uint16_t sizeAlign;    // byte alignment of the whole buffer
+};
+
+static const FormatGeometry sFormatGeometry[] = {
+    // format, bpp, planes, chroma, oddReject,
+    //     strideAlign, heightAlign, lumaAlign, sizeAlign
+    { HAL_PIXEL_FORMAT_RGBA_8888,               4, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_RGBX_8888,               4, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_BGRA_8888,               4, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_RGB_888,                 3, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_RGB_565,                 2, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_RGBA_5551,               2, 1, CHROMA_NONE, 0,
+        0, 32, 1, 1 },
+    // Outside the padded RGB range (< 0x7), plain 32 pixel stride
+    { HAL_PIXEL_FORMAT_RGBA_4444,               2, 1, CHROMA_NONE, 0,
+        32, 32, 1, 1 },
+    // adreno formats
+    { HAL_PIXEL_FORMAT_YCrCb_420_SP_ADRENO,     1, 2, CHROMA_ADRENO_420, 0,
+        32, 32, 4096, 4096 },
+    // The GPU needs 4K alignment, but the video decoder needs 8K
+    { HAL_PIXEL_FORMAT_YCbCr_420_SP_TILED,      1, 2, CHROMA_TILED_420, 0,
+        128, 32, 8192, 8192 },
+    // The encoder requires a 2K aligned chroma offset.
+    { HAL_PIXEL_FORMAT_NV12_ENCODEABLE,         1, 2, CHROMA_PLANAR_420, 0,
+        16, 1, 2048, 4096 },
+    { HAL_PIXEL_FORMAT_YV12,                    1, 3, CHROMA_PLANAR_420,
+        ODD_WIDTH | ODD_HEIGHT, 16, 1, 1, 4096 },
+    // Sized like the planar formats they were grouped with, which is never
+    // less than one CbCr plane of full pitch and half height
+    { HAL_PIXEL_FORMAT_YCbCr_420_SP,            1, 2, CHROMA_PLANAR_420, 0,
+        16, 1, 1, 4096 },
+    { HAL_PIXEL_FORMAT_YCrCb_420_SP,            1, 2, CHROMA_PLANAR_420, 0,
+        16, 1, 1, 4096 },
+    { HAL_PIXEL_FORMAT_YCbCr_422_SP,            1, 2, CHROMA_SP_422,
+        ODD_WIDTH, 16, 1, 1, 4096 },
+    { HAL_PIXEL_FORMAT_YCrCb_422_SP,            1, 2, CHROMA_SP_422,
+        ODD_WIDTH, 16, 1, 1, 4096 },
+    { HAL_PIXEL_FORMAT_YCbCr_420_SP_VENUS,      1, 2, CHROMA_VENUS, 0,
+        0, 1, 1, 1 },
+};
+
+static const FormatGeometry* getFormatGeometry(int format)
+{
+    for (size_t i = 0; i < sizeof(sFormatGeometry) /
+                 sizeof(sFormatGeometry[0]); i++) {
+        if (sFormatGeometry[i].format == format)
+            return &sFormatGeometry[i];
+    }
+    return NULL;
+}
+
 //-------------- AdrenoMemInfo-----------------------//
 AdrenoMemInfo::AdrenoMemInfo()
 {
+    memset((void*)mStrideCache, 0, sizeof(mStrideCache));
     libadreno_utils = ::dlopen("libadreno_utils.so", RTLD_NOW);
     if (libadreno_utils) {
         *(void **)&LINK_adreno_compute_padding = ::dlsym(libadreno_utils,
@@ -128,55 +214,44 @@ AdrenoMemInfo::~AdrenoMemInfo()
 
 int AdrenoMemInfo::getStride(int width, int format)
 {
-    int stride = ALIGN(width, 32);
+    const FormatGeometry* geo = getFormatGeometry(format);
+    if (!geo)
+        return ALIGN(width, 32);
+    if (geo->chroma == CHROMA_VENUS)
+        return VENUS_Y_STRIDE(COLOR_FMT_NV12, width);
+    if (geo->strideAlign)
+        return ALIGN(width, geo->strideAlign);
     // Currently surface padding is only computed for RGB* surfaces.
-    if (format < 0x7) {
-        int bpp = 4;
-        switch(format)
-        {
-            case HAL_PIXEL_FORMAT_RGB_888:
-                bpp = 3;
-                break;
-            case HAL_PIXEL_FORMAT_RGB_565:
-            case HAL_PIXEL_FORMAT_RGBA_5551:
-            case HAL_PIXEL_FORMAT_RGBA_4444:
-                bpp = 2;
-                break;
-            default: break;
-        }
-        if ((libadreno_utils) && (LINK_adreno_compute_padding)) {
-            int surface_tile_height = 1;   // Linear surface
-            int raster_mode         = 1;   // Adreno TW raster mode.
-            int padding_threshold   = 512; // Threshold for padding surfaces.
-            // the function below expects the width to be a multiple of
-            // 32 pixels, hence we pass stride instead of width.
-            stride = LINK_adreno_compute_padding(stride, bpp,
-                                      surface_tile_height, raster_mode,
-                                      padding_threshold);
-        }
-    } else {
-        switch (format)
-        {
-            case HAL_PIXEL_FORMAT_YCrCb_420_SP_ADRENO:
-                stride = ALIGN(width, 32);
-                break;
-            case HAL_PIXEL_FORMAT_YCbCr_420_SP_TILED:
-                stride = ALIGN(width, 128);
-                break;
-            case HAL_PIXEL_FORMAT_NV12_ENCODEABLE:
-            case HAL_PIXEL_FORMAT_YCbCr_420_SP:
-            case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-            case HAL_PIXEL_FORMAT_YV12:
-            case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-            case HAL_PIXEL_FORMAT_YCrCb_422_SP:
-                stride = ALIGN(width, 16);
-                break;
-            case HAL_PIXEL_FORMAT_YCbCr_420_SP_VENUS:
-                stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, width);
-                break;
-            default: break;
-        }
+    return getPaddedStride(width, format, geo->bpp);
+}
+
+int AdrenoMemInfo::getPaddedStride(int width, int format, int bpp)
+{
+    int stride = ALIGN(width, 32);
+    if (!libadreno_utils || !LINK_adreno_compute_padding)
+        return stride;
+
+    // Entries pack (stride << 16 | width << 3 | format) into one word so
+    // that lookups and updates need no lock. RGB formats fit in 3 bits.
+    bool cacheable = (width > 0) && (width < (1 << 13)) && (format < 0x8);
+    int key = (width << 3) | format;
+    int slot = ((width >> 5) + format) & (STRIDE_CACHE_SIZE - 1);
+    if (cacheable) {
+        int32_t entry = mStrideCache[slot];
+        if ((entry & 0xFFFF) == key)
+            return (uint32_t)entry >> 16;
     }
+
+    int surface_tile_height = 1;   // Linear surface
+    int raster_mode         = 1;   // Adreno TW raster mode.
+    int padding_threshold   = 512; // Threshold for padding surfaces.
+    // the function below expects the width to be a multiple of
+    // 32 pixels, hence we pass stride instead of width.
+    stride = LINK_adreno_compute_padding(stride, bpp,
+                                         surface_tile_height, raster_mode,
+                                         padding_threshold);
+    if (cacheable && stride > 0 && stride < (1 << 16))
+        mStrideCache[slot] = (stride << 16) | key;
     return stride;
 }
 
@@ -185,11 +260,22 @@ IAllocController* IAllocController::sController = NULL;
 IAllocController* IAllocController::getInstance(void)
 {
     if(sController == NULL) {
+#ifdef USE_FAKE_ION
+        sController = new IonController(FakeIonAlloc::getInstance());
+#else
         sController = new IonController();
+#endif
     }
     return sController;
 }
 
+IAllocController* IAllocController::setInstance(IAllocController* controller)
+{
+    IAllocController* prev = sController;
+    sController = controller;
+    return prev;
+}
+
 
 //-------------- IonController-----------------------//
 IonController::IonController()
@@ -200,6 +286,14 @@ IonController::IonController()
 #endif
 }
 
+IonController::IonController(IMemAlloc* ionAlloc)
+{
+    mIonAlloc = ionAlloc;
+#ifdef USE_PMEM_ADSP
+    mPmemAlloc = new PmemAdspAlloc();
+#endif
+}
+
 int IonController::allocate(alloc_data& data, int usage)
 {
     int ionFlags = 0;
@@ -298,86 +392,49 @@ size_t getBufferSizeAndDimensions(int width, int height, int format,
                                   int& alignedw, int &alignedh)
 {
     size_t size;
+    const FormatGeometry* geo = getFormatGeometry(format);
 
-    alignedw = ALIGN(width, 32);
     alignedw = AdrenoMemInfo::getInstance().getStride(width, format);
     alignedh = ALIGN(height, 32);
-    switch (format) {
-        case HAL_PIXEL_FORMAT_RGBA_8888:
-        case HAL_PIXEL_FORMAT_RGBX_8888:
-        case HAL_PIXEL_FORMAT_BGRA_8888:
-            size = alignedw * alignedh * 4;
-            break;
-        case HAL_PIXEL_FORMAT_RGB_888:
-            size = alignedw * alignedh * 3;
-            break;
-        case HAL_PIXEL_FORMAT_RGB_565:
-        case HAL_PIXEL_FORMAT_RGBA_5551:
-        case HAL_PIXEL_FORMAT_RGBA_4444:
-            size = alignedw * alignedh * 2;
-            break;
-
-            // adreno formats
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP_ADRENO:  // NV21
-            size  = ALIGN(alignedw*alignedh, 4096);
-            size += ALIGN(2 * ALIGN(width/2, 32) * ALIGN(height/2, 32), 4096);
-            break;
-        case HAL_PIXEL_FORMAT_YCbCr_420_SP_TILED:   // NV12
-            // The chroma plane is subsampled,
-            // but the pitch in bytes is unchanged
-            // The GPU needs 4K alignment, but the video decoder needs 8K
-            alignedw = ALIGN(width, 128);
-            size  = ALIGN( alignedw * alignedh, 8192);
-            size += ALIGN( alignedw * ALIGN(height/2, 32), 8192);
-            break;
-        case HAL_PIXEL_FORMAT_NV12_ENCODEABLE:
-        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-        case HAL_PIXEL_FORMAT_YV12:
-            if ((format == HAL_PIXEL_FORMAT_YV12) && ((width&1) || (height&1))) {
-                ALOGE("w or h is odd for the YV12 format");
-                return -EINVAL;
-            }
-            alignedw = ALIGN(width, 16);
-            alignedh = height;
-            if (HAL_PIXEL_FORMAT_NV12_ENCODEABLE == format) {
-                // The encoder requires a 2K aligned chroma offset.
-                size = ALIGN(alignedw*alignedh, 2048) +
-                    (ALIGN(alignedw/2, 16) * (alignedh/2))*2;
-            } else {
-                size = alignedw*alignedh +
-                    (ALIGN(alignedw/2, 16) * (alignedh/2))*2;
-            }
-            size = ALIGN(size, 4096);
-            break;
-        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-            alignedh = height;
-            size = ALIGN((alignedw*alignedh) + (alignedw* alignedh)/2, 4096);
-            break;
-        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-        case HAL_PIXEL_FORMAT_YCrCb_422_SP:
-            if(width & 1) {
-                ALOGE("width is odd for the YUV422_SP format");
-                return -EINVAL;
-            }
-            alignedw = ALIGN(width, 16);
-            alignedh = height;
-            size = ALIGN(alignedw * alignedh * 2, 4096);
-            break;
-            alignedh = height;
-            size = ALIGN(alignedw * alignedh * 2, 4096);
-            break;
-        case HAL_PIXEL_FORMAT_YCbCr_420_SP_VENUS:
-            alignedh = VENUS_Y_SCANLINES(COLOR_FMT_NV12, height);
-            size = VENUS_BUFFER_SIZE(COLOR_FMT_NV12, width, height);
-            break;
-        default:
-            ALOGE("unrecognized pixel format: 0x%x", format);
-            return -EINVAL;
+    if (!geo) {
+        ALOGE("unrecognized pixel format: 0x%x", format);
+        return -EINVAL;
     }
 
-    return size;
+    if (((geo->oddReject & ODD_WIDTH) && (width & 1)) ||
+        ((geo->oddReject & ODD_HEIGHT) && (height & 1))) {
+        ALOGE("%dx%d is odd for the format 0x%x", width, height, format);
+        return -EINVAL;
+    }
+
+    if (geo->chroma == CHROMA_VENUS) {
+        alignedh = VENUS_Y_SCANLINES(COLOR_FMT_NV12, height);
+        return VENUS_BUFFER_SIZE(COLOR_FMT_NV12, width, height);
+    }
+
+    alignedh = ALIGN(height, geo->heightAlign);
+    size = ALIGN(alignedw * alignedh * geo->bpp, geo->lumaAlign);
+    if (geo->planes > 1) {
+        switch (geo->chroma) {
+            case CHROMA_ADRENO_420:
+                size += 2 * ALIGN(width/2, 32) * ALIGN(height/2, 32);
+                break;
+            case CHROMA_TILED_420:
+                // The chroma plane is subsampled,
+                // but the pitch in bytes is unchanged
+                size += alignedw * ALIGN(height/2, 32);
+                break;
+            case CHROMA_PLANAR_420:
+                size += (ALIGN(alignedw/2, 16) * (alignedh/2)) * 2;
+                break;
+            case CHROMA_SP_422:
+                size += alignedw * alignedh;
+                break;
+            default:
+                break;
+        }
+    }
+    return ALIGN(size, geo->sizeAlign);
 }
 
 // Allocate buffer from width, height and format into a
@@ -54,6 +54,11 @@ class IAllocController {
 
     static IAllocController* getInstance(void);
 
+    // Replaces the controller getInstance returns, e.g. with an
+    // IonController over FakeIonAlloc. NULL brings back the default one.
+    // Returns the previous controller, NULL if none was created yet.
+    static IAllocController* setInstance(IAllocController* controller);
+
     private:
     static IAllocController* sController;
 
@@ -68,8 +73,11 @@ class IonController : public IAllocController {
 
     IonController();
 
+    // Serves ION allocations from the given backend instead of /dev/ion
+    explicit IonController(IMemAlloc* ionAlloc);
+
     private:
-    IonAlloc* mIonAlloc;
+    IMemAlloc* mIonAlloc;
 #ifdef USE_PMEM_ADSP
     PmemAdspAlloc* mPmemAlloc;
 #endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <binder/IPCThreadState.h>
+#include <cutils/log.h>
+#include "alloc_stats.h"
+
+using namespace gralloc;
+
+ANDROID_SINGLETON_STATIC_INSTANCE(AllocStats);
+
+static const char* sDimensionNames[GRALLOC_STATS_DIMENSION_COUNT] = {
+    "total", "heap", "usage", "format", "pid",
+};
+
+static const char* sUsageClassNames[] = {
+    "protected", "camera", "venc", "video", "composer", "gpu", "sw", "other",
+};
+
+static int getUsageClass(int usage)
+{
+    if (usage & (GRALLOC_USAGE_PROTECTED | GRALLOC_USAGE_PRIVATE_CP_BUFFER))
+        return GRALLOC_USAGE_CLASS_PROTECTED;
+    if (usage & (GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_CAMERA_READ))
+        return GRALLOC_USAGE_CLASS_CAMERA;
+    if (usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+        return GRALLOC_USAGE_CLASS_VIDEO_ENCODER;
+    if (usage & (GRALLOC_USAGE_PRIVATE_MM_HEAP | GRALLOC_USAGE_EXTERNAL_DISP))
+        return GRALLOC_USAGE_CLASS_VIDEO;
+    if (usage & GRALLOC_USAGE_HW_COMPOSER)
+        return GRALLOC_USAGE_CLASS_COMPOSER;
+    if (usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER))
+        return GRALLOC_USAGE_CLASS_GPU;
+    if (usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK))
+        return GRALLOC_USAGE_CLASS_SW;
+    return GRALLOC_USAGE_CLASS_OTHER;
+}
+
+AllocStats::AllocStats()
+{
+    memset(mTables, 0, sizeof(mTables));
+    for (int dim = 0; dim < GRALLOC_STATS_DIMENSION_COUNT; dim++)
+        mTables[dim].buckets[OTHER_SLOT].key = GRALLOC_STATS_KEY_OTHER;
+}
+
+int AllocStats::findSlotLocked(int dimension, int key) const
+{
+    const Table& table = mTables[dimension];
+    if (key == GRALLOC_STATS_KEY_OTHER)
+        return OTHER_SLOT;
+    for (int i = 0; i < table.count; i++) {
+        if (table.buckets[i].key == key)
+            return i;
+    }
+    return -1;
+}
+
+int AllocStats::getSlotLocked(int dimension, int key)
+{
+    int slot = findSlotLocked(dimension, key);
+    if (slot >= 0)
+        return slot;
+    Table& table = mTables[dimension];
+    if (table.count < MAX_KEYS) {
+        slot = table.count++;
+    } else {
+        // Reuse a bucket that no longer holds any memory. Its history goes
+        // to the overflow bucket rather than being lost.
+        for (int i = 0; i < table.count && slot < 0; i++) {
+            if (!table.buckets[i].counter.liveCount)
+                slot = i;
+        }
+        if (slot < 0)
+            return OTHER_SLOT;
+        AllocCounter_t& other = table.buckets[OTHER_SLOT].counter;
+        const AllocCounter_t& old = table.buckets[slot].counter;
+        other.allocCount += old.allocCount;
+        if (old.peakBytes > other.peakBytes)
+            other.peakBytes = old.peakBytes;
+        table.recycled++;
+    }
+    memset(&table.buckets[slot], 0, sizeof(Bucket));
+    table.buckets[slot].key = key;
+    return slot;
+}
+
+void AllocStats::addLocked(Record& rec)
+{
+    for (int dim = 0; dim < GRALLOC_STATS_DIMENSION_COUNT; dim++) {
+        int slot = getSlotLocked(dim, rec.keys[dim]);
+        rec.slots[dim] = slot;
+        AllocCounter_t& c = mTables[dim].buckets[slot].counter;
+        c.liveCount++;
+        c.allocCount++;
+        c.liveBytes += rec.size;
+        if (c.liveBytes > c.peakBytes)
+            c.peakBytes = c.liveBytes;
+    }
+}
+
+void AllocStats::removeLocked(const Record& rec)
+{
+    for (int dim = 0; dim < GRALLOC_STATS_DIMENSION_COUNT; dim++) {
+        AllocCounter_t& c = mTables[dim].buckets[rec.slots[dim]].counter;
+        if (!c.liveCount || c.liveBytes < rec.size) {
+            ALOGE("%s: %s bucket underflow", __FUNCTION__,
+                  sDimensionNames[dim]);
+            continue;
+        }
+        c.liveCount--;
+        c.liveBytes -= rec.size;
+    }
+}
+
+void AllocStats::onAlloc(private_handle_t const* hnd, int usage,
+                         unsigned int heapMask)
+{
+    Record rec;
+    rec.keys[GRALLOC_STATS_TOTAL] = 0;
+    rec.keys[GRALLOC_STATS_HEAP] = heapMask;
+    rec.keys[GRALLOC_STATS_USAGE] = getUsageClass(usage);
+    rec.keys[GRALLOC_STATS_FORMAT] = hnd->format;
+    // Buffers for apps are allocated by SurfaceFlinger on a binder thread,
+    // the calling pid is the process the buffer is made for.
+    rec.keys[GRALLOC_STATS_PID] =
+            android::IPCThreadState::self()->getCallingPid();
+    rec.size = hnd->size;
+
+    Locker::Autolock _l(mLock);
+    addLocked(rec);
+    mRecords.add(hnd, rec);
+}
+
+void AllocStats::onFree(private_handle_t const* hnd)
+{
+    Locker::Autolock _l(mLock);
+    ssize_t index = mRecords.indexOfKey(hnd);
+    if (index < 0)
+        return;
+    removeLocked(mRecords.valueAt(index));
+    mRecords.removeItemsAt(index);
+}
+
+int AllocStats::getCounter(int dimension, int key, AllocCounter_t* counter)
+{
+    if (dimension < 0 || dimension >= GRALLOC_STATS_DIMENSION_COUNT ||
+        !counter)
+        return -EINVAL;
+    if (dimension == GRALLOC_STATS_TOTAL)
+        key = 0;
+
+    Locker::Autolock _l(mLock);
+    int slot = findSlotLocked(dimension, key);
+    if (slot < 0)
+        return -ENOENT;
+    *counter = mTables[dimension].buckets[slot].counter;
+    return 0;
+}
+
+void AllocStats::dump(char* buf, size_t len)
+{
+    if (!buf || !len)
+        return;
+    char str[128] = {'\0'};
+    buf[0] = '\0';
+    Locker::Autolock _l(mLock);
+    strlcat(buf, "Gralloc allocations (live/peak KB, live/total count):\n",
+            len);
+    for (int dim = 0; dim < GRALLOC_STATS_DIMENSION_COUNT; dim++) {
+        const Table& table = mTables[dim];
+        for (int n = 0; n <= table.count; n++) {
+            // The overflow bucket last, and only once it was used
+            int i = (n == table.count) ? OTHER_SLOT : n;
+            const Bucket& b = table.buckets[i];
+            if (i == OTHER_SLOT && !b.counter.allocCount)
+                continue;
+            char key[32];
+            if (i == OTHER_SLOT)
+                snprintf(key, sizeof(key), "other(%u)", table.recycled);
+            else if (dim == GRALLOC_STATS_USAGE)
+                snprintf(key, sizeof(key), "%s", sUsageClassNames[b.key]);
+            else if (dim == GRALLOC_STATS_TOTAL)
+                key[0] = '\0';
+            else
+                snprintf(key, sizeof(key), (dim == GRALLOC_STATS_PID) ?
+                         "%d" : "0x%x", b.key);
+            snprintf(str, sizeof(str), "  %-6s %-12s %8u/%-8u %5u/%u\n",
+                     sDimensionNames[dim], key,
+                     b.counter.liveBytes / 1024, b.counter.peakBytes / 1024,
+                     b.counter.liveCount, b.counter.allocCount);
+            strlcat(buf, str, len);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_ALLOC_STATS_H
+#define GRALLOC_ALLOC_STATS_H
+
+#include <utils/KeyedVector.h>
+#include <utils/Singleton.h>
+#include <gralloc_priv.h>
+#include "gr.h"
+
+namespace gralloc {
+
+/*
+ * Live and peak memory held by the buffers this process allocated, broken
+ * down by heap, usage class, format and the pid the buffer was made for.
+ * Updated on every alloc and free; read via gralloc_perform.
+ */
+class AllocStats : public android::Singleton<AllocStats> {
+    public:
+    AllocStats();
+
+    void onAlloc(private_handle_t const* hnd, int usage,
+                 unsigned int heapMask);
+
+    // No-op for handles that were not seen by onAlloc
+    void onFree(private_handle_t const* hnd);
+
+    // Returns -ENOENT if nothing was ever allocated for the key
+    int getCounter(int dimension, int key, AllocCounter_t* counter);
+
+    void dump(char* buf, size_t len);
+
+    private:
+    enum { MAX_KEYS = 16 };
+    // Slot of the overflow bucket, past the keyed ones
+    enum { OTHER_SLOT = MAX_KEYS };
+
+    struct Bucket {
+        int key;
+        AllocCounter_t counter;
+    };
+
+    // Buckets never move, a Record's slot stays valid while it is live
+    struct Table {
+        Bucket buckets[MAX_KEYS + 1];
+        int count;
+        uint32_t recycled;
+    };
+
+    struct Record {
+        int keys[GRALLOC_STATS_DIMENSION_COUNT];
+        // Bucket each dimension was counted in
+        uint8_t slots[GRALLOC_STATS_DIMENSION_COUNT];
+        uint32_t size;
+    };
+
+    // Must be called with mLock held
+    int findSlotLocked(int dimension, int key) const;
+
+    // Must be called with mLock held, never fails: keys past MAX_KEYS land
+    // in the overflow bucket
+    int getSlotLocked(int dimension, int key);
+
+    void addLocked(Record& rec);
+
+    void removeLocked(const Record& rec);
+
+    Table mTables[GRALLOC_STATS_DIMENSION_COUNT];
+    android::KeyedVector<const void*, Record> mRecords;
+    Locker mLock;
+};
+
+} // namespace gralloc
+
+#endif // GRALLOC_ALLOC_STATS_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Runs FakeIonAlloc through allocation, mapping, failure injection and
+ * heap exhaustion. The fake is built into this test directly, so it runs
+ * on any target, TARGET_USES_FAKE_ION or not. Exits non zero if any check
+ * fails. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ion_msm.h"
+#include "fakeionalloc.h"
+
+using gralloc::FakeIonAlloc;
+using gralloc::alloc_data;
+
+static int sFailures = 0;
+static int sChecks = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+    sChecks++;
+    if (!ok)
+        sFailures++;
+}
+
+static int alloc(FakeIonAlloc& ion, unsigned int flags, size_t size,
+                 alloc_data& data)
+{
+    memset(&data, 0, sizeof(data));
+    data.fd = -1;
+    data.size = size;
+    data.flags = flags;
+    return ion.alloc_buffer(data);
+}
+
+static void testAlloc()
+{
+    FakeIonAlloc ion;
+    FakeIonAlloc::Stats stats;
+    alloc_data data;
+    size_t page = getpagesize();
+
+    int ret = alloc(ion, ION_HEAP(ION_SYSTEM_HEAP_ID), page + 1, data);
+    check(ret == 0 && data.fd >= 0 && data.base, "alloc maps a buffer");
+    ion.getStats(stats);
+    check(stats.heapUsed[ION_SYSTEM_HEAP_ID] == 2 * page,
+          "alloc rounds the size up to pages");
+
+    // A second mapping of the same fd sees the same memory
+    memset(data.base, 0x5a, page);
+    void *base = 0;
+    check(ion.map_buffer(&base, 2 * page, 0, data.fd) == 0 &&
+          ((unsigned char *)base)[page - 1] == 0x5a,
+          "map shares the buffer contents");
+    ion.unmap_buffer(base, 2 * page, 0);
+
+    check(ion.clean_buffer(data.base, 2 * page, 0, data.fd,
+                           gralloc::CACHE_CLEAN) == 0,
+          "clean inside the buffer");
+    check(ion.clean_buffer(data.base, 3 * page, 0, data.fd,
+                           gralloc::CACHE_CLEAN) == -EINVAL,
+          "clean past the buffer is refused");
+
+    check(ion.free_buffer(data.base, 2 * page, 0, data.fd) == 0,
+          "free a buffer");
+    ion.getStats(stats);
+    check(stats.heapUsed[ION_SYSTEM_HEAP_ID] == 0 && stats.allocs == 1 &&
+          stats.frees == 1 && stats.maps == 1 && stats.cleans == 1,
+          "stats follow alloc, map, clean and free");
+
+    ret = alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID) | ION_SECURE, page, data);
+    check(ret == 0 && data.fd >= 0 && !data.base,
+          "secure buffers are not mapped");
+    ion.free_buffer(0, page, 0, data.fd);
+}
+
+static void testFailureInjection()
+{
+    FakeIonAlloc ion;
+    FakeIonAlloc::Stats stats;
+    alloc_data data;
+    size_t page = getpagesize();
+
+    ion.injectAllocFailure(ION_HEAP(ION_CP_MM_HEAP_ID), 2, -EIO);
+    check(alloc(ion, ION_HEAP(ION_SYSTEM_HEAP_ID), page, data) == 0,
+          "injection spares heaps outside its mask");
+    ion.free_buffer(data.base, page, 0, data.fd);
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), page, data) == -EIO,
+          "first injected failure");
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), page, data) == -EIO,
+          "second injected failure");
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), page, data) == 0,
+          "injection stops after its count");
+    ion.free_buffer(data.base, page, 0, data.fd);
+    ion.getStats(stats);
+    check(stats.allocFailures == 2 && stats.allocs == 2,
+          "injected failures are counted");
+}
+
+static void testCapacity()
+{
+    FakeIonAlloc ion;
+    FakeIonAlloc::Stats stats;
+    alloc_data a, b, c;
+    size_t page = getpagesize();
+    unsigned int both = ION_HEAP(ION_CP_MM_HEAP_ID) |
+            ION_HEAP(ION_IOMMU_HEAP_ID);
+
+    ion.setHeapCapacity(ION_CP_MM_HEAP_ID, 2 * page);
+    ion.setHeapCapacity(ION_IOMMU_HEAP_ID, page);
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), 2 * page, a) == 0,
+          "alloc up to the heap capacity");
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), page, b) == -ENOMEM,
+          "full heap fails with ENOMEM");
+    check(alloc(ion, both, page, b) == 0,
+          "full heap falls back to the next heap in the mask");
+    ion.getStats(stats);
+    check(stats.heapUsed[ION_IOMMU_HEAP_ID] == page,
+          "fallback is charged to the next heap");
+    check(alloc(ion, both, page, c) == -ENOMEM,
+          "every heap in the mask full fails");
+
+    ion.free_buffer(a.base, 2 * page, 0, a.fd);
+    check(alloc(ion, ION_HEAP(ION_CP_MM_HEAP_ID), page, c) == 0,
+          "free returns capacity to its heap");
+    ion.free_buffer(b.base, page, 0, b.fd);
+    ion.free_buffer(c.base, page, 0, c.fd);
+    ion.getStats(stats);
+    check(stats.heapUsed[ION_CP_MM_HEAP_ID] == 0 &&
+          stats.heapUsed[ION_IOMMU_HEAP_ID] == 0,
+          "heaps are empty after every free");
+}
+
+int main()
+{
+    testAlloc();
+    testFailureInjection();
+    testCapacity();
+    check(FakeIonAlloc::getInstance() == FakeIonAlloc::getInstance(),
+          "getInstance returns one allocator");
+    printf("%d of %d checks failed\n", sFailures, sChecks);
+    return sFailures ? 1 : 0;
+}
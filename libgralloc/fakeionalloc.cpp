@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define DEBUG 0
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cutils/log.h>
+#include <cutils/ashmem.h>
+#include "ion_msm.h"
+#include "fakeionalloc.h"
+
+using gralloc::FakeIonAlloc;
+
+FakeIonAlloc *FakeIonAlloc::sInstance = 0;
+
+FakeIonAlloc* FakeIonAlloc::getInstance()
+{
+    if (sInstance == NULL)
+        sInstance = new FakeIonAlloc();
+    return sInstance;
+}
+
+FakeIonAlloc::FakeIonAlloc() :
+    mFailMask(0), mFailCount(0), mFailErr(0)
+{
+    memset(mCapacity, 0, sizeof(mCapacity));
+    for (int i = 0; i < MAX_BUFFERS; i++)
+        mBuffers[i].fd = FD_INIT;
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+FakeIonAlloc::~FakeIonAlloc()
+{
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (mBuffers[i].fd >= 0) {
+            ALOGW("fakeion: leaked buffer fd:%d size:%zu heap:%d",
+                  mBuffers[i].fd, mBuffers[i].size, mBuffers[i].heapId);
+        }
+    }
+}
+
+void FakeIonAlloc::setHeapCapacity(int heapId, size_t capacity)
+{
+    Locker::Autolock _l(mLock);
+    if (heapId >= 0 && heapId < MAX_HEAPS)
+        mCapacity[heapId] = capacity;
+}
+
+void FakeIonAlloc::injectAllocFailure(unsigned int heapMask, int count,
+                                      int err)
+{
+    Locker::Autolock _l(mLock);
+    mFailMask = heapMask;
+    mFailCount = count;
+    mFailErr = err;
+}
+
+void FakeIonAlloc::getStats(Stats& stats)
+{
+    Locker::Autolock _l(mLock);
+    stats = mStats;
+}
+
+void FakeIonAlloc::resetStats()
+{
+    Locker::Autolock _l(mLock);
+    // Live heap usage is state, not a statistic, so it survives a reset
+    size_t heapUsed[MAX_HEAPS];
+    memcpy(heapUsed, mStats.heapUsed, sizeof(heapUsed));
+    memset(&mStats, 0, sizeof(mStats));
+    memcpy(mStats.heapUsed, heapUsed, sizeof(heapUsed));
+}
+
+int FakeIonAlloc::createShmem(size_t size)
+{
+    int fd = -1;
+#ifdef __NR_memfd_create
+    fd = syscall(__NR_memfd_create, "fake-ion", 0);
+    if (fd >= 0) {
+        if (ftruncate(fd, size)) {
+            int err = -errno;
+            close(fd);
+            return err;
+        }
+        return fd;
+    }
+#endif
+    // Kernels without memfd: ashmem is sized at creation
+    fd = ashmem_create_region("fake-ion", size);
+    if (fd < 0)
+        return errno ? -errno : -ENOMEM;
+    return fd;
+}
+
+int FakeIonAlloc::pickHeapLocked(unsigned int heapMask, size_t size)
+{
+    // Like ION, heaps are tried in order of their ids
+    for (int id = 0; id < MAX_HEAPS; id++) {
+        if (!(heapMask & ION_HEAP(id)) || id == ION_HEAP_ID_RESERVED)
+            continue;
+        if (!mCapacity[id] || mStats.heapUsed[id] + size <= mCapacity[id])
+            return id;
+    }
+    return -1;
+}
+
+FakeIonAlloc::Buffer* FakeIonAlloc::findBufferLocked(int fd)
+{
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (mBuffers[i].fd == fd)
+            return &mBuffers[i];
+    }
+    return NULL;
+}
+
+int FakeIonAlloc::alloc_buffer(alloc_data& data)
+{
+    void *base = 0;
+    size_t align = data.align ? data.align : getpagesize();
+
+    if (align & (align - 1)) {
+        ALOGE("fakeion: alignment %zu is not a power of two", align);
+        return -EINVAL;
+    }
+    size_t size = ALIGN(data.size, getpagesize());
+
+    Locker::Autolock _l(mLock);
+    if (mFailCount && (data.flags & mFailMask)) {
+        mFailCount--;
+        mStats.allocFailures++;
+        return mFailErr;
+    }
+
+    int heapId = pickHeapLocked(data.flags, size);
+    Buffer* buf = findBufferLocked(FD_INIT);
+    if (heapId < 0 || !buf) {
+        mStats.allocFailures++;
+        ALOGD_IF(DEBUG, "fakeion: out of memory, mask:0x%x size:%zu",
+                 data.flags, size);
+        return -ENOMEM;
+    }
+
+    int fd = createShmem(size);
+    if (fd < 0) {
+        mStats.allocFailures++;
+        return fd;
+    }
+
+    if (!(data.flags & ION_SECURE)) {
+        // The backing file is already zero filled, no memset needed
+        base = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            int err = -errno;
+            ALOGE("fakeion: Failed to map the allocated memory: %s",
+                  strerror(errno));
+            close(fd);
+            mStats.allocFailures++;
+            return err;
+        }
+    }
+
+    buf->fd = fd;
+    buf->heapId = heapId;
+    buf->size = size;
+    mStats.heapUsed[heapId] += size;
+    mStats.allocs++;
+
+    data.base = base;
+    data.fd = fd;
+    ALOGD_IF(DEBUG, "fakeion: Allocated buffer base:%p size:%zu fd:%d heap:%d",
+             base, size, fd, heapId);
+    return 0;
+}
+
+int FakeIonAlloc::free_buffer(void* base, size_t size, int offset, int fd)
+{
+    int err = 0;
+    if (base)
+        err = unmap_buffer(base, size, offset);
+
+    Locker::Autolock _l(mLock);
+    Buffer* buf = findBufferLocked(fd);
+    if (buf) {
+        mStats.heapUsed[buf->heapId] -= buf->size;
+        buf->fd = FD_INIT;
+    } else {
+        ALOGE("fakeion: freeing unknown fd:%d", fd);
+        err = -EINVAL;
+    }
+    mStats.frees++;
+    close(fd);
+    return err;
+}
+
+int FakeIonAlloc::map_buffer(void **pBase, size_t size, int offset, int fd)
+{
+    int err = 0;
+    void *base = mmap(0, size, PROT_READ| PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    *pBase = base;
+    if (base == MAP_FAILED) {
+        err = -errno;
+        ALOGE("fakeion: Failed to map memory in the client: %s",
+              strerror(errno));
+    } else {
+        Locker::Autolock _l(mLock);
+        mStats.maps++;
+    }
+    return err;
+}
+
+int FakeIonAlloc::unmap_buffer(void *base, size_t size, int offset)
+{
+    int err = 0;
+    if (munmap(base, size)) {
+        err = -errno;
+        ALOGE("fakeion: Failed to unmap memory at %p : %s",
+              base, strerror(errno));
+    }
+    return err;
+}
+
+int FakeIonAlloc::clean_buffer(void *base, size_t size, int offset,
+                               int fd, int op)
+{
+    Locker::Autolock _l(mLock);
+    Buffer* buf = findBufferLocked(fd);
+    // Same range check the kernel does before touching the caches. Fds
+    // imported from another process are not tracked and always pass.
+    if (buf && (size_t)offset + size > buf->size) {
+        ALOGE("fakeion: cache op on invalid range fd:%d off:%d size:%zu",
+              fd, offset, size);
+        return -EINVAL;
+    }
+    // Shared memory is coherent, only the operations are accounted
+    if (op == CACHE_CLEAN || op == CACHE_CLEAN_AND_INVALIDATE)
+        mStats.cleans++;
+    if (op == CACHE_INVALIDATE || op == CACHE_CLEAN_AND_INVALIDATE)
+        mStats.invalidates++;
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRALLOC_FAKEIONALLOC_H
+#define GRALLOC_FAKEIONALLOC_H
+
+#include "memalloc.h"
+#include "gr.h"
+
+namespace gralloc {
+
+/*
+ * Software stand-in for the ION device, the allocator of IAllocController
+ * when USE_FAKE_ION is set. Buffers are anonymous shared memory, so they
+ * can be mapped, shared and freed exactly like ION fds on a system without
+ * /dev/ion. Heaps are modelled by a per heap id capacity, and failures can
+ * be injected to exercise fallback paths.
+ */
+class FakeIonAlloc : public IMemAlloc  {
+
+    public:
+    virtual int alloc_buffer(alloc_data& data);
+
+    virtual int free_buffer(void *base, size_t size,
+                            int offset, int fd);
+
+    virtual int map_buffer(void **pBase, size_t size,
+                           int offset, int fd);
+
+    virtual int unmap_buffer(void *base, size_t size,
+                             int offset);
+
+    virtual int clean_buffer(void*base, size_t size,
+                             int offset, int fd, int op);
+
+    FakeIonAlloc();
+
+    ~FakeIonAlloc();
+
+    // The instance IAllocController allocates from with USE_FAKE_ION, for
+    // tests that inject failures or read stats behind gralloc
+    static FakeIonAlloc* getInstance();
+
+    enum { MAX_HEAPS = 32, MAX_BUFFERS = 256 };
+
+    struct Stats {
+        uint32_t allocs;
+        uint32_t allocFailures;
+        uint32_t frees;
+        uint32_t maps;
+        uint32_t cleans;
+        uint32_t invalidates;
+        size_t   heapUsed[MAX_HEAPS];
+    };
+
+    // Limits the bytes that can be live in a heap, 0 means unlimited
+    void setHeapCapacity(int heapId, size_t capacity);
+
+    // Fails the next count allocations that target any heap in heapMask
+    // with err, regardless of capacity.
+    void injectAllocFailure(unsigned int heapMask, int count, int err);
+
+    void getStats(Stats& stats);
+
+    void resetStats();
+
+    private:
+    struct Buffer {
+        int fd;
+        int heapId;
+        size_t size;
+    };
+
+    int createShmem(size_t size);
+
+    // Picks the first heap in the mask with room for size, -1 if none.
+    // Must be called with mLock held.
+    int pickHeapLocked(unsigned int heapMask, size_t size);
+
+    Buffer* findBufferLocked(int fd);
+
+    static FakeIonAlloc *sInstance;
+    size_t mCapacity[MAX_HEAPS];
+    Buffer mBuffers[MAX_BUFFERS];
+    unsigned int mFailMask;
+    int mFailCount;
+    int mFailErr;
+    Stats mStats;
+    Locker mLock;
+};
+
+}
+
+#endif /* GRALLOC_FAKEIONALLOC_H */
@@ -31,6 +31,8 @@
 #include "gpu.h"
 #include "memalloc.h"
 #include "alloc_controller.h"
+#include "release_queue.h"
+#include "alloc_stats.h"
 
 using namespace gralloc;
 
@@ -40,10 +42,14 @@ using namespace gralloc;
 using namespace gralloc;
 
 #define SZ_1M 0x100000
+// Default cap on memory held by buffers waiting for deferred release
+#define DEFAULT_RELEASE_QUEUE_SIZE (64 * SZ_1M)
+// Upper bound for debug.gralloc.async_free.mb
+#define MAX_RELEASE_QUEUE_MB 1024
 
 gpu_context_t::gpu_context_t(const private_module_t* module,
                              IAllocController* alloc_ctrl ) :
-    mAllocCtrl(alloc_ctrl)
+    mAllocCtrl(alloc_ctrl), mReleaseQueue(NULL)
 {
     // Zero out the alloc_device_t
     memset(static_cast<alloc_device_t*>(this), 0, sizeof(alloc_device_t));
@@ -60,6 +66,33 @@ gpu_context_t::gpu_context_t(const private_module_t* module,
 #endif
     free           = gralloc_free;
 
+    char property[PROPERTY_VALUE_MAX];
+    if((property_get("debug.gralloc.async_free", property, NULL) > 0) &&
+       (!strncmp(property, "1", PROPERTY_VALUE_MAX ) ||
+        (!strncasecmp(property,"true", PROPERTY_VALUE_MAX )))) {
+        size_t maxSize = DEFAULT_RELEASE_QUEUE_SIZE;
+        if(property_get("debug.gralloc.async_free.mb", property, NULL) > 0) {
+            int mb = atoi(property);
+            if(mb > MAX_RELEASE_QUEUE_MB)
+                mb = MAX_RELEASE_QUEUE_MB;
+            if(mb > 0)
+                maxSize = (size_t)mb * SZ_1M;
+            else
+                ALOGE("%s: ignoring debug.gralloc.async_free.mb=%s",
+                      __FUNCTION__, property);
+        }
+        mReleaseQueue = new ReleaseQueue(this, maxSize);
+        if(!mReleaseQueue->init()) {
+            delete mReleaseQueue;
+            mReleaseQueue = NULL;
+        }
+    }
+}
+
+gpu_context_t::~gpu_context_t()
+{
+    // Joins the release thread and frees anything still queued
+    delete mReleaseQueue;
 }
 
 int gpu_context_t::gralloc_alloc_framebuffer_locked(size_t size, int usage,
@@ -161,6 +194,12 @@ int gpu_context_t::gralloc_alloc_buffer(size_t size, int usage,
     data.pHandle = (unsigned int) pHandle;
     err = mAllocCtrl->allocate(data, usage);
 
+    if (err && mReleaseQueue && mReleaseQueue->getPendingSize()) {
+        // Memory may still be held by deferred frees, reclaim and retry
+        mReleaseQueue->flush();
+        err = mAllocCtrl->allocate(data, usage);
+    }
+
     if (!err) {
 #ifdef QCOM_BSP
         /* allocate memory for enhancement data */
@@ -232,6 +271,7 @@ int gpu_context_t::gralloc_alloc_buffer(size_t size, int usage,
 #ifdef QCOM_BSP
         hnd->gpuaddr = 0;
 #endif
+        AllocStats::getInstance().onAlloc(hnd, usage, data.flags);
 
         *pHandle = hnd;
     }
@@ -350,13 +390,27 @@ int gpu_context_t::free_impl(private_handle_t const* hnd) {
         const size_t bufferSize = m->finfo.line_length * m->info.yres;
         int index = (hnd->base - m->framebuffer->base) / bufferSize;
         m->bufferMask &= ~(1<<index);
-    } else {
+    } else if (mReleaseQueue && mReleaseQueue->queue(hnd)) {
+        // The release thread unmaps and closes the buffer
+        return 0;
+    }
+    return release_impl(hnd);
+}
+
+int gpu_context_t::release_impl(private_handle_t const* hnd) {
+    private_module_t* m = reinterpret_cast<private_module_t*>(common.module);
+    int err = 0;
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        AllocStats::getInstance().onFree(hnd);
         terminateBuffer(&m->base, const_cast<private_handle_t*>(hnd));
         IMemAlloc* memalloc = mAllocCtrl->getAllocator(hnd->flags);
-        int err = memalloc->free_buffer((void*)hnd->base, (size_t) hnd->size,
-                                        hnd->offset, hnd->fd);
-        if(err)
+        err = memalloc->free_buffer((void*)hnd->base, (size_t) hnd->size,
+                                    hnd->offset, hnd->fd);
+        if(err) {
+            ALOGE("%s: free_buffer failed for fd %d", __FUNCTION__, hnd->fd);
             return err;
+        }
+#ifdef QCOM_BSP
         // free the metadata space
         unsigned long size = ROUND_UP_PAGESIZE(sizeof(MetaData_t));
         err = memalloc->free_buffer((void*)hnd->base_metadata,
@@ -364,29 +418,8 @@ int gpu_context_t::free_impl(private_handle_t const* hnd) {
                                     hnd->fd_metadata);
         if (err)
             return err;
-    }
-
-    // Release the genlock
-    int err = genlock_release_lock((native_handle_t*)hnd);
-    if (err) {
-        ALOGE("%s: genlock_release_lock failed", __FUNCTION__);
-    }
-
-    terminateBuffer(&m->base, const_cast<private_handle_t*>(hnd));
-    IMemAlloc* memalloc = mAllocCtrl->getAllocator(hnd->flags);
-    int err = memalloc->free_buffer((void*)hnd->base, (size_t) hnd->size,
-                                    hnd->offset, hnd->fd);
-    if(err)
-        return err;
-#ifdef QCOM_BSP
-    // free the metadata space
-    unsigned long size = ROUND_UP_PAGESIZE(sizeof(MetaData_t));
-    err = memalloc->free_buffer((void*)hnd->base_metadata,
-                                (size_t) size, hnd->offset_metadata,
-                                hnd->fd_metadata);
-    if (err)
-        return err;
 #endif
+    }
 
 #ifndef QCOM_BSP
     // Release the genlock
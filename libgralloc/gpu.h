@@ -35,11 +35,14 @@
 
 namespace gralloc {
 class IAllocController;
+class ReleaseQueue;
 class gpu_context_t : public alloc_device_t {
     public:
     gpu_context_t(const private_module_t* module,
                   IAllocController* alloc_ctrl);
 
+    ~gpu_context_t();
+
     int gralloc_alloc_framebuffer_locked(size_t size, int usage,
                                          buffer_handle_t* pHandle);
 
@@ -53,6 +56,9 @@ class gpu_context_t : public alloc_device_t {
 
     int free_impl(private_handle_t const* hnd);
 
+    // Unmaps and frees the buffer and deletes the handle
+    int release_impl(private_handle_t const* hnd);
+
     int alloc_impl(int w, int h, int format, int usage,
                    buffer_handle_t* pHandle, int* pStride,
                    size_t bufferSize = 0);
@@ -73,6 +79,8 @@ class gpu_context_t : public alloc_device_t {
 
     private:
    IAllocController* mAllocCtrl;
+    // Deferred buffer release, NULL when frees are synchronous
+    ReleaseQueue* mReleaseQueue;
     void getGrallocInformationFromFormat(int inputFormat,
                                          int *colorFormat,
                                          int *bufferType);
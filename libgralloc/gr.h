@@ -78,6 +78,7 @@ class Locker {
     inline Locker()        { pthread_mutex_init(&mutex, 0); }
     inline ~Locker()       { pthread_mutex_destroy(&mutex); }
     inline void lock()     { pthread_mutex_lock(&mutex); }
+    inline bool tryLock()  { return pthread_mutex_trylock(&mutex) == 0; }
     inline void unlock()   { pthread_mutex_unlock(&mutex); }
 };
 
@@ -97,6 +98,14 @@ class AdrenoMemInfo : public android::Singleton <AdrenoMemInfo>
     int getStride(int width, int format);
 
     private:
+        enum { STRIDE_CACHE_SIZE = 16 };
+
+        // Padded stride of an RGB surface, memoized per (width, format)
+        int getPaddedStride(int width, int format, int bpp);
+
+        // Recently computed padded strides, see getPaddedStride
+        volatile int32_t mStrideCache[STRIDE_CACHE_SIZE];
+
         // Pointer to the padding library.
         void *libadreno_utils;
 
@@ -128,6 +128,37 @@ enum {
     GRALLOC_MODULE_PERFORM_CREATE_HANDLE_FROM_BUFFER = 0x080000001,
 #endif
     GRALLOC_MODULE_PERFORM_GET_STRIDE,
+    GRALLOC_MODULE_PERFORM_GET_ALLOC_STATS,
+    GRALLOC_MODULE_PERFORM_DUMP_ALLOC_STATS,
+};
+
+/* Dimensions of the allocation accounting, used as the first argument of
+ * GRALLOC_MODULE_PERFORM_GET_ALLOC_STATS. The second argument is the key
+ * within the dimension, the third a pointer to an AllocCounter_t.
+ */
+enum {
+    GRALLOC_STATS_TOTAL = 0,    /* key is ignored */
+    GRALLOC_STATS_HEAP,         /* key is the ION heap mask */
+    GRALLOC_STATS_USAGE,        /* key is a GRALLOC_USAGE_CLASS_* */
+    GRALLOC_STATS_FORMAT,       /* key is the HAL pixel format */
+    GRALLOC_STATS_PID,          /* key is the pid the buffer was made for */
+    GRALLOC_STATS_DIMENSION_COUNT,
+};
+
+/* Key of the bucket holding the keys of a dimension past its tracked ones,
+ * and the history of keys whose bucket was recycled */
+#define GRALLOC_STATS_KEY_OTHER (-1)
+
+/* Usage classes, in the order they are matched against the usage bits */
+enum {
+    GRALLOC_USAGE_CLASS_PROTECTED = 0,
+    GRALLOC_USAGE_CLASS_CAMERA,
+    GRALLOC_USAGE_CLASS_VIDEO_ENCODER,
+    GRALLOC_USAGE_CLASS_VIDEO,
+    GRALLOC_USAGE_CLASS_COMPOSER,
+    GRALLOC_USAGE_CLASS_GPU,
+    GRALLOC_USAGE_CLASS_SW,
+    GRALLOC_USAGE_CLASS_OTHER,
 };
 
 #define GRALLOC_HEAP_MASK   (GRALLOC_USAGE_PRIVATE_UI_CONTIG_HEAP |\
@@ -185,6 +216,13 @@ typedef struct {
     float   contrast;
 } HSICData_t;
 
+typedef struct {
+    uint32_t liveCount;     /* buffers currently allocated */
+    uint32_t allocCount;    /* buffers allocated since boot */
+    uint32_t liveBytes;
+    uint32_t peakBytes;     /* high-water mark of liveBytes */
+} AllocCounter_t;
+
 typedef struct {
     int32_t operation;
     int32_t interlaced;
@@ -34,7 +34,9 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <cutils/log.h>
+#include <cutils/atomic.h>
 #include <errno.h>
+#include <strings.h>
 #include "gralloc_priv.h"
 #include <gralloc_priv.h>
 #include "ionalloc.h"
@@ -50,15 +52,23 @@ using gralloc::IonAlloc;
 
 int IonAlloc::open_device()
 {
-    if(mIonFd == FD_INIT)
-        mIonFd = open(ION_DEVICE, O_RDONLY);
+    // Fast path: once the device is open the fd is never changed again
+    // until the allocator is destroyed, so readers need no lock.
+    if(mIonFd >= 0)
+        return 0;
+
+    Locker::Autolock _l(mOpenLock);
+    if(mIonFd >= 0)
+        return 0;
 
-    if(mIonFd < 0 ) {
+    int fd = open(ION_DEVICE, O_RDONLY);
+    if(fd < 0) {
+        int err = -errno;
         ALOGE("%s: Failed to open ion device - %s",
               __FUNCTION__, strerror(errno));
-        mIonFd = FD_INIT;
-        return -errno;
+        return err;
     }
+    android_atomic_release_store(fd, &mIonFd);
     return 0;
 }
 
@@ -69,28 +79,36 @@ void IonAlloc::close_device()
     mIonFd = FD_INIT;
 }
 
+// Heaps are served by independent kernel allocators, so only requests
+// targeting the same heap need to be ordered against each other.
+Locker& IonAlloc::getHeapLock(unsigned int heapMask)
+{
+    int heapId = ffs(heapMask & ~ION_SECURE);
+    return mHeapLock[heapId % ION_HEAP_LOCK_COUNT];
+}
+
+void IonAlloc::lockHeap(Locker& heapLock)
+{
+    if(!heapLock.tryLock()) {
+        android_atomic_inc(&mContentionCount);
+        heapLock.lock();
+    }
+}
+
 int IonAlloc::alloc_buffer(alloc_data& data)
 {
-    Locker::Autolock _l(mLock);
     int err = 0;
-    int ionSyncFd = FD_INIT;
-    int iFd = FD_INIT;
     struct ion_handle_data handle_data;
     struct ion_fd_data fd_data;
     struct ion_allocation_data ionAllocData;
-
+    void *base = 0;
 #ifndef NEW_ION_API
     int ionSyncFd = FD_INIT;
-    int iFd = FD_INIT;
 #endif
-    struct ion_handle_data handle_data;
-    struct ion_fd_data fd_data;
-    struct ion_allocation_data ionAllocData;
-    void *base = 0;
+    int iFd = FD_INIT;
 
     ionAllocData.len = data.size;
     ionAllocData.align = data.align;
-    ionAllocData.flags = data.flags;
 #ifndef NEW_ION_API
     ionAllocData.flags = data.flags;
 #else
@@ -106,13 +124,10 @@ int IonAlloc::alloc_buffer(alloc_data& data)
     if (err)
         return err;
 
+#ifndef NEW_ION_API
     if(data.uncached) {
         // Use the sync FD to alloc and map
         // when we need uncached memory
-#ifndef NEW_ION_API
-    if(data.uncached) {
-        // Use the sync FD to alloc and map 93
-        // when we need uncached memory 94
         ionSyncFd = open(ION_DEVICE, O_RDONLY|O_DSYNC);
         if(ionSyncFd < 0) {
             ALOGE("%s: Failed to open ion device - %s",
@@ -123,46 +138,36 @@ int IonAlloc::alloc_buffer(alloc_data& data)
     } else {
         iFd = mIonFd;
     }
-
-    if(ioctl(iFd, ION_IOC_ALLOC, &ionAllocData)) {
-        err = -errno;
-        ALOGE("ION_IOC_ALLOC failed with error - %s", strerror(errno));
-        if(ionSyncFd >= 0)
-            close(ionSyncFd);
-        ionSyncFd = FD_INIT;
 #else
-    if(ioctl(mIonFd, ION_IOC_ALLOC, &ionAllocData)) {
+    iFd = mIonFd;
 #endif
+
+    // Only the heap allocation itself is ordered per heap; export,
+    // mapping and zeroing of the buffer run without any lock held.
+    Locker& heapLock = getHeapLock(data.flags);
+    lockHeap(heapLock);
+    if(ioctl(iFd, ION_IOC_ALLOC, &ionAllocData)) {
         err = -errno;
-        ALOGE("ION_IOC_ALLOC failed with error - %s", strerror(errno));
+        heapLock.unlock();
+        ALOGE("ION_IOC_ALLOC failed with error - %s", strerror(-err));
 #ifndef NEW_ION_API
         if(ionSyncFd >= 0)
             close(ionSyncFd);
-        ionSyncFd = FD_INIT;
 #endif
         return err;
     }
+    heapLock.unlock();
 
     fd_data.handle = ionAllocData.handle;
     handle_data.handle = ionAllocData.handle;
     if(ioctl(iFd, ION_IOC_MAP, &fd_data)) {
-#ifndef NEW_ION_API
-    if(ioctl(iFd, ION_IOC_MAP, &fd_data))
-#else
-    if(ioctl(mIonFd, ION_IOC_MAP, &fd_data))
-#endif
-    {
         err = -errno;
         ALOGE("%s: ION_IOC_MAP failed with error - %s",
-              __FUNCTION__, strerror(errno));
+              __FUNCTION__, strerror(-err));
         ioctl(mIonFd, ION_IOC_FREE, &handle_data);
-        if(ionSyncFd >= 0)
-            close(ionSyncFd);
-        ionSyncFd = FD_INIT;
 #ifndef NEW_ION_API
         if(ionSyncFd >= 0)
             close(ionSyncFd);
-        ionSyncFd = FD_INIT;
 #endif
         return err;
     }
@@ -173,21 +178,17 @@ int IonAlloc::alloc_buffer(alloc_data& data)
         if(base == MAP_FAILED) {
             err = -errno;
             ALOGE("%s: Failed to map the allocated memory: %s",
-                  __FUNCTION__, strerror(errno));
+                  __FUNCTION__, strerror(-err));
             ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+            close(fd_data.fd);
+#ifndef NEW_ION_API
             if(ionSyncFd >= 0)
                 close(ionSyncFd);
-            ionSyncFd = FD_INIT;
-#ifndef NEW_ION_API
-            ionSyncFd = FD_INIT;
 #endif
             return err;
         }
         memset(base, 0, ionAllocData.len);
         // Clean cache after memset
-        clean_buffer(base, data.size, data.offset, fd_data.fd);
-    }
-
         clean_buffer(base, data.size, data.offset, fd_data.fd,
                      CACHE_CLEAN_AND_INVALIDATE);
     }
@@ -196,7 +197,6 @@ int IonAlloc::alloc_buffer(alloc_data& data)
     //Close the uncached FD since we no longer need it;
     if(ionSyncFd >= 0)
         close(ionSyncFd);
-    ionSyncFd = FD_INIT;
 #endif
 
     data.base = base;
@@ -210,7 +210,6 @@ int IonAlloc::alloc_buffer(alloc_data& data)
 
 int IonAlloc::free_buffer(void* base, size_t size, int offset, int fd)
 {
-    Locker::Autolock _l(mLock);
     ALOGD_IF(DEBUG, "ion: Freeing buffer base:%p size:%d fd:%d",
           base, size, fd);
     int err = 0;
@@ -58,18 +58,32 @@ class IonAlloc : public IMemAlloc  {
                              int offset, int fd);
                              int offset, int fd, int op);
 
-    IonAlloc() { mIonFd = FD_INIT; }
+    IonAlloc() : mIonFd(FD_INIT), mContentionCount(0) { }
 
     ~IonAlloc() { close_device(); }
 
+    // Number of allocations that found their heap lock already taken
+    virtual int getContentionCount() const { return mContentionCount; }
+
     private:
-    int mIonFd;
+    enum { ION_HEAP_LOCK_COUNT = 8 };
+
+    // Written once under mOpenLock, read lock-free afterwards
+    volatile int32_t mIonFd;
+
+    volatile int32_t mContentionCount;
 
     int open_device();
 
     void close_device();
 
-    mutable Locker mLock;
+    Locker& getHeapLock(unsigned int heapMask);
+
+    void lockHeap(Locker& heapLock);
+
+    Locker mOpenLock;
+
+    Locker mHeapLock[ION_HEAP_LOCK_COUNT];
 
 };
 
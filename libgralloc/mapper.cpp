@@ -17,6 +17,7 @@
  */
 
 #include <limits.h>
+#include <stdio.h>
 #include <errno.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -54,6 +55,7 @@
 #include "alloc_controller.h"
 #include "memalloc.h"
 #include <qdMetaData.h>
+#include "alloc_stats.h"
 
 using namespace gralloc;
 /*****************************************************************************/
@@ -508,6 +510,29 @@ int gralloc_perform(struct gralloc_module_t const* module,
                 *stride = AdrenoMemInfo::getInstance().getStride(width, format);
                 res = 0;
             } break;
+        case GRALLOC_MODULE_PERFORM_GET_ALLOC_STATS:
+            {
+                int dimension = va_arg(args, int);
+                int key = va_arg(args, int);
+                AllocCounter_t* counter = va_arg(args, AllocCounter_t*);
+                res = AllocStats::getInstance().getCounter(dimension, key,
+                                                           counter);
+            } break;
+        case GRALLOC_MODULE_PERFORM_DUMP_ALLOC_STATS:
+            {
+                char* buf = va_arg(args, char*);
+                int len = va_arg(args, int);
+                AllocStats::getInstance().dump(buf, len);
+                IMemAlloc* memalloc =
+                        getAllocator(private_handle_t::PRIV_FLAGS_USES_ION);
+                if (buf && len > 0 && memalloc) {
+                    char str[64];
+                    snprintf(str, sizeof(str), "ION heap lock contention: "
+                             "%d\n", memalloc->getContentionCount());
+                    strlcat(buf, str, len);
+                }
+                res = 0;
+            } break;
         default:
             break;
     }
@@ -78,6 +78,10 @@ class IMemAlloc {
                              int offset, int fd) = 0;
                              int offset, int fd, int op) = 0;
 
+    // Allocations that found their heap lock already taken, 0 for
+    // allocators without per heap locks
+    virtual int getContentionCount() const { return 0; }
+
     // Destructor
     virtual ~IMemAlloc() {};
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <cutils/log.h>
+#include <system/thread_defs.h>
+#include "gpu.h"
+#include "release_queue.h"
+
+using namespace gralloc;
+
+ReleaseQueue::ReleaseQueue(gpu_context_t* ctx, size_t maxPendingBytes) :
+    mCtx(ctx), mMaxPendingBytes(maxPendingBytes), mPendingBytes(0),
+    mHead(0), mCount(0), mBusy(0), mStop(false), mStarted(false)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mIdleCond, NULL);
+}
+
+ReleaseQueue::~ReleaseQueue()
+{
+    if(mStarted) {
+        pthread_mutex_lock(&mLock);
+        mStop = true;
+        pthread_cond_signal(&mWorkCond);
+        pthread_mutex_unlock(&mLock);
+        pthread_join(mThread, NULL);
+    }
+    // Anything still queued is released on the caller's thread
+    flush();
+    pthread_cond_destroy(&mIdleCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+bool ReleaseQueue::init()
+{
+    if(pthread_create(&mThread, NULL, threadLoop, this)) {
+        ALOGE("%s: failed to create release thread", __FUNCTION__);
+        return false;
+    }
+    mStarted = true;
+    return true;
+}
+
+bool ReleaseQueue::queue(private_handle_t const* hnd)
+{
+    bool queued = false;
+    pthread_mutex_lock(&mLock);
+    if(mStarted && !mStop && mCount < MAX_PENDING &&
+       mPendingBytes + hnd->size <= mMaxPendingBytes) {
+        mRing[(mHead + mCount) % MAX_PENDING] = hnd;
+        mCount++;
+        mPendingBytes += hnd->size;
+        pthread_cond_signal(&mWorkCond);
+        queued = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    return queued;
+}
+
+private_handle_t const* ReleaseQueue::popLocked()
+{
+    private_handle_t const* hnd = mRing[mHead];
+    mHead = (mHead + 1) % MAX_PENDING;
+    mCount--;
+    mBusy++;
+    return hnd;
+}
+
+void ReleaseQueue::flush()
+{
+    pthread_mutex_lock(&mLock);
+    while(mCount) {
+        private_handle_t const* hnd = popLocked();
+        size_t size = hnd->size;
+        pthread_mutex_unlock(&mLock);
+        mCtx->release_impl(hnd);
+        pthread_mutex_lock(&mLock);
+        mBusy--;
+        mPendingBytes -= size;
+        if(!mBusy)
+            pthread_cond_broadcast(&mIdleCond);
+    }
+    // Wait for the buffer the worker may be tearing down right now
+    while(mBusy)
+        pthread_cond_wait(&mIdleCond, &mLock);
+    pthread_mutex_unlock(&mLock);
+}
+
+size_t ReleaseQueue::getPendingSize()
+{
+    pthread_mutex_lock(&mLock);
+    size_t size = mPendingBytes;
+    pthread_mutex_unlock(&mLock);
+    return size;
+}
+
+void* ReleaseQueue::threadLoop(void* arg)
+{
+    ReleaseQueue* queue = reinterpret_cast<ReleaseQueue*>(arg);
+    char thread_name[64] = "grallocRelThr";
+    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+
+    pthread_mutex_lock(&queue->mLock);
+    while(!queue->mStop) {
+        if(!queue->mCount) {
+            pthread_cond_wait(&queue->mWorkCond, &queue->mLock);
+            continue;
+        }
+        private_handle_t const* hnd = queue->popLocked();
+        size_t size = hnd->size;
+        pthread_mutex_unlock(&queue->mLock);
+        queue->mCtx->release_impl(hnd);
+        pthread_mutex_lock(&queue->mLock);
+        queue->mBusy--;
+        queue->mPendingBytes -= size;
+        if(!queue->mBusy)
+            pthread_cond_broadcast(&queue->mIdleCond);
+    }
+    pthread_mutex_unlock(&queue->mLock);
+    return NULL;
+}
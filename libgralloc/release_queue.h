@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_RELEASE_QUEUE_H
+#define GRALLOC_RELEASE_QUEUE_H
+
+#include <pthread.h>
+#include <gralloc_priv.h>
+
+namespace gralloc {
+
+class gpu_context_t;
+
+/*
+ * Defers the teardown of gralloc buffers (unmap, fd close, genlock release)
+ * to a worker thread so that gralloc_free returns immediately.
+ * The number of queued buffers and the memory they hold are bounded;
+ * once either limit is hit the caller frees synchronously instead.
+ */
+class ReleaseQueue {
+    public:
+    ReleaseQueue(gpu_context_t* ctx, size_t maxPendingBytes);
+
+    ~ReleaseQueue();
+
+    // Starts the worker thread. Returns false if the queue cannot be used.
+    bool init();
+
+    // Hands the buffer over to the worker. Returns false if the caller
+    // must release the buffer itself.
+    bool queue(private_handle_t const* hnd);
+
+    // Releases every pending buffer and waits for the worker to go idle,
+    // so that all queued memory is back in the heaps on return.
+    void flush();
+
+    // Memory held by buffers that are queued or being released
+    size_t getPendingSize();
+
+    private:
+    enum { MAX_PENDING = 32 };
+
+    static void* threadLoop(void* arg);
+
+    // Pops the oldest entry. Must be called with mLock held.
+    private_handle_t const* popLocked();
+
+    gpu_context_t* mCtx;
+    size_t mMaxPendingBytes;
+    size_t mPendingBytes;
+    private_handle_t const* mRing[MAX_PENDING];
+    int mHead;
+    int mCount;
+    int mBusy;
+    bool mStop;
+    bool mStarted;
+    pthread_t mThread;
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond;
+    pthread_cond_t mIdleCond;
+};
+
+} // namespace gralloc
+
+#endif // GRALLOC_RELEASE_QUEUE_H
@@ -14,7 +14,7 @@ LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"hwcomposer\"
 LOCAL_SHARED_LIBRARIES        := $(common_libs) libEGL liboverlay \
                                  libexternal libqdutils libhardware_legacy \
                                  libdl libmemalloc libqservice libsync \
-                                 libbinder libmedia
+                                 libbinder libmedia libqdbwmodel
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcomposer\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
 LOCAL_SRC_FILES               := hwc.cpp          \
@@ -60,6 +60,49 @@ LOCAL_SRC_FILES               := hwc_service.cpp \
                                  hwc_fbupdate.cpp \
                                  hwc_mdpcomp.cpp  \
                                  hwc_copybit.cpp  \
-                                 hwc_qclient.cpp
+                                 hwc_qclient.cpp  \
+                                 hwc_trace.cpp    \
+                                 hwc_frametiming.cpp \
+                                 hwc_layer_cache.cpp
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Replays a debug.hwc.capture trace against the fake MDP driver and fake
+# ION heaps, on any target
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := hwcreplay
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+# sw_sync.h, for replaying acquire fences
+LOCAL_C_INCLUDES              += system/core/libsync
+LOCAL_SHARED_LIBRARIES        := $(common_libs) liboverlay libmemalloc libsync
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"hwcreplay\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps) $(kernel_deps)
+LOCAL_SRC_FILES               := hwc_replay.cpp
+
+include $(BUILD_EXECUTABLE)
+
+# Checks the MDPComp pipe type solver against the old greedy order
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := hwc_pipe_solver_test
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(common_libs) liboverlay
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"hwcpipesolver\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := hwc_pipe_solver_test.cpp
+
+include $(BUILD_EXECUTABLE)
+
+# Checks that a mixed mode FB batch gets cached once its layers settle
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := hwc_layer_cache_test
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(common_libs)
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"hwclayercache\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := hwc_layer_cache_test.cpp \
+                                 hwc_layer_cache.cpp
+
+include $(BUILD_EXECUTABLE)
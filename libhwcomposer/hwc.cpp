@@ -44,8 +44,12 @@
 using namespace qhwc;
 #include <utils/Trace.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <cutils/properties.h>
 #include <overlay.h>
 #include <overlayRotator.h>
+#include <mdpBackend.h>
 #include <mdp_version.h>
 #include "hwc_utils.h"
 #include "hwc_video.h"
@@ -53,10 +57,13 @@ using namespace qhwc;
 #include "hwc_mdpcomp.h"
 #include "external.h"
 #include "hwc_copybit.h"
+#include "hwc_trace.h"
+#include "hwc_frametiming.h"
 #include "profiler.h"
 
 using namespace qhwc;
 #define VSYNC_DEBUG 0
+#define HWC_SET_THREAD_NAME "hwcSetThread"
 
 static int hwc_device_open(const struct hw_module_t* module,
                            const char* name,
@@ -190,7 +197,8 @@ static int display_commit(hwc_context_t *ctx, int dpy) {
     struct mdp_display_commit commit_info;
     memset(&commit_info, 0, sizeof(struct mdp_display_commit));
     commit_info.flags = MDP_DISPLAY_COMMIT_OVERLAY;
-    if(ioctl(ctx->dpyAttr[dpy].fd, MSMFB_DISPLAY_COMMIT, &commit_info) == -1) {
+    if(overlay::mdp_wrapper::getBackend()->ioctl(ctx->dpyAttr[dpy].fd,
+            MSMFB_DISPLAY_COMMIT, &commit_info) == -1) {
        ALOGE("%s: MSMFB_DISPLAY_COMMIT for primary failed", __FUNCTION__);
        return -errno;
     }
@@ -214,6 +222,10 @@ static int hwc_prepare_primary(hwc_composer_device_1 *dev,
                 ctx->mFBUpdate[dpy]->prepare(ctx, list);
                 return 0;
             }
+            ctx->mLayerCache[dpy]->updateStability(list);
+            //Same layers as the last frame, only buffers and fences change
+            if(ctx->mMDPComp->prepareFast(ctx, list))
+                return 0;
             setListStats(ctx, list, dpy);
             bool ret = ctx->mMDPComp->prepare(ctx, list);
             if(!ret) {
@@ -250,6 +262,7 @@ static int hwc_prepare_external(hwc_composer_device_1 *dev,
                     return 0;
                 }
                 setListStats(ctx, list, dpy);
+                ctx->mLayerCache[dpy]->updateStability(list);
                 ctx->mVidOv[dpy]->prepare(ctx, list);
                 ctx->mFBUpdate[dpy]->prepare(ctx, list);
                 ctx->mLayerCache[dpy]->updateLayerCache(list);
@@ -334,8 +347,22 @@ static int hwc_prepare(hwc_composer_device_1 *dev, size_t numDisplays,
     int ret = 0;
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     Locker::Autolock _l(ctx->mBlankLock);
+    if(ctx->mTrace)
+        ctx->mTrace->beginPrepare(numDisplays, displays);
+    if(ctx->mFrameTiming)
+        ctx->mFrameTiming->beginPrepare(numDisplays, displays);
     reset(ctx, numDisplays, displays);
 
+    if(ctx->mResetPerfStats) {
+        ctx->mResetPerfStats = false;
+        ctx->mOverlay->resetStats();
+        ctx->mRotMgr->resetStats();
+        memset(ctx->mSetTiming, 0, sizeof(ctx->mSetTiming));
+        memset(&ctx->mSetTotal, 0, sizeof(ctx->mSetTotal));
+        memset(ctx->mFenceStats, 0, sizeof(ctx->mFenceStats));
+    }
+
+    refreshProps(ctx, false);
     ctx->mOverlay->configBegin();
     ctx->mRotMgr->configBegin();
     ctx->mNeedsRotator = false;
@@ -357,6 +384,10 @@ static int hwc_prepare(hwc_composer_device_1 *dev, size_t numDisplays,
 
     ctx->mOverlay->configDone();
     ctx->mRotMgr->configDone();
+    if(ctx->mTrace)
+        ctx->mTrace->endPrepare(displays);
+    if(ctx->mFrameTiming)
+        ctx->mFrameTiming->endPrepare(numDisplays, displays);
 
     return ret;
 }
@@ -401,6 +432,7 @@ static int hwc_blank(struct hwc_composer_device_1* dev, int dpy, int blank)
         // makes sure that all pipes are freed
         ctx->mOverlay->configBegin();
         ctx->mOverlay->configDone();
+        ctx->mOverlay->clear();
         ctx->mRotMgr->clear();
     }
     switch(dpy) {
@@ -517,6 +549,12 @@ static int hwc_set(hwc_composer_device_t *dev,
 }
 
 
+static inline void stamp_frame(hwc_context_t *ctx, int dpy,
+        FrameTiming::Stamp stamp) {
+    if(UNLIKELY(ctx->mFrameTiming != NULL))
+        ctx->mFrameTiming->stamp(dpy, stamp);
+}
+
 static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     ATRACE_CALL();
     int ret = 0;
@@ -526,10 +564,13 @@ static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         hwc_layer_1_t *fbLayer = &list->hwLayers[last];
         int fd = -1; //FenceFD from the Copybit(valid in async mode)
         bool copybitDone = false;
+        stamp_frame(ctx, dpy, FrameTiming::SET_START);
         if(ctx->mCopyBit[dpy])
             copybitDone = ctx->mCopyBit[dpy]->draw(ctx, list, dpy, &fd);
+        stamp_frame(ctx, dpy, FrameTiming::COPYBIT_DONE);
         if(list->numHwLayers > 1)
             hwc_sync(ctx, list, dpy, fd);
+        stamp_frame(ctx, dpy, FrameTiming::SYNC_DONE);
         if (!ctx->mVidOv[dpy]->draw(ctx, list)) {
             ALOGE("%s: VideoOverlay draw failed", __FUNCTION__);
             ret = -1;
@@ -553,13 +594,19 @@ static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             }
         }
 
+        stamp_frame(ctx, dpy, FrameTiming::DRAW_DONE);
         if (display_commit(ctx, dpy) < 0) {
             ALOGE("%s: display commit fail!", __FUNCTION__);
-            return -1;
+            ret = -1;
+        } else {
+            stamp_frame(ctx, dpy, FrameTiming::COMMIT_DONE);
         }
     }
 
-    closeAcquireFds(list);
+    ctx->mFenceStats[dpy].cur.close += closeAcquireFds(list);
+    ctx->mFenceStats[dpy].endFrame();
+    if(ctx->mFrameTiming)
+        ctx->mFrameTiming->endFrame(dpy);
     return ret;
 }
 
@@ -577,11 +624,14 @@ static int hwc_set_external(hwc_context_t *ctx,
         hwc_layer_1_t *fbLayer = &list->hwLayers[last];
         int fd = -1; //FenceFD from the Copybit(valid in async mode)
         bool copybitDone = false;
+        stamp_frame(ctx, dpy, FrameTiming::SET_START);
         if(ctx->mCopyBit[dpy])
             copybitDone = ctx->mCopyBit[dpy]->draw(ctx, list, dpy, &fd);
+        stamp_frame(ctx, dpy, FrameTiming::COPYBIT_DONE);
 
         if(list->numHwLayers > 1)
             hwc_sync(ctx, list, dpy, fd);
+        stamp_frame(ctx, dpy, FrameTiming::SYNC_DONE);
 
         if (!ctx->mVidOv[dpy]->draw(ctx, list)) {
             ALOGE("%s: VideoOverlay::draw fail!", __FUNCTION__);
@@ -600,41 +650,157 @@ static int hwc_set_external(hwc_context_t *ctx,
             }
         }
 
+        stamp_frame(ctx, dpy, FrameTiming::DRAW_DONE);
         if (display_commit(ctx, dpy) < 0) {
             ALOGE("%s: display commit fail!", __FUNCTION__);
             ret = -1;
+        } else {
+            stamp_frame(ctx, dpy, FrameTiming::COMMIT_DONE);
         }
     }
 
-    closeAcquireFds(list);
+    ctx->mFenceStats[dpy].cur.close += closeAcquireFds(list);
+    ctx->mFenceStats[dpy].endFrame();
+    if(ctx->mFrameTiming)
+        ctx->mFrameTiming->endFrame(dpy);
     return ret;
 }
 
-static int hwc_set(hwc_composer_device_1 *dev,
-                   size_t numDisplays,
-                   hwc_display_contents_1_t** displays)
+static int hwc_set_secondary(hwc_context_t *ctx, size_t numDisplays,
+                             hwc_display_contents_1_t** displays)
 {
     int ret = 0;
-    hwc_context_t* ctx = (hwc_context_t*)(dev);
-    Locker::Autolock _l(ctx->mBlankLock);
-    for (uint32_t i = 0; i <= numDisplays; i++) {
+    for (uint32_t i = HWC_DISPLAY_EXTERNAL; i <= numDisplays; i++) {
         hwc_display_contents_1_t* list = displays[i];
         switch(i) {
-            case HWC_DISPLAY_PRIMARY:
-                ret = hwc_set_primary(ctx, list);
-                break;
             case HWC_DISPLAY_EXTERNAL:
             case HWC_DISPLAY_VIRTUAL:
             /* ToDo: We are using hwc_set_external path for both External and
                      Virtual displays on HWC1.1. Eventually, we will have
                      separate functions when we move to HWC1.2
             */
+            {
+                nsecs_t start = systemTime();
                 ret = hwc_set_external(ctx, list, i);
+                ctx->mSetTiming[i].add(systemTime() - start);
                 break;
+            }
             default:
                 ret = -EINVAL;
         }
     }
+    return ret;
+}
+
+/* Set worker: takes the external and virtual displays off the primary's
+ * critical path, so their commits don't queue behind its
+ * MSMFB_DISPLAY_COMMIT. The Overlay PipeBook and RotMgr sessions are only
+ * changed in prepare, set just plays on pipes and rotator sessions owned by
+ * its display, so the shared state left to guard is the ioctl counters
+ * (atomic) and RotMgr's lazily opened device fd (locked). */
+static void *set_worker_loop(void *param)
+{
+    hwc_context_t *ctx = reinterpret_cast<hwc_context_t *>(param);
+    struct set_worker& w = ctx->mSetWorker;
+
+    char thread_name[64] = HWC_SET_THREAD_NAME;
+    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
+    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
+
+    pthread_mutex_lock(&w.lock);
+    while(true) {
+        while(!w.pending && !w.exit)
+            pthread_cond_wait(&w.cond, &w.lock);
+        if(w.exit)
+            break;
+        pthread_mutex_unlock(&w.lock);
+        int ret = hwc_set_secondary(ctx, w.numDisplays, w.displays);
+        pthread_mutex_lock(&w.lock);
+        w.ret = ret;
+        w.pending = false;
+        pthread_cond_signal(&w.done);
+    }
+    pthread_mutex_unlock(&w.lock);
+    return NULL;
+}
+
+static void init_set_worker(hwc_context_t *ctx)
+{
+    struct set_worker& w = ctx->mSetWorker;
+    char property[PROPERTY_VALUE_MAX];
+    w.enabled = false;
+    if(property_get("debug.hwc.parallelset", property, NULL) > 0 &&
+            atoi(property) != 0)
+        w.enabled = true;
+    if(!w.enabled)
+        return;
+
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    pthread_cond_init(&w.done, NULL);
+    w.exit = false;
+    w.pending = false;
+    int ret = pthread_create(&w.thread, NULL, set_worker_loop, (void*) ctx);
+    if (ret) {
+        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
+                HWC_SET_THREAD_NAME, strerror(ret));
+        w.enabled = false;
+    }
+    ALOGI("%s: parallel set %s", __FUNCTION__, w.enabled ? "on" : "off");
+}
+
+static void close_set_worker(hwc_context_t *ctx)
+{
+    struct set_worker& w = ctx->mSetWorker;
+    if(!w.enabled)
+        return;
+    pthread_mutex_lock(&w.lock);
+    w.exit = true;
+    pthread_cond_signal(&w.cond);
+    pthread_mutex_unlock(&w.lock);
+    pthread_join(w.thread, NULL);
+    w.enabled = false;
+}
+
+static int hwc_set(hwc_composer_device_1 *dev,
+                   size_t numDisplays,
+                   hwc_display_contents_1_t** displays)
+{
+    int ret = 0;
+    hwc_context_t* ctx = (hwc_context_t*)(dev);
+    Locker::Autolock _l(ctx->mBlankLock);
+    nsecs_t start = systemTime();
+    struct set_worker& w = ctx->mSetWorker;
+    //Only worth the hop when there is a second display to commit
+    bool parallel = w.enabled && numDisplays > HWC_DISPLAY_EXTERNAL &&
+            displays[HWC_DISPLAY_EXTERNAL];
+
+    if(parallel) {
+        pthread_mutex_lock(&w.lock);
+        w.numDisplays = numDisplays;
+        w.displays = displays;
+        w.pending = true;
+        pthread_cond_signal(&w.cond);
+        pthread_mutex_unlock(&w.lock);
+    }
+
+    ret = hwc_set_primary(ctx, displays[HWC_DISPLAY_PRIMARY]);
+    ctx->mSetTiming[HWC_DISPLAY_PRIMARY].add(systemTime() - start);
+
+    if(parallel) {
+        //Barrier, SurfaceFlinger owns the lists and fences once we return
+        pthread_mutex_lock(&w.lock);
+        while(w.pending)
+            pthread_cond_wait(&w.done, &w.lock);
+        ret = w.ret;
+        pthread_mutex_unlock(&w.lock);
+    } else if(numDisplays >= HWC_DISPLAY_EXTERNAL) {
+        ret = hwc_set_secondary(ctx, numDisplays, displays);
+    }
+    ctx->mSetTotal.add(systemTime() - start);
+    if(ctx->mTrace)
+        ctx->mTrace->endSet(ctx->mSetTotal.last);
+
     // This is only indicative of how many times SurfaceFlinger posts
     // frames to the display.
     CALC_FPS();
@@ -729,13 +895,64 @@ void hwc_dump(struct hwc_composer_device_1* dev, char *buff, int buff_len)
     dumpsys_log(aBuf, "Qualcomm HWC state:\n");
     dumpsys_log(aBuf, "  MDPVersion=%d\n", ctx->mMDP.version);
     dumpsys_log(aBuf, "  DisplayPanel=%c\n", ctx->mMDP.panel);
+    dumpsys_log(aBuf, "  Properties: swapinterval=%d actionsafe=%dx%d "
+            "cabl.yuv=%d refreshes=%u\n", ctx->mProps.swapInterval,
+            ctx->mProps.actionSafeWidth, ctx->mProps.actionSafeHeight,
+            ctx->mCablYuv, ctx->mProps.refreshCount);
+    dumpsys_log(aBuf, "  Set latency us (%s): total last=%lld avg=%lld "
+            "max=%lld\n", ctx->mSetWorker.enabled ? "parallel" : "serial",
+            ns2us(ctx->mSetTotal.last), ns2us(ctx->mSetTotal.avg()),
+            ns2us(ctx->mSetTotal.max));
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+        const qhwc::SetTiming& t = ctx->mSetTiming[i];
+        if(!t.count)
+            continue;
+        dumpsys_log(aBuf, "    dpy %d: last=%lld avg=%lld max=%lld "
+                "frames=%u\n", i, ns2us(t.last), ns2us(t.avg()),
+                ns2us(t.max), t.count);
+    }
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+        const qhwc::FenceStats& f = ctx->mFenceStats[i];
+        if(!f.frames)
+            continue;
+        dumpsys_log(aBuf, "  Fence syscalls per frame dpy %d: last=%u "
+                "(ioctl %u dup %u close %u merge %u) avg=%u max=%u "
+                "frames=%u\n", i, f.last.total(), f.last.ioctl, f.last.dup,
+                f.last.close, f.last.merge, f.avg(), f.max, f.frames);
+    }
+    if(ctx->mTrace) {
+        dumpsys_log(aBuf, "  Capture: %s frames=%u dropped layers=%u%s\n",
+                ctx->mTrace->getPath(), ctx->mTrace->getFrameCount(),
+                ctx->mTrace->getDroppedCount(),
+                ctx->mTrace->isCapturing() ? "" : " (done)");
+    }
+    if(ctx->mFrameTiming) {
+        ctx->mFrameTiming->dump(aBuf);
+        char path[PROPERTY_VALUE_MAX];
+        if(property_get("debug.hwc.frametiming.file", path, NULL) > 0) {
+            int ret = ctx->mFrameTiming->exportTo(path);
+            dumpsys_log(aBuf, "    exported %d records to %s\n", ret, path);
+        }
+    }
     ctx->mMDPComp->dump(aBuf);
-    char ovDump[2048] = {'\0'};
-    ctx->mOverlay->getDump(ovDump, 2048);
-    dumpsys_log(aBuf, ovDump);
+    //Room for every pipe with its stats and the event ring, the dump
+    //helpers truncate anything past it
+    char ovDump[16384] = {'\0'};
+    ctx->mOverlay->getDump(ovDump, sizeof(ovDump));
+    dumpsys_log(aBuf, "%s", ovDump);
     ovDump[0] = '\0';
-    ctx->mRotMgr->getDump(ovDump, 2048);
-    dumpsys_log(aBuf, ovDump);
+    ctx->mRotMgr->getDump(ovDump, sizeof(ovDump));
+    dumpsys_log(aBuf, "%s", ovDump);
+    const hw_module_t* module;
+    if(hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) == 0) {
+        const gralloc_module_t* gralloc =
+                reinterpret_cast<const gralloc_module_t*>(module);
+        char grDump[2048] = {'\0'};
+        if(gralloc->perform && !gralloc->perform(gralloc,
+                GRALLOC_MODULE_PERFORM_DUMP_ALLOC_STATS, grDump,
+                (int)sizeof(grDump)))
+            dumpsys_log(aBuf, "%s", grDump);
+    }
     strlcpy(buff, aBuf.string(), buff_len);
 }
 
@@ -745,6 +962,7 @@ static int hwc_device_close(struct hw_device_t *dev)
         ALOGE("%s: NULL device pointer", __FUNCTION__);
         return -1;
     }
+    close_set_worker((hwc_context_t*)dev);
     closeContext((hwc_context_t*)dev);
     free(dev);
 
@@ -763,6 +981,7 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
 
         //Initialize hwc context
         initContext(dev);
+        init_set_worker(dev);
 
         //Setup HWC methods
         hwc_methods_t *methods;
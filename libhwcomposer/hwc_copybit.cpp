@@ -744,11 +744,12 @@ private_handle_t * CopyBit::getCurrentRenderBuffer() {
     return mRenderBuffer[mCurRenderBufferIndex];
 }
 
-void CopyBit::setReleaseFd(int fd) {
+int CopyBit::setReleaseFd(int fd) {
     if(mRelFd[0] >=0)
         close(mRelFd[0]);
     mRelFd[0] = mRelFd[1];
     mRelFd[1] = dup(fd);
+    return mRelFd[1] >= 0 ? 1 : 0;
 }
 
 struct copybit_device_t* CopyBit::getCopyBitDevice() {
@@ -103,7 +103,8 @@ inline void CopyBit::setStats(int skipCount) {
 
     private_handle_t * getCurrentRenderBuffer();
 
-    void setReleaseFd(int fd);
+    //Keeps a dup of the release fence, returns the number of fds dup'ed
+    int setReleaseFd(int fd);
 
 private:
     // holds the copybit device
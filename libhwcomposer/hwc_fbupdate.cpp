@@ -36,6 +36,7 @@ IFBUpdate* IFBUpdate::getObject(const int& width, const int& dpy) {
 
 inline void IFBUpdate::reset() {
     mModeOn = false;
+    mZOrder = -1;
 }
 
 bool IFBUpdate::needFbUpdate(hwc_context_t *ctx,
@@ -49,11 +50,16 @@ bool IFBUpdate::needFbUpdate(hwc_context_t *ctx,
     return true;
 }
 //================= Low res====================================
-FBUpdateLowRes::FBUpdateLowRes(const int& dpy): IFBUpdate(dpy) {}
+FBUpdateLowRes::FBUpdateLowRes(const int& dpy): IFBUpdate(dpy),
+        mDest(ovutils::OV_INVALID) {}
 
+//The pipe stays recorded for reuse(), mModeOn guards its use
 inline void FBUpdateLowRes::reset() {
     IFBUpdate::reset();
-    mDest = ovutils::OV_INVALID;
+}
+
+int FBUpdateLowRes::getPipeMask() {
+    return (mDest == ovutils::OV_INVALID) ? 0 : (1 << mDest);
 }
 
 bool FBUpdateLowRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list)
@@ -96,13 +102,16 @@ bool FBUpdateLowRes::configure(hwc_context_t *ctx,
         ovutils::eMdpFlags mdpFlags = ovutils::OV_MDP_FLAGS_NONE;
         // If any of the layers has pre-multiplied alpha, set Pre multiplied
         // Flag as the compositied output is alpha pre-multiplied.
-        if(ctx->listStats[mDpy].preMultipliedAlpha == true)
+        // Staged above MDP layers, the cleared FB areas must blend as well.
+        if(ctx->listStats[mDpy].preMultipliedAlpha == true || mZOrder > 0)
                ovutils::setMdpFlags(mdpFlags, ovutils::OV_MDP_BLEND_FG_PREMULT);
 
         ovutils::eZorder z_order =
               ctx->mVidOv[mDpy]->isModeOn()?ovutils::ZORDER_1:ovutils::ZORDER_0;
-        ovutils::eIsFg is_fg =
-           ctx->mVidOv[mDpy]->isModeOn()? ovutils::IS_FG_OFF:ovutils::IS_FG_SET;
+        if(mZOrder >= 0)
+            z_order = static_cast<ovutils::eZorder>(mZOrder);
+        ovutils::eIsFg is_fg = (z_order == ovutils::ZORDER_0) ?
+                ovutils::IS_FG_SET : ovutils::IS_FG_OFF;
 
         ovutils::PipeArgs parg(mdpFlags,
                 info,
@@ -159,12 +168,18 @@ bool FBUpdateLowRes::draw(hwc_context_t *ctx, private_handle_t *hnd)
 }
 
 //================= High res====================================
-FBUpdateHighRes::FBUpdateHighRes(const int& dpy): IFBUpdate(dpy) {}
+FBUpdateHighRes::FBUpdateHighRes(const int& dpy): IFBUpdate(dpy),
+        mDestLeft(ovutils::OV_INVALID), mDestRight(ovutils::OV_INVALID) {}
 
+//The pipes stay recorded for reuse(), mModeOn guards their use
 inline void FBUpdateHighRes::reset() {
     IFBUpdate::reset();
-    mDestLeft = ovutils::OV_INVALID;
-    mDestRight = ovutils::OV_INVALID;
+}
+
+int FBUpdateHighRes::getPipeMask() {
+    if(mDestLeft == ovutils::OV_INVALID || mDestRight == ovutils::OV_INVALID)
+        return 0;
+    return (1 << mDestLeft) | (1 << mDestRight);
 }
 
 bool FBUpdateHighRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list)
@@ -213,13 +228,16 @@ bool FBUpdateHighRes::configure(hwc_context_t *ctx,
         ovutils::eMdpFlags mdpFlagsL = ovutils::OV_MDP_FLAGS_NONE;
         //If any layer has pre-multiplied alpha, set Pre multiplied
         //Flag as the compositied output is alpha pre-multiplied.
-        if(ctx->listStats[mDpy].preMultipliedAlpha == true)
+        //Staged above MDP layers, the cleared FB areas must blend as well.
+        if(ctx->listStats[mDpy].preMultipliedAlpha == true || mZOrder > 0)
             ovutils::setMdpFlags(mdpFlagsL, ovutils::OV_MDP_BLEND_FG_PREMULT);
 
         ovutils::eZorder z_order =
               ctx->mVidOv[mDpy]->isModeOn()?ovutils::ZORDER_1:ovutils::ZORDER_0;
-        ovutils::eIsFg is_fg =
-           ctx->mVidOv[mDpy]->isModeOn()? ovutils::IS_FG_OFF:ovutils::IS_FG_SET;
+        if(mZOrder >= 0)
+            z_order = static_cast<ovutils::eZorder>(mZOrder);
+        ovutils::eIsFg is_fg = (z_order == ovutils::ZORDER_0) ?
+                ovutils::IS_FG_SET : ovutils::IS_FG_OFF;
 
         ovutils::PipeArgs pargL(mdpFlagsL,
                 info,
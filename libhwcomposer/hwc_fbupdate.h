@@ -31,7 +31,7 @@ namespace ovutils = overlay::utils;
 //Framebuffer update Interface
 class IFBUpdate {
 public:
-    explicit IFBUpdate(const int& dpy) : mDpy(dpy) {}
+    explicit IFBUpdate(const int& dpy) : mDpy(dpy), mZOrder(-1) {}
     virtual ~IFBUpdate() {};
     // Sets up members and prepares overlay if conditions are met
     virtual bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list) = 0;
@@ -39,6 +39,13 @@ public:
     virtual bool draw(hwc_context_t *ctx, private_handle_t *hnd) = 0;
     //Reset values
     virtual void reset();
+    //Stage the FB target at z instead of the bottom, used by mixed mode
+    void setZOrder(int z) { mZOrder = z; }
+    //Pipes of the last configure as a bitmask of ovutils::eDest
+    virtual int getPipeMask() = 0;
+    //Draw this frame on the pipes of the last one, which the caller
+    //already kept staged in the overlay
+    void reuse() { mModeOn = true; }
     //Factory method that returns a low-res or high-res version
     static IFBUpdate *getObject(const int& width, const int& dpy);
     //To know if configuring FbUpdate is needed.
@@ -48,6 +55,7 @@ public:
 protected:
     const int mDpy; // display to update
     bool mModeOn; // if prepare happened
+    int mZOrder; // z-order requested for this frame, -1 if none
 };
 
 //Low resolution (<= 2048) panel handler.
@@ -59,6 +67,7 @@ public:
 
     bool draw(hwc_context_t *ctx, private_handle_t *hnd);
     void reset();
+    int getPipeMask();
 private:
     bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list);
     ovutils::eDest mDest; //pipe to draw on
@@ -72,6 +81,7 @@ public:
     bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list);
     bool draw(hwc_context_t *ctx, private_handle_t *hnd);
     void reset();
+    int getPipeMask();
 private:
     bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list);
     ovutils::eDest mDestLeft; //left pipe to draw on
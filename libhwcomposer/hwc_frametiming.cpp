@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <sync/sync.h>
+#include "hwc_frametiming.h"
+#include "hwc_utils.h"
+
+namespace qhwc {
+
+//Where a frame's time went, each one a span between two stamps
+struct Segment {
+    const char *name;
+    FrameTiming::Stamp from;
+    FrameTiming::Stamp to;
+};
+
+static const Segment sSegments[] = {
+    { "prepare", FrameTiming::PREPARE_START, FrameTiming::PREPARE_END },
+    { "copybit", FrameTiming::SET_START, FrameTiming::COPYBIT_DONE },
+    { "acquire", FrameTiming::COPYBIT_DONE, FrameTiming::BUFFER_SYNC_DONE },
+    { "draw", FrameTiming::SYNC_DONE, FrameTiming::DRAW_DONE },
+    { "commit", FrameTiming::DRAW_DONE, FrameTiming::COMMIT_DONE },
+    { "release", FrameTiming::COMMIT_DONE, FrameTiming::RELEASE_SIGNALED },
+    { "total", FrameTiming::PREPARE_START, FrameTiming::COMMIT_DONE },
+};
+
+FrameTiming *FrameTiming::create(uint32_t vsyncPeriodNs) {
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.frametiming", property, NULL) <= 0 ||
+            atoi(property) == 0)
+        return NULL;
+    return new FrameTiming(vsyncPeriodNs);
+}
+
+FrameTiming::FrameTiming(uint32_t vsyncPeriodNs) :
+        mVsyncPeriodNs(vsyncPeriodNs) {
+    memset(mRings, 0, sizeof(mRings));
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+        for(int j = 0; j < RING_SIZE; j++)
+            mRings[i].slots[j].releaseFd = -1;
+    }
+}
+
+FrameTiming::~FrameTiming() {
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+        for(int j = 0; j < RING_SIZE; j++) {
+            if(mRings[i].slots[j].releaseFd >= 0)
+                close(mRings[i].slots[j].releaseFd);
+        }
+    }
+}
+
+void FrameTiming::pollReleaseFences(Ring& ring) {
+    int32_t head = ring.head;
+    for(int32_t i = 1; i <= MAX_PENDING_FRAMES && i <= head; i++) {
+        Slot& slot = ring.slots[(head - i) % RING_SIZE];
+        if(slot.releaseFd < 0)
+            continue;
+        struct sync_fence_info_data *info = sync_fence_info(slot.releaseFd);
+        int status = info ? info->status : -1;
+        if(status == 0 && i < MAX_PENDING_FRAMES) {
+            //Still on screen, look again next frame
+            sync_fence_info_free(info);
+            continue;
+        }
+        if(status == 1) {
+            uint64_t signaled = 0;
+            struct sync_pt_info *pt = NULL;
+            while((pt = sync_pt_info(info, pt)) != NULL) {
+                if(pt->timestamp_ns > signaled)
+                    signaled = pt->timestamp_ns;
+            }
+            android_atomic_inc(&slot.seq);
+            slot.rec.stamp[RELEASE_SIGNALED] = (int64_t)signaled;
+            android_atomic_inc(&slot.seq);
+        }
+        if(info)
+            sync_fence_info_free(info);
+        close(slot.releaseFd);
+        slot.releaseFd = -1;
+    }
+}
+
+void FrameTiming::beginFrame(int dpy) {
+    Ring& ring = mRings[dpy];
+    if(ring.open) {
+        //Prepared but never set, start the record over
+        Slot& slot = ring.slots[(ring.head - 1) % RING_SIZE];
+        memset(slot.rec.stamp, 0, sizeof(slot.rec.stamp));
+        return;
+    }
+    pollReleaseFences(ring);
+    Slot& slot = ring.slots[ring.head % RING_SIZE];
+    if(slot.releaseFd >= 0) {
+        close(slot.releaseFd);
+        slot.releaseFd = -1;
+    }
+    android_atomic_inc(&slot.seq);
+    memset(&slot.rec, 0, sizeof(slot.rec));
+    slot.rec.frame = ring.head;
+    slot.rec.dpy = dpy;
+    android_atomic_inc(&ring.head);
+    ring.open = true;
+}
+
+void FrameTiming::beginPrepare(size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    for(size_t i = 0; i <= numDisplays && i < HWC_NUM_DISPLAY_TYPES; i++) {
+        if(displays[i] == NULL)
+            continue;
+        beginFrame(i);
+        stamp(i, PREPARE_START);
+    }
+}
+
+void FrameTiming::endPrepare(size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    for(size_t i = 0; i <= numDisplays && i < HWC_NUM_DISPLAY_TYPES; i++) {
+        if(displays[i])
+            stamp(i, PREPARE_END);
+    }
+}
+
+void FrameTiming::stamp(int dpy, Stamp s) {
+    Ring& ring = mRings[dpy];
+    if(!ring.open)
+        return;
+    ring.slots[(ring.head - 1) % RING_SIZE].rec.stamp[s] =
+            systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+int FrameTiming::setReleaseFence(int dpy, int fd) {
+    Ring& ring = mRings[dpy];
+    if(!ring.open || fd < 0)
+        return 0;
+    Slot& slot = ring.slots[(ring.head - 1) % RING_SIZE];
+    if(slot.releaseFd >= 0)
+        close(slot.releaseFd);
+    slot.releaseFd = dup(fd);
+    return slot.releaseFd >= 0 ? 1 : 0;
+}
+
+void FrameTiming::endFrame(int dpy) {
+    Ring& ring = mRings[dpy];
+    if(!ring.open)
+        return;
+    android_atomic_inc(&ring.slots[(ring.head - 1) % RING_SIZE].seq);
+    ring.open = false;
+}
+
+size_t FrameTiming::snapshot(int dpy, Record *out, size_t max) const {
+    const Ring& ring = mRings[dpy];
+    size_t count = 0;
+    for(int i = 0; i < RING_SIZE && count < max; i++) {
+        const Slot& slot = ring.slots[i];
+        int32_t seq = android_atomic_acquire_load(&slot.seq);
+        if(seq & 1)
+            continue;
+        Record rec = slot.rec;
+        android_memory_barrier();
+        if(seq != slot.seq || rec.stamp[PREPARE_START] == 0)
+            continue;
+        //Oldest first
+        size_t j = count++;
+        while(j > 0 && out[j - 1].frame > rec.frame) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = rec;
+    }
+    return count;
+}
+
+static int cmpNsecs(const void *a, const void *b) {
+    nsecs_t x = *(const nsecs_t *)a, y = *(const nsecs_t *)b;
+    return (x > y) - (x < y);
+}
+
+void FrameTiming::dump(android::String8& buf) {
+    Record recs[RING_SIZE];
+    nsecs_t spans[RING_SIZE];
+    for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++) {
+        size_t count = snapshot(dpy, recs, RING_SIZE);
+        if(count == 0)
+            continue;
+
+        //A frame misses its vsync when prepare to commit takes longer than
+        //a refresh. Blame the stage that took the longest.
+        uint32_t missed = 0, hwc = 0, gpu = 0, panel = 0;
+        for(size_t i = 0; i < count; i++) {
+            const int64_t *t = recs[i].stamp;
+            if(!t[COMMIT_DONE] ||
+                    t[COMMIT_DONE] - t[PREPARE_START] <= mVsyncPeriodNs)
+                continue;
+            missed++;
+            int64_t acquire = (t[BUFFER_SYNC_DONE] && t[COPYBIT_DONE]) ?
+                    t[BUFFER_SYNC_DONE] - t[COPYBIT_DONE] : 0;
+            int64_t commit = t[DRAW_DONE] ? t[COMMIT_DONE] - t[DRAW_DONE] : 0;
+            int64_t rest = t[COMMIT_DONE] - t[PREPARE_START] - acquire -
+                    commit;
+            if(acquire >= commit && acquire >= rest)
+                gpu++;
+            else if(commit >= rest)
+                panel++;
+            else
+                hwc++;
+        }
+        dumpsys_log(buf, "  Frame timing dpy %d: %zu frames, missed vsync %u "
+                "(hwc %u gpu %u panel %u)\n", dpy, count, missed, hwc, gpu,
+                panel);
+
+        for(size_t s = 0; s < sizeof(sSegments) / sizeof(sSegments[0]);
+                s++) {
+            const Segment& seg = sSegments[s];
+            size_t n = 0;
+            for(size_t i = 0; i < count; i++) {
+                const int64_t *t = recs[i].stamp;
+                if(t[seg.from] && t[seg.to] && t[seg.to] >= t[seg.from])
+                    spans[n++] = t[seg.to] - t[seg.from];
+            }
+            if(n == 0)
+                continue;
+            qsort(spans, n, sizeof(spans[0]), cmpNsecs);
+            dumpsys_log(buf, "    %-8s us p50=%lld p90=%lld p99=%lld "
+                    "max=%lld\n", seg.name, ns2us(spans[n / 2]),
+                    ns2us(spans[n * 9 / 10]), ns2us(spans[n * 99 / 100]),
+                    ns2us(spans[n - 1]));
+        }
+    }
+}
+
+int FrameTiming::exportTo(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        ALOGE("%s: failed to open %s: %s", __FUNCTION__, path,
+                strerror(errno));
+        return -errno;
+    }
+    Record recs[HWC_NUM_DISPLAY_TYPES * RING_SIZE];
+    size_t count = 0;
+    for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++)
+        count += snapshot(dpy, recs + count, RING_SIZE);
+
+    ExportHeader header;
+    header.magic = EXPORT_MAGIC;
+    header.numStamps = NUM_STAMPS;
+    header.vsyncPeriodNs = mVsyncPeriodNs;
+    header.numRecords = count;
+    int ret = count;
+    if(fwrite(&header, sizeof(header), 1, file) != 1 ||
+            fwrite(recs, sizeof(Record), count, file) != count) {
+        ALOGE("%s: write to %s failed", __FUNCTION__, path);
+        ret = -EIO;
+    }
+    fclose(file);
+    return ret;
+}
+
+}; //namespace qhwc
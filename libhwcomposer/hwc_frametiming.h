@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HWC_FRAMETIMING_H
+#define HWC_FRAMETIMING_H
+
+#include <stdint.h>
+#include <hardware/hwcomposer.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace qhwc {
+
+/* Per display timeline of each frame, from prepare to the release fence
+ * signaling, enabled with debug.hwc.frametiming=1. Each display has a ring
+ * with a single writer, the thread composing that display; readers (dump,
+ * export) copy records under a per record sequence count and never block
+ * the writer. */
+class FrameTiming {
+public:
+    enum Stamp {
+        PREPARE_START,
+        PREPARE_END,
+        SET_START,
+        COPYBIT_DONE,
+        BUFFER_SYNC_DONE, //MSMFB_BUFFER_SYNC returned, acquire fences met
+        SYNC_DONE,        //hwc_sync returned, release fences handed out
+        DRAW_DONE,        //buffers queued, MSMFB_DISPLAY_COMMIT next
+        COMMIT_DONE,      //MSMFB_DISPLAY_COMMIT returned
+        RELEASE_SIGNALED, //this frame's release fence signaled
+        NUM_STAMPS
+    };
+    enum { RING_SIZE = 128 };
+    enum { EXPORT_MAGIC = 0x4d495446 }; //"FTIM"
+
+    /* Binary export layout: ExportHeader, then numRecords Records */
+    struct Record {
+        uint32_t frame;
+        int32_t dpy;
+        int64_t stamp[NUM_STAMPS]; //CLOCK_MONOTONIC ns, 0 if not reached
+    };
+    struct ExportHeader {
+        uint32_t magic;
+        uint32_t numStamps;
+        uint32_t vsyncPeriodNs;
+        uint32_t numRecords;
+    };
+
+    /* NULL unless debug.hwc.frametiming is set */
+    static FrameTiming *create(uint32_t vsyncPeriodNs);
+    ~FrameTiming();
+
+    /* Opens a new record for the display, and picks up the signal time of
+     * earlier frames' release fences */
+    void beginFrame(int dpy);
+    /* beginFrame and PREPARE_START / PREPARE_END for every display hwc_prepare
+     * walks that has a list */
+    void beginPrepare(size_t numDisplays,
+            hwc_display_contents_1_t** displays);
+    void endPrepare(size_t numDisplays, hwc_display_contents_1_t** displays);
+    void stamp(int dpy, Stamp s);
+    /* Keeps a dup of the frame's release fence to time its signal.
+     * Returns the number of fds dup'ed, 0 or 1 */
+    int setReleaseFence(int dpy, int fd);
+    /* Publishes the record opened by beginFrame */
+    void endFrame(int dpy);
+
+    void dump(android::String8& buf);
+    /* Writes the rings to path, returns the record count or -errno */
+    int exportTo(const char *path);
+
+private:
+    struct Slot {
+        volatile int32_t seq; //odd while the writer updates the record
+        Record rec;
+        int releaseFd;        //owned until its signal time is known
+    };
+    struct Ring {
+        Slot slots[RING_SIZE];
+        volatile int32_t head; //records begun
+        bool open;
+    };
+    enum { MAX_PENDING_FRAMES = 4 }; //fences given up on after this many
+
+    explicit FrameTiming(uint32_t vsyncPeriodNs);
+    void pollReleaseFences(Ring& ring);
+    size_t snapshot(int dpy, Record *out, size_t max) const;
+
+    Ring mRings[HWC_NUM_DISPLAY_TYPES];
+    uint32_t mVsyncPeriodNs;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_FRAMETIMING_H
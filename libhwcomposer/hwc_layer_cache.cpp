@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "hwc_layer_cache.h"
+
+namespace qhwc {
+
+void LayerCache::resetLayerCache(int num) {
+    memset(entry, 0, sizeof(entry));
+    fbCleared = false;
+    numHwLayers = num;
+}
+
+void LayerCache::updateStability(hwc_display_contents_1_t* list) {
+    if(list->flags & HWC_GEOMETRY_CHANGED ||
+       list->numHwLayers != numHwLayers ) {
+        resetLayerCache(list->numHwLayers);
+    }
+
+    for(uint32_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        Entry& e = entry[i];
+        bool same = e.hnd && e.hnd == layer->handle &&
+                !memcmp(&e.sourceCrop, &layer->sourceCrop,
+                        sizeof(hwc_rect_t)) &&
+                !memcmp(&e.displayFrame, &layer->displayFrame,
+                        sizeof(hwc_rect_t)) &&
+                e.transform == layer->transform &&
+                e.blending == layer->blending &&
+                e.flags == layer->flags;
+        //SurfaceFlinger redraws skip layers behind our back
+        if(layer->flags & HWC_SKIP_LAYER)
+            same = false;
+
+        if(same) {
+            e.stableFrames++;
+        } else {
+            e.hnd = layer->handle;
+            e.sourceCrop = layer->sourceCrop;
+            e.displayFrame = layer->displayFrame;
+            e.transform = layer->transform;
+            e.blending = layer->blending;
+            e.flags = layer->flags;
+            e.stableFrames = 0;
+            //The FB target holds the old content
+            e.inFB = false;
+        }
+    }
+}
+
+bool LayerCache::getReusableFB(int& start, int& count) const {
+    int numAppLayers = numHwLayers - 1;
+    start = -1;
+    count = 0;
+    for(int i = 0; i < numAppLayers; i++) {
+        if(!entry[i].inFB)
+            continue;
+        //Changed layers leave holes, only a contiguous run is reusable
+        if(!isStable(i) || (start >= 0 && start + count != i))
+            return false;
+        if(start < 0)
+            start = i;
+        count++;
+    }
+    //Without the clear, uncovered areas are opaque and only fit the bottom
+    return count && (fbCleared || start == 0);
+}
+
+bool LayerCache::isBatchReusable(int start, int count) const {
+    int cachedStart, cachedCount;
+    return getReusableFB(cachedStart, cachedCount) &&
+            cachedStart == start && cachedCount == count;
+}
+
+void LayerCache::setFBContent(const bool* inFB, int count, bool cleared) {
+    for(int i = 0; i < count; i++)
+        entry[i].inFB = inFB[i];
+    fbCleared = cleared;
+}
+
+void LayerCache::updateLayerCache(hwc_display_contents_1_t* list) {
+
+    int numFbLayers = 0;
+    int numCacheableLayers = 0;
+    bool inFB[MAX_NUM_LAYERS];
+    bool cleared = false;
+    bool fbKnown = true;
+
+    //Geometry changes and skip layers are never stable, see updateStability
+    canUseLayerCache = false;
+    uint32_t numAppLayers = list->numHwLayers - 1;
+    for(uint32_t i = 0; i < numAppLayers; i++) {
+        inFB[i] = false;
+        switch(list->hwLayers[i].compositionType) {
+            case HWC_FRAMEBUFFER:
+                numFbLayers++;
+                inFB[i] = true;
+                //Cacheable if its current content is already in the FB
+                if(isStable(i) && entry[i].inFB)
+                    numCacheableLayers++;
+                break;
+            case HWC_OVERLAY:
+                cleared = true;
+                //The old FB would still show a layer moved off it
+                if(entry[i].inFB)
+                    fbKnown = false;
+                break;
+            default:
+                //Composed elsewhere, e.g. by copybit
+                fbKnown = false;
+                break;
+        }
+    }
+    if(fbKnown && numFbLayers && numFbLayers == numCacheableLayers)
+        canUseLayerCache = true;
+
+    //The FB target is redrawn from these layers unless it is cached
+    if(!canUseLayerCache) {
+        if(!fbKnown)
+            memset(inFB, 0, sizeof(inFB));
+        setFBContent(inFB, numAppLayers, cleared);
+    }
+
+    markCachedLayersAsOverlay(list);
+}
+
+void LayerCache::markCachedLayersAsOverlay(hwc_display_contents_1_t* list) {
+    //This optimization only works if ALL the layers that are on the
+    //framebuffer are still in it unchanged.
+    if(canUseLayerCache){
+        uint32_t numAppLayers = list->numHwLayers - 1;
+        for(uint32_t i = 0; i < numAppLayers; i++) {
+            if (list->hwLayers[i].compositionType == HWC_FRAMEBUFFER)
+            {
+                list->hwLayers[i].compositionType = HWC_OVERLAY;
+            }
+        }
+    }
+}
+
+}; //namespace qhwc
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HWC_LAYER_CACHE_H
+#define HWC_LAYER_CACHE_H
+
+#include <string.h>
+#include <hardware/hwcomposer.h>
+
+#define MAX_NUM_LAYERS 32 //includes fb layer
+
+namespace qhwc {
+
+class LayerCache {
+    public:
+    LayerCache() {
+        canUseLayerCache = false;
+        fbCleared = false;
+        numHwLayers = 0;
+        memset(entry, 0, sizeof(entry));
+    }
+    //Compares every layer with the previous frame, once per frame and
+    //before any composition decision
+    void updateStability(hwc_display_contents_1_t* list);
+    //Layer kept its buffer and geometry since the previous frame
+    bool isStable(int index) const { return entry[index].stableFrames > 0; }
+    //The stable layers the FB target already holds, if they are
+    //contiguous and can be shown above MDP layers. Cleared when the FB
+    //target was composed over a transparent clear.
+    bool getReusableFB(int& start, int& count) const;
+    //The FB target already holds exactly this batch unchanged, so a
+    //batch SurfaceFlinger redraws every frame could be cached instead
+    bool isBatchReusable(int start, int count) const;
+    //Records the layers SurfaceFlinger composes into the FB target
+    void setFBContent(const bool* inFB, int count, bool cleared);
+    //LayerCache optimization
+    void updateLayerCache(hwc_display_contents_1_t* list);
+    void resetLayerCache(int num);
+    void markCachedLayersAsOverlay(hwc_display_contents_1_t* list);
+    private:
+    struct Entry {
+        buffer_handle_t hnd;
+        hwc_rect_t sourceCrop;
+        hwc_rect_t displayFrame;
+        uint32_t transform;
+        int32_t blending;
+        uint32_t flags;
+        uint32_t stableFrames; //frames without a change, 0 if changed
+        bool inFB; //content is in the current FB target
+    };
+    uint32_t numHwLayers;
+    bool canUseLayerCache;
+    bool fbCleared;
+    Entry entry[MAX_NUM_LAYERS];
+
+};
+
+}; //namespace qhwc
+
+#endif //HWC_LAYER_CACHE_H
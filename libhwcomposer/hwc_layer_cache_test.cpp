@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Drives LayerCache through a mixed mode sequence the way hwc_prepare
+ * does: updateStability every frame, then the MDPComp fast path, then the
+ * full path when the fast path misses. The frame loop follows what
+ * prepareFast and chooseFBBatch do with the cache, so a batch
+ * SurfaceFlinger redraws every frame has to turn into a cached FB target
+ * once its layers stop changing, with a single fast path miss, and a batch
+ * that keeps changing must never cost a miss. Exits non zero if any check
+ * fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hwc_layer_cache.h"
+
+using namespace qhwc;
+
+#define NUM_APP_LAYERS 3
+#define NUM_FRAMES 12
+
+//The batch the full path picks when nothing is cached, layers 0 and 1
+#define BATCH_START 0
+#define BATCH_COUNT 2
+
+struct TestCase {
+    const char *name;
+    //First frame a layer keeps its buffer, -1 if it changes every frame
+    int settleFrame[NUM_APP_LAYERS];
+    int expectCachedFrame; //first frame with a cached FB, -1 for never
+    int expectMisses;      //fast path misses after the first frame
+};
+
+static const TestCase sCases[] = {
+    { "static batch",           {  0,  0, -1 },  1,  1 },
+    { "batch settles late",     {  5,  3, -1 },  6,  1 },
+    { "batch keeps changing",   {  0, -1, -1 }, -1,  0 },
+    { "all static",             {  0,  0,  0 },  1,  1 },
+};
+
+struct FrameState {
+    bool valid;
+    bool fbCached;
+    int fbStart;
+    int fbCount;
+    bool isFBComposed[NUM_APP_LAYERS];
+};
+
+static hwc_display_contents_1_t* allocList() {
+    size_t size = sizeof(hwc_display_contents_1_t) +
+            (NUM_APP_LAYERS + 1) * sizeof(hwc_layer_1_t);
+    hwc_display_contents_1_t* list =
+            (hwc_display_contents_1_t*)calloc(1, size);
+    list->numHwLayers = NUM_APP_LAYERS + 1;
+    for(int i = 0; i <= NUM_APP_LAYERS; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        layer->compositionType = i < NUM_APP_LAYERS ? HWC_FRAMEBUFFER :
+                HWC_FRAMEBUFFER_TARGET;
+        layer->displayFrame.right = 1080;
+        layer->displayFrame.bottom = 1920;
+        layer->sourceCrop = layer->displayFrame;
+    }
+    return list;
+}
+
+//Only the buffer identity matters to the cache, never dereferenced
+static buffer_handle_t fakeHandle(int layer, int frame) {
+    return (buffer_handle_t)(uintptr_t)(0x1000 * (layer + 1) + frame + 1);
+}
+
+static void setBatch(FrameState& frame, int start, int count, bool cached) {
+    frame.valid = true;
+    frame.fbCached = cached;
+    frame.fbStart = start;
+    frame.fbCount = count;
+    for(int i = 0; i < NUM_APP_LAYERS; i++)
+        frame.isFBComposed[i] = i >= start && i < start + count;
+}
+
+//prepareFast, as far as the FB batch is concerned
+static bool prepareFast(LayerCache& cache, FrameState& frame) {
+    if(!frame.valid)
+        return false;
+    for(int i = 0; i < NUM_APP_LAYERS; i++) {
+        if(frame.isFBComposed[i] && frame.fbCached && !cache.isStable(i))
+            return false;
+    }
+    if(!frame.fbCached &&
+            cache.isBatchReusable(frame.fbStart, frame.fbCount))
+        return false;
+    if(!frame.fbCached)
+        cache.setFBContent(frame.isFBComposed, NUM_APP_LAYERS, true);
+    return true;
+}
+
+//chooseFBBatch and the end of prepare, pipe limits left out
+static void prepare(LayerCache& cache, FrameState& frame) {
+    int cachedStart, cachedCount;
+    if(cache.getReusableFB(cachedStart, cachedCount) &&
+            cachedCount < NUM_APP_LAYERS) {
+        setBatch(frame, cachedStart, cachedCount, true);
+    } else {
+        setBatch(frame, BATCH_START, BATCH_COUNT, false);
+        cache.setFBContent(frame.isFBComposed, NUM_APP_LAYERS, true);
+    }
+}
+
+static bool runCase(const TestCase& test) {
+    LayerCache cache;
+    FrameState frame;
+    memset(&frame, 0, sizeof(frame));
+    hwc_display_contents_1_t* list = allocList();
+    int cachedFrame = -1;
+    int misses = 0;
+    bool ok = true;
+
+    for(int f = 0; f < NUM_FRAMES; f++) {
+        list->flags = f ? 0 : HWC_GEOMETRY_CHANGED;
+        for(int i = 0; i < NUM_APP_LAYERS; i++) {
+            int settle = test.settleFrame[i];
+            bool changes = settle < 0 || f < settle;
+            list->hwLayers[i].handle = fakeHandle(i, changes ? f : settle);
+        }
+
+        cache.updateStability(list);
+        if(!prepareFast(cache, frame)) {
+            if(f)
+                misses++;
+            prepare(cache, frame);
+        }
+        if(frame.fbCached && cachedFrame < 0)
+            cachedFrame = f;
+        //Once cached, it has to stay cached while nothing changes
+        if(cachedFrame >= 0 && !frame.fbCached)
+            ok = false;
+    }
+    free(list);
+
+    ok = ok && cachedFrame == test.expectCachedFrame &&
+            misses == test.expectMisses;
+    printf("%s %-24s cached at frame %2d, %d fast path misses\n",
+            ok ? "PASS" : "FAIL", test.name, cachedFrame, misses);
+    return ok;
+}
+
+int main() {
+    int failures = 0;
+    const int count = sizeof(sCases) / sizeof(sCases[0]);
+    for(int i = 0; i < count; i++) {
+        if(!runCase(sCases[i]))
+            failures++;
+    }
+    printf("%d of %d cases failed\n", failures, count);
+    return failures ? 1 : 0;
+}
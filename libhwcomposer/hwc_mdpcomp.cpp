@@ -112,6 +112,9 @@ bool MDPComp::deinit() {
 #include "qdMetaData.h"
 #include "mdp_version.h"
 #include <overlayRotator.h>
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include "hwc_fbupdate.h"
 
 using overlay::Rotator;
 using namespace overlay::utils;
@@ -125,6 +128,10 @@ IdleInvalidator *MDPComp::idleInvalidator = NULL;
 bool MDPComp::sIdleFallBack = false;
 bool MDPComp::sDebugLogs = false;
 bool MDPComp::sEnabled = false;
+bool MDPComp::sMixedMode = false;
+qdutils::MDPBwModel *MDPComp::sBwModel = NULL;
+bool MDPComp::sIdleFixed = false;
+uint32_t MDPComp::sIdleTimeout = DEFAULT_IDLE_TIME;
 
 MDPComp* MDPComp::getObject(const int& width) {
     if(width <= MAX_DISPLAY_DIM) {
@@ -138,7 +145,48 @@ void MDPComp::dump(android::String8& buf)
 {
     dumpsys_log(buf, "  MDP Composition: ");
     dumpsys_log(buf, "MDPCompState=%d\n", mState);
-    //XXX: Log more info
+    if(sBwModel) {
+        const qdutils::MDPBwModel::Estimate& est = sBwModel->getEstimate();
+        dumpsys_log(buf, "  BW model: ab=%lluMB/s ib=%lluMB/s clk=%uMHz "
+                "last reject=%s\n", est.abBps / 1000000, est.ibBps / 1000000,
+                est.clkHz / 1000000,
+                qdutils::MDPBwModel::getVerdictStr(
+                sBwModel->getLastVerdict()));
+    }
+    const FrameInfo& frame = mCurrentFrame;
+    if(mState == MDPCOMP_ON && frame.fbCount) {
+        dumpsys_log(buf, "  Split: mixed mdp=%d fb=[%d..%d] fbZ=%d "
+                "gpu cost=%upx%s\n", frame.mdpCount, frame.fbStart,
+                frame.fbStart + frame.fbCount - 1, frame.fbZ, frame.fbCost,
+                frame.fbCached ? " (cached)" : "");
+    } else {
+        dumpsys_log(buf, "  Split: %s\n",
+                (mState == MDPCOMP_ON) ? "full mdp" : "gpu");
+    }
+    dumpsys_log(buf, "  Frames: full=%u mixed=%u gpu=%u\n",
+            mFullFrames, mMixedFrames, mFBFrames);
+    dumpsys_log(buf, "  Pipe solver: nodes=%d timeouts=%u infeasible=%u\n",
+            mSolverNodes, mSolverTimeouts, mSolverInfeasible);
+    dumpsys_log(buf, "  Fast path: hits=%u misses=%u\n",
+            mFastHits, mFastMisses);
+    const IdlePolicy& idle = mIdle;
+    if(sIdleFixed) {
+        dumpsys_log(buf, "  Idle fallback: fixed %ums", sIdleTimeout);
+    } else if(idle.never) {
+        dumpsys_log(buf, "  Idle fallback: never (mdp fetch <= fb)");
+    } else {
+        dumpsys_log(buf, "  Idle fallback: %ums (break even %ums << %u)",
+                idle.timeoutMs, idle.breakEvenMs, idle.backoff);
+    }
+    dumpsys_log(buf, " fired=%u skipped=%d wasted=%u\n", idle.fired,
+            android_atomic_acquire_load(&idle.skipped), idle.wasted);
+    if(idle.staticCount) {
+        dumpsys_log(buf, "  Static after fallback ms: last=%lld avg=%lld "
+                "max=%lld%s\n", ns2ms(idle.staticLast),
+                ns2ms(idle.staticTotal / idle.staticCount),
+                ns2ms(idle.staticMax),
+                idle.fallbackTime ? " (static now)" : "");
+    }
 }
 
 bool MDPComp::init(hwc_context_t *ctx) {
@@ -163,10 +211,21 @@ bool MDPComp::init(hwc_context_t *ctx) {
             sDebugLogs = true;
     }
 
-    unsigned long idle_timeout = DEFAULT_IDLE_TIME;
+    //Mixed mode is on unless explicitly disabled
+    sMixedMode = true;
+    if(property_get("debug.mdpcomp.mixedmode", property, NULL) > 0) {
+        if(atoi(property) == 0)
+            sMixedMode = false;
+    }
+
+    //A set idle time turns the idle policy off
+    sIdleFixed = false;
+    sIdleTimeout = DEFAULT_IDLE_TIME;
     if(property_get("debug.mdpcomp.idletime", property, NULL) > 0) {
-        if(atoi(property) != 0)
-            idle_timeout = atoi(property);
+        if(atoi(property) != 0) {
+            sIdleTimeout = atoi(property);
+            sIdleFixed = true;
+        }
     }
 
     //create Idle Invalidator
@@ -175,7 +234,12 @@ bool MDPComp::init(hwc_context_t *ctx) {
     if(idleInvalidator == NULL) {
         ALOGE("%s: failed to instantiate idleInvalidator  object", __FUNCTION__);
     } else {
-        idleInvalidator->init(timeout_handler, ctx, idle_timeout);
+        idleInvalidator->init(timeout_handler, ctx, sIdleTimeout);
+    }
+
+    if(sBwModel == NULL) {
+        sBwModel = new qdutils::MDPBwModel(
+                qdutils::MDPVersion::getInstance().getMDPVersion());
     }
     return true;
 }
@@ -195,6 +259,13 @@ void MDPComp::timeout_handler(void *udata) {
         ALOGE("%s: HWC proc not registered", __FUNCTION__);
         return;
     }
+    MDPComp *comp = ctx->mMDPComp;
+    //Runs on the IdleInvalidator thread, see IdlePolicy
+    if(comp && !sIdleFixed &&
+            android_atomic_acquire_load(&comp->mIdle.never)) {
+        android_atomic_inc(&comp->mIdle.skipped);
+        return;
+    }
     sIdleFallBack = true;
     /* Trigger SF to redraw the current frame */
     proc->invalidate(proc);
@@ -449,6 +520,13 @@ void MDPComp::setMDPCompLayerFlags(hwc_context_t *ctx,
     LayerProp *layerProp = ctx->layerProp[dpy];
 
     for(int index = 0; index < ctx->listStats[dpy].numAppLayers; index++ ) {
+        //Batched layers stay HWC_FRAMEBUFFER for SurfaceFlinger to compose,
+        //unless the FB target already holds them
+        if(mCurrentFrame.isFBComposed[index]) {
+            if(mCurrentFrame.fbCached)
+                list->hwLayers[index].compositionType = HWC_OVERLAY;
+            continue;
+        }
         hwc_layer_1_t* layer = &(list->hwLayers[index]);
         layerProp[index].mFlags |= HWC_MDPCOMP;
         layer->compositionType = HWC_OVERLAY;
@@ -490,6 +568,15 @@ void MDPComp::reset(hwc_context_t *ctx,
         mCurrentFrame.pipeLayer = NULL;
     }
     mCurrentFrame.count = 0;
+    memset(mCurrentFrame.isFBComposed, 0,
+            sizeof(mCurrentFrame.isFBComposed));
+    mCurrentFrame.fbStart = -1;
+    mCurrentFrame.fbCount = 0;
+    mCurrentFrame.fbZ = 0;
+    mCurrentFrame.mdpCount = 0;
+    mCurrentFrame.fbCost = 0;
+    mCurrentFrame.fbCached = false;
+    mGeometryValid = false;
 }
 
 bool MDPComp::isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer) {
@@ -582,8 +669,9 @@ bool MDPComp::isDoable(hwc_context_t *ctx,
     if(ctx->mNeedsRotator)
         availablePipes -= numDMAPipes;
 
-    if(numAppLayers < 1 || numAppLayers > MAX_PIPES_PER_MIXER ||
-                           pipesNeeded(ctx, list) > availablePipes) {
+    //Layers beyond what the pipes take are batched into the FB target,
+    //see chooseFBBatch
+    if(numAppLayers < 1) {
         ALOGD_IF(isDebug(), "%s: Unsupported number of layers",__FUNCTION__);
         return false;
     }
@@ -602,12 +690,6 @@ bool MDPComp::isDoable(hwc_context_t *ctx,
     if(ctx->mSecureMode)
         return false;
 
-    //Check for skip layers
-    if(isSkipPresent(ctx, dpy)) {
-        ALOGD_IF(isDebug(), "%s: Skip layers are present",__FUNCTION__);
-        return false;
-    }
-
     if(ctx->listStats[dpy].needsAlphaScale
                      && ctx->mMDP.version < qdutils::MDSS_V5) {
         ALOGD_IF(isDebug(), "%s: frame needs alpha downscaling",__FUNCTION__);
@@ -619,6 +701,8 @@ bool MDPComp::isDoable(hwc_context_t *ctx,
         reset_comp_type(list);
         ctx->mLayerCache[dpy]->resetLayerCache(list->numHwLayers);
         sIdleFallBack = false;
+        mIdle.fired++;
+        mIdle.fallbackTime = systemTime(SYSTEM_TIME_MONOTONIC);
         ALOGD_IF(isDebug(), "%s: idle fallback",__FUNCTION__);
         return false;
     }
@@ -1109,22 +1193,271 @@ bool MDPComp::configure(hwc_composer_device_t *dev,  hwc_layer_list_t* list) {
     for(int i = 0; i < numAppLayers; ++i) {
         // As MDP h/w supports flip operation, use MDP comp only for
         // 180 transforms. Fail for any transform involving 90 (90, 270).
+        //Layers MDP can not take are left to the GPU, in the FB batch
         hwc_layer_1_t* layer = &list->hwLayers[i];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
 
+        if(isSkipLayer(layer)) {
+            ALOGD_IF(isDebug(), "%s: layer %d is skip",__FUNCTION__, i);
+            mCurrentFrame.isFBComposed[i] = true;
+            continue;
+        }
+
         if(layer->transform & HWC_TRANSFORM_ROT_90 && !isYuvBuffer(hnd)) {
             ALOGD_IF(isDebug(), "%s: orientation involved",__FUNCTION__);
-            return false;
+            mCurrentFrame.isFBComposed[i] = true;
+            continue;
         }
 
         if(!isYuvBuffer(hnd) && !isValidDimension(ctx,layer)) {
             ALOGD_IF(isDebug(), "%s: Buffer is of invalid width",__FUNCTION__);
+            mCurrentFrame.isFBComposed[i] = true;
+        }
+    }
+
+    if(!chooseFBBatch(ctx, list, availablePipes)) {
+        ALOGD_IF(isDebug(), "%s: No split fits the pipes",__FUNCTION__);
+        return false;
+    }
+
+    //Reject before any pipe is touched, rather than failing in the driver
+    if(!isBwSufficient(ctx, list)) {
+        return false;
+    }
+    return true;
+}
+
+bool MDPComp::isBwSufficient(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    if(sBwModel == NULL)
+        return true;
+
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    int hw_w = ctx->dpyAttr[dpy].xres;
+    int hw_h = ctx->dpyAttr[dpy].yres;
+    uint32_t fps = 60;
+    if(ctx->dpyAttr[dpy].vsync_period)
+        fps = 1000000000 / ctx->dpyAttr[dpy].vsync_period;
+
+    sBwModel->begin(hw_w, hw_h, fps);
+    for(int i = 0; i <= numAppLayers; ++i) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        if(!hnd || mCurrentFrame.isFBComposed[i])
+            continue;
+        //The FB target, last in the list, is fetched only in mixed mode
+        if(i == numAppLayers && !mCurrentFrame.fbCount)
+            break;
+
+        hwc_rect_t crop = layer->sourceCrop;
+        hwc_rect_t dst = layer->displayFrame;
+        if(dst.left < 0 || dst.top < 0 ||
+                dst.right > hw_w || dst.bottom > hw_h) {
+            hwc_rect_t scissor = {0, 0, hw_w, hw_h };
+            qhwc::calculate_crop_rects(crop, dst, scissor, layer->transform);
+        }
+
+        qdutils::MDPBwModel::Pipe pipe;
+        pipe.srcW = crop.right - crop.left;
+        pipe.srcH = crop.bottom - crop.top;
+        pipe.dstW = dst.right - dst.left;
+        pipe.dstH = dst.bottom - dst.top;
+        pipe.bpp = qdutils::MDPBwModel::getFormatBpp(hnd->format);
+        pipe.rotDownscale = 0;
+        pipe.rotated = (layer->transform & HWC_TRANSFORM_ROT_90);
+        //Compare like axes, the rotator output is what the pipe scales
+        if(pipe.rotated)
+            swap(pipe.srcW, pipe.srcH);
+
+        if(!sBwModel->addPipe(pipe)) {
+            ALOGD_IF(isDebug(), "%s: layer %d exceeds MDP limits (%s)",
+                    __FUNCTION__, i, qdutils::MDPBwModel::getVerdictStr(
+                    sBwModel->getLastVerdict()));
             return false;
         }
     }
     return true;
 }
 
+uint32_t MDPComp::getGpuCost(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    hwc_rect_t dst = layer->displayFrame;
+    int w = min(dst.right, (int)ctx->dpyAttr[dpy].xres) - max(dst.left, 0);
+    int h = min(dst.bottom, (int)ctx->dpyAttr[dpy].yres) - max(dst.top, 0);
+    if(w <= 0 || h <= 0)
+        return 0;
+    //Pixels the GPU writes; YUV costs a second pass for the color convert
+    uint32_t cost = w * h;
+    if(isYuvBuffer((private_handle_t *)layer->handle))
+        cost *= 2;
+    return cost;
+}
+
+bool MDPComp::chooseFBBatch(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int availablePipes) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    FrameInfo& frame = mCurrentFrame;
+    int pipes[MAX_NUM_LAYERS];
+    uint32_t cost[MAX_NUM_LAYERS];
+    int totalPipes = 0;
+    //Layers that have to go to the GPU bound the batch on both ends
+    int gpuFirst = -1, gpuLast = -1;
+
+    for(int i = 0; i < numAppLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        pipes[i] = pipesNeeded(ctx, layer);
+        cost[i] = getGpuCost(ctx, layer);
+        totalPipes += pipes[i];
+        if(frame.isFBComposed[i]) {
+            if(gpuFirst < 0)
+                gpuFirst = i;
+            gpuLast = i;
+        }
+    }
+
+    if(gpuFirst < 0 && numAppLayers <= MAX_PIPES_PER_MIXER &&
+            totalPipes <= availablePipes) {
+        frame.mdpCount = numAppLayers;
+        return true;
+    }
+
+    if(!sMixedMode)
+        return false;
+
+    //The FB target is full screen, it needs its own stage and pipe(s)
+    int fbPipes = pipesNeeded(ctx, &list->hwLayers[numAppLayers]);
+    int bestStart = -1, bestEnd = -1;
+    uint32_t bestCost = 0;
+
+    //Layers unchanged since SurfaceFlinger drew them into the FB target
+    //cost the GPU nothing, if only the others need pipes
+    int cachedStart, cachedCount;
+    if(ctx->mLayerCache[dpy]->getReusableFB(cachedStart, cachedCount)) {
+        int cachedEnd = cachedStart + cachedCount - 1;
+        int batchPipes = 0;
+        for(int i = cachedStart; i <= cachedEnd; i++)
+            batchPipes += pipes[i];
+        int mdpLayers = numAppLayers - cachedCount;
+        if((gpuFirst < 0 || (cachedStart <= gpuFirst &&
+                gpuLast <= cachedEnd)) && mdpLayers > 0 &&
+                mdpLayers + 1 <= MAX_PIPES_PER_MIXER &&
+                totalPipes - batchPipes + fbPipes <= availablePipes) {
+            bestStart = cachedStart;
+            bestEnd = cachedEnd;
+            frame.fbCached = true;
+        }
+    }
+
+    for(int start = 0; !frame.fbCached && start < numAppLayers; start++) {
+        if(gpuFirst >= 0 && start > gpuFirst)
+            break;
+        uint32_t batchCost = 0;
+        int batchPipes = 0;
+        for(int end = start; end < numAppLayers; end++) {
+            batchCost += cost[end];
+            batchPipes += pipes[end];
+            if(end < gpuLast)
+                continue;
+            int mdpLayers = numAppLayers - (end - start + 1);
+            //Nothing left for MDP is plain FB composition
+            if(mdpLayers == 0)
+                break;
+            if(mdpLayers + 1 > MAX_PIPES_PER_MIXER ||
+                    totalPipes - batchPipes + fbPipes > availablePipes)
+                continue;
+            if(bestStart < 0 || batchCost < bestCost) {
+                bestStart = start;
+                bestEnd = end;
+                bestCost = batchCost;
+            }
+        }
+    }
+
+    if(bestStart < 0)
+        return false;
+
+    for(int i = bestStart; i <= bestEnd; i++)
+        frame.isFBComposed[i] = true;
+    frame.fbStart = bestStart;
+    frame.fbCount = bestEnd - bestStart + 1;
+    frame.fbZ = bestStart;
+    frame.mdpCount = numAppLayers - frame.fbCount;
+    frame.fbCost = bestCost;
+    ALOGD_IF(isDebug(), "%s: mixed mode fb=[%d..%d] mdp=%d cost=%u%s",
+            __FUNCTION__, bestStart, bestEnd, frame.mdpCount, bestCost,
+            frame.fbCached ? " cached" : "");
+    return true;
+}
+
+int MDPComp::getPipeCaps(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+
+    //Only VG pipes do color conversion, rotator output included
+    if(isYuvBuffer(hnd))
+        return (1 << MDPCOMP_OV_VG);
+
+    int caps = (1 << MDPCOMP_OV_RGB) | (1 << MDPCOMP_OV_VG);
+    //DMA pipes neither scale nor flip, and the rotator may own them
+    if(!qhwc::needsScaling(layer) && !layer->transform &&
+            !ctx->mNeedsRotator && ctx->mMDP.version >= qdutils::MDSS_V5)
+        caps |= (1 << MDPCOMP_OV_DMA);
+    return caps;
+}
+
+bool MDPComp::assignPipeTypes(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    overlay::Overlay& ov = *ctx->mOverlay;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    int layerOf[PipeSolver::MAX_SLOTS];
+    PipeSolver solver;
+
+    solver.numSlots = 0;
+    for(int i = 0; i < numAppLayers; i++) {
+        if(mCurrentFrame.isFBComposed[i])
+            continue;
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        int slots = pipesNeeded(ctx, layer);
+        if(solver.numSlots + slots > PipeSolver::MAX_SLOTS)
+            return false;
+        int caps = getPipeCaps(ctx, layer);
+        for(int j = 0; j < slots; j++) {
+            solver.caps[solver.numSlots] = caps;
+            layerOf[solver.numSlots++] = i;
+        }
+    }
+
+    for(int type = 0; type < PipeSolver::NUM_TYPES; type++) {
+        solver.freePipes[type] =
+                ov.availablePipes(dpy, (ovutils::eMdpPipeType)type);
+    }
+    //The rotator takes the DMA pipes on MDSS
+    if(ctx->mNeedsRotator)
+        solver.freePipes[ovutils::OV_MDP_PIPE_DMA] = 0;
+
+    bool found = solver.solve();
+    mSolverNodes = solver.nodes;
+    if(solver.timedOut)
+        mSolverTimeouts++;
+    if(!found) {
+        mSolverInfeasible++;
+        ALOGD_IF(isDebug(), "%s: no pipe assignment for %d slots (%s)",
+                __FUNCTION__, solver.numSlots,
+                solver.timedOut ? "out of time" : "infeasible");
+        return false;
+    }
+
+    for(int slot = 0, last = -1; slot < solver.numSlots; slot++) {
+        int i = layerOf[slot];
+        int side = (i == last) ? 1 : 0;
+        mCurrentFrame.pipeType[i][side] = (ePipeType)solver.best[slot];
+        last = i;
+    }
+    return true;
+}
+
 bool MDPComp::setup(hwc_context_t* ctx, hwc_display_contents_1_t* list) {
     const int dpy = HWC_DISPLAY_PRIMARY;
     if(!ctx) {
@@ -1132,20 +1465,221 @@ bool MDPComp::setup(hwc_context_t* ctx, hwc_display_contents_1_t* list) {
         return -1;
     }
 
+    //Stage all layers and apply them together, so a failing layer does not
+    //leave the others reprogrammed for a frame that goes to GPU anyway.
+    //Aborting also hands back every pipe allocated for the display.
+    overlay::Overlay& ov = *ctx->mOverlay;
+    ov.beginTransaction(dpy);
     ctx->mDMAInUse = false;
-    if(!allocLayerPipes(ctx, list, mCurrentFrame)) {
+
+    //The FB target asks for an RGB pipe, take it before the layers do
+    if(mCurrentFrame.fbCount) {
+        IFBUpdate *fbUpdate = ctx->mFBUpdate[dpy];
+        fbUpdate->setZOrder(mCurrentFrame.fbZ);
+        if(!fbUpdate->prepare(ctx, list)) {
+            ALOGD_IF(isDebug(), "%s: FB target not staged", __FUNCTION__);
+            fbUpdate->reset();
+            ov.abortTransaction(dpy);
+            return false;
+        }
+    }
+
+    //Solve for the pipe types first, greedy allocation misses fits
+    if(!assignPipeTypes(ctx, list) ||
+            !allocLayerPipes(ctx, list, mCurrentFrame)) {
         ALOGD_IF(isDebug(), "%s: Falling back to FB", __FUNCTION__);
+        ctx->mFBUpdate[dpy]->reset();
+        ov.abortTransaction(dpy);
         return false;
     }
 
     for (int index = 0 ; index < mCurrentFrame.count; index++) {
+        if(mCurrentFrame.isFBComposed[index])
+            continue;
         hwc_layer_1_t* layer = &list->hwLayers[index];
         if(configure(ctx, layer, mCurrentFrame.pipeLayer[index]) != 0 ) {
             ALOGD_IF(isDebug(), "%s: MDPComp failed to configure overlay for \
                     layer %d",__FUNCTION__, index);
+            ctx->mFBUpdate[dpy]->reset();
+            ov.abortTransaction(dpy);
             return false;
         }
     }
+
+    if(!ov.endTransaction(dpy)) {
+        ALOGD_IF(isDebug(), "%s: MDPComp failed to commit the frame",
+                __FUNCTION__);
+        ctx->mFBUpdate[dpy]->reset();
+        return false;
+    }
+    return true;
+}
+
+void MDPComp::getGeometry(hwc_layer_1_t* layer, LayerGeometry& geom) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    memset(&geom, 0, sizeof(geom));
+    geom.flags = layer->flags;
+    geom.transform = layer->transform;
+    geom.blending = layer->blending;
+    geom.sourceCrop = layer->sourceCrop;
+    geom.displayFrame = layer->displayFrame;
+    if(hnd) {
+        geom.format = hnd->format;
+        geom.width = hnd->width;
+        geom.height = hnd->height;
+        geom.privFlags = hnd->flags;
+    }
+}
+
+void MDPComp::saveGeometry(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+
+    //Rotator sessions are handed out per frame, such frames are not reused
+    for(int i = 0; i < mCurrentFrame.count; i++) {
+        if(mCurrentFrame.pipeLayer[i].rot)
+            return;
+    }
+
+    mGeometryLayers = list->numHwLayers;
+    for(int i = 0; i < mGeometryLayers; i++)
+        getGeometry(&list->hwLayers[i], mGeometry[i]);
+    mGeometryStats = ctx->listStats[dpy];
+    mGeometryValid = true;
+}
+
+bool MDPComp::isSameGeometry(hwc_display_contents_1_t* list) {
+    if((list->flags & HWC_GEOMETRY_CHANGED) ||
+            (int)list->numHwLayers != mGeometryLayers)
+        return false;
+
+    for(int i = 0; i < mGeometryLayers; i++) {
+        LayerGeometry geom;
+        getGeometry(&list->hwLayers[i], geom);
+        if(memcmp(&geom, &mGeometry[i], sizeof(geom)))
+            return false;
+    }
+    return true;
+}
+
+void MDPComp::updateIdlePolicy(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    if(sIdleFixed || sBwModel == NULL)
+        return;
+
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    IdlePolicy& idle = mIdle;
+    uint64_t fps = 60;
+    if(ctx->dpyAttr[dpy].vsync_period)
+        fps = 1000000000 / ctx->dpyAttr[dpy].vsync_period;
+    //Once fallen back the MDP fetches the FB target alone
+    uint64_t fbBps = (uint64_t)ctx->dpyAttr[dpy].xres *
+            ctx->dpyAttr[dpy].yres * 4 * fps;
+    //isBwSufficient left the estimate of this frame's pipes
+    uint64_t mdpBps = sBwModel->getEstimate().abBps;
+    int32_t never = (mdpBps <= fbBps) ? 1 : 0;
+    android_atomic_release_store(never, &idle.never);
+    if(never)
+        return;
+
+    //The GPU reads and writes every layer once, at about twice the cost
+    //of the same bytes fetched by the MDP
+    uint64_t gpuBytes = 0;
+    for(int i = 0; i < ctx->listStats[dpy].numAppLayers; i++)
+        gpuBytes += getGpuCost(ctx, &list->hwLayers[i]);
+    gpuBytes *= 4 * 2 * 2;
+
+    uint64_t breakEven = gpuBytes * 1000 / (mdpBps - fbBps);
+    idle.breakEvenMs = (uint32_t)min(breakEven, (uint64_t)MAX_IDLE_TIME);
+    uint32_t timeout = idle.breakEvenMs << idle.backoff;
+    timeout = max(min(timeout, (uint32_t)MAX_IDLE_TIME),
+            (uint32_t)MIN_IDLE_TIME);
+    if(timeout != idle.timeoutMs) {
+        ALOGD_IF(isDebug(), "%s: idle time %ums, mdp %lluMB/s fb %lluMB/s "
+                "gpu %lluKB", __FUNCTION__, timeout, mdpBps / 1000000,
+                fbBps / 1000000, gpuBytes / 1000);
+        idle.timeoutMs = timeout;
+        if(idleInvalidator)
+            idleInvalidator->setSleepTime(timeout);
+    }
+}
+
+void MDPComp::endIdleStatic() {
+    IdlePolicy& idle = mIdle;
+    nsecs_t span = systemTime(SYSTEM_TIME_MONOTONIC) - idle.fallbackTime;
+    idle.fallbackTime = 0;
+    idle.staticLast = span;
+    idle.staticTotal += span;
+    if(span > idle.staticMax)
+        idle.staticMax = span;
+    idle.staticCount++;
+
+    if(sIdleFixed || idle.never)
+        return;
+    //A fallback undone before it paid off backs the idle time off
+    if(ns2ms(span) < idle.breakEvenMs) {
+        idle.wasted++;
+        if(idle.backoff < 3)
+            idle.backoff++;
+    } else if(idle.backoff) {
+        idle.backoff--;
+    }
+}
+
+bool MDPComp::prepareFast(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    if(!isEnabled() || mState != MDPCOMP_ON || !mGeometryValid)
+        return false;
+
+    //What isDoable checks outside the layer list
+    if(sIdleFallBack || ctx->mExtDispConfiguring || isSecuring(ctx) ||
+            ctx->mSecureMode || !isSameGeometry(list)) {
+        mFastMisses++;
+        return false;
+    }
+
+    IFBUpdate *fbUpdate = ctx->mFBUpdate[dpy];
+    int mask = mCurrentFrame.fbCount ? fbUpdate->getPipeMask() : 0;
+    for(int i = 0; i < mCurrentFrame.count; i++) {
+        if(!mCurrentFrame.isFBComposed[i]) {
+            mask |= getPipeMask(mCurrentFrame.pipeLayer[i]);
+        } else if(mCurrentFrame.fbCached &&
+                !ctx->mLayerCache[dpy]->isStable(i)) {
+            //A cached layer got a new buffer, the FB target is stale
+            mFastMisses++;
+            return false;
+        }
+    }
+    //The FB target holds the whole batch unchanged, the full path can
+    //cache it instead of having SurfaceFlinger redraw it every frame
+    if(mCurrentFrame.fbCount && !mCurrentFrame.fbCached &&
+            ctx->mLayerCache[dpy]->isBatchReusable(mCurrentFrame.fbStart,
+                    mCurrentFrame.fbCount)) {
+        mFastMisses++;
+        return false;
+    }
+
+    //The pipes still hold last frame's configuration, only draw moves on
+    if(!ctx->mOverlay->keepPipes(dpy, mask)) {
+        mFastMisses++;
+        return false;
+    }
+    if(mCurrentFrame.fbCount)
+        fbUpdate->reuse();
+
+    ctx->listStats[dpy] = mGeometryStats;
+    setMDPCompLayerFlags(ctx, list);
+    if(mCurrentFrame.fbCount && !mCurrentFrame.fbCached) {
+        ctx->mLayerCache[dpy]->setFBContent(mCurrentFrame.isFBComposed,
+                mCurrentFrame.count, true);
+    }
+    mFastHits++;
+    if(mCurrentFrame.fbCount)
+        mMixedFrames++;
+    else
+        mFullFrames++;
+    ALOGD_IF(isDebug(), "%s: reusing last frame's setup", __FUNCTION__);
     return true;
 }
 
@@ -1159,6 +1693,10 @@ bool MDPComp::prepare(hwc_context_t *ctx,
     overlay::Overlay& ov = *ctx->mOverlay;
     bool isMDPCompUsed = true;
 
+    //SurfaceFlinger composes again only once something changed
+    if(mIdle.fallbackTime)
+        endIdleStatic();
+
     //reset old data
     reset(ctx, list);
 
@@ -1183,6 +1721,21 @@ bool MDPComp::prepare(hwc_context_t *ctx,
     }
 
     mState = isMDPCompUsed ? MDPCOMP_ON : MDPCOMP_OFF;
+    if(isMDPCompUsed) {
+        saveGeometry(ctx, list);
+        updateIdlePolicy(ctx, list);
+    }
+    //SurfaceFlinger redraws the batch over a transparent clear
+    if(isMDPCompUsed && mCurrentFrame.fbCount && !mCurrentFrame.fbCached) {
+        ctx->mLayerCache[HWC_DISPLAY_PRIMARY]->setFBContent(
+                mCurrentFrame.isFBComposed, mCurrentFrame.count, true);
+    }
+    if(!isMDPCompUsed)
+        mFBFrames++;
+    else if(mCurrentFrame.fbCount)
+        mMixedFrames++;
+    else
+        mFullFrames++;
     return isMDPCompUsed;
 }
 
@@ -1205,10 +1758,14 @@ int MDPCompLowRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
             &pipeLayerPair.rot);
 }
 
-int MDPCompLowRes::pipesNeeded(hwc_context_t *ctx,
-                        hwc_display_contents_1_t* list) {
-    const int dpy = HWC_DISPLAY_PRIMARY;
-    return ctx->listStats[dpy].numAppLayers;
+int MDPCompLowRes::getPipeMask(PipeLayerPair& pipeLayerPair) {
+    MdpPipeInfoLowRes& mdp_info =
+            *(static_cast<MdpPipeInfoLowRes*>(pipeLayerPair.pipeInfo));
+    return (1 << mdp_info.index);
+}
+
+int MDPCompLowRes::pipesNeeded(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+    return 1;
 }
 
 bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
@@ -1220,25 +1777,28 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
 
     currentFrame.count = layer_count;
     currentFrame.pipeLayer = (PipeLayerPair*)
-            malloc(sizeof(PipeLayerPair) * currentFrame.count);
+            calloc(currentFrame.count, sizeof(PipeLayerPair));
 
     if(isYuvPresent(ctx, dpy)) {
         int nYuvCount = ctx->listStats[dpy].yuvCount;
 
         for(int index = 0; index < nYuvCount; index ++) {
             int nYuvIndex = ctx->listStats[dpy].yuvIndices[index];
+            if(currentFrame.isFBComposed[nYuvIndex])
+                continue;
             hwc_layer_1_t* layer = &list->hwLayers[nYuvIndex];
             PipeLayerPair& info = currentFrame.pipeLayer[nYuvIndex];
             info.pipeInfo = new MdpPipeInfoLowRes;
             info.rot = NULL;
             MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
-            pipe_info.index = getMdpPipe(ctx, MDPCOMP_OV_VG);
+            pipe_info.index = getMdpPipe(ctx,
+                    currentFrame.pipeType[nYuvIndex][0]);
             if(pipe_info.index == ovutils::OV_INVALID) {
                 ALOGD_IF(isDebug(), "%s: Unable to get pipe for Videos",
                         __FUNCTION__);
                 return false;
             }
-            pipe_info.zOrder = nYuvIndex;
+            pipe_info.zOrder = getMdpZ(nYuvIndex);
         }
     }
 
@@ -1246,7 +1806,7 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
         hwc_layer_1_t* layer = &list->hwLayers[index];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
 
-        if(isYuvBuffer(hnd))
+        if(isYuvBuffer(hnd) || currentFrame.isFBComposed[index])
             continue;
 
         PipeLayerPair& info = currentFrame.pipeLayer[index];
@@ -1254,19 +1814,12 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
         info.rot = NULL;
         MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
 
-        ePipeType type = MDPCOMP_OV_ANY;
-
-        if(!qhwc::needsScaling(layer) && !ctx->mNeedsRotator
-                             && ctx->mMDP.version >= qdutils::MDSS_V5) {
-            type = MDPCOMP_OV_DMA;
-        }
-
-        pipe_info.index = getMdpPipe(ctx, type);
+        pipe_info.index = getMdpPipe(ctx, currentFrame.pipeType[index][0]);
         if(pipe_info.index == ovutils::OV_INVALID) {
             ALOGD_IF(isDebug(), "%s: Unable to get pipe for UI", __FUNCTION__);
             return false;
         }
-        pipe_info.zOrder = index;
+        pipe_info.zOrder = getMdpZ(index);
     }
     return true;
 }
@@ -1294,6 +1847,11 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     int numHwLayers = ctx->listStats[dpy].numAppLayers;
     for(int i = 0; i < numHwLayers; i++ )
     {
+        //Layers in the FB batch have no pipe of their own
+        if(!(layerProp[i].mFlags & HWC_MDPCOMP)) {
+            continue;
+        }
+
         hwc_layer_1_t *layer = &list->hwLayers[i];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
         if(!hnd) {
@@ -1309,10 +1867,6 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             return false;
         }
 
-        if(!(layerProp[i].mFlags & HWC_MDPCOMP)) {
-            continue;
-        }
-
         ALOGD_IF(isDebug(),"%s: MDP Comp: Drawing layer: %p hnd: %p \
                 using  pipe: %d", __FUNCTION__, layer,
                 hnd, dest );
@@ -1321,6 +1875,7 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         uint32_t offset = hnd->offset;
         Rotator *rot = mCurrentFrame.pipeLayer[i].rot;
         if(rot) {
+            rot->setSrcBuffer(hnd, !ctx->mLayerCache[dpy]->isStable(i));
             if(!rot->queueBuffer(fd, offset))
                 return false;
             fd = rot->getDstMemId();
@@ -1339,47 +1894,49 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 
 //=============MDPCompHighRes===================================================
 
-int MDPCompHighRes::pipesNeeded(hwc_context_t *ctx,
-                        hwc_display_contents_1_t* list) {
-    const int dpy = HWC_DISPLAY_PRIMARY;
-    int numAppLayers = ctx->listStats[dpy].numAppLayers;
-    int pipesNeeded = 0;
+int MDPCompHighRes::getPipeMask(PipeLayerPair& pipeLayerPair) {
+    MdpPipeInfoHighRes& mdp_info =
+            *(static_cast<MdpPipeInfoHighRes*>(pipeLayerPair.pipeInfo));
+    int mask = 0;
+    if(mdp_info.lIndex != ovutils::OV_INVALID)
+        mask |= (1 << mdp_info.lIndex);
+    if(mdp_info.rIndex != ovutils::OV_INVALID)
+        mask |= (1 << mdp_info.rIndex);
+    return mask;
+}
 
+int MDPCompHighRes::pipesNeeded(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
     int hw_w = ctx->dpyAttr[dpy].xres;
+    hwc_rect_t dst = layer->displayFrame;
 
-    for(int i = 0; i < numAppLayers; ++i) {
-        hwc_layer_1_t* layer = &list->hwLayers[i];
-        hwc_rect_t dst = layer->displayFrame;
-      if(dst.left > hw_w/2) {
-          pipesNeeded++;
-      } else if(dst.right <= hw_w/2) {
-          pipesNeeded++;
-      } else {
-          pipesNeeded += 2;
-      }
-    }
-    return pipesNeeded;
+    //One pipe per mixer the layer spans
+    if(dst.left > hw_w/2 || dst.right <= hw_w/2)
+        return 1;
+    return 2;
 }
 
 bool MDPCompHighRes::acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
-                        MdpPipeInfoHighRes& pipe_info, ePipeType type) {
+                        MdpPipeInfoHighRes& pipe_info,
+                        const ePipeType types[2]) {
      const int dpy = HWC_DISPLAY_PRIMARY;
      int hw_w = ctx->dpyAttr[dpy].xres;
 
+     //A layer on one mixer has its type in types[0]
      hwc_rect_t dst = layer->displayFrame;
      if(dst.left > hw_w/2) {
          pipe_info.lIndex = ovutils::OV_INVALID;
-         pipe_info.rIndex = getMdpPipe(ctx, type);
+         pipe_info.rIndex = getMdpPipe(ctx, types[0]);
          if(pipe_info.rIndex == ovutils::OV_INVALID)
              return false;
      } else if (dst.right <= hw_w/2) {
          pipe_info.rIndex = ovutils::OV_INVALID;
-         pipe_info.lIndex = getMdpPipe(ctx, type);
+         pipe_info.lIndex = getMdpPipe(ctx, types[0]);
          if(pipe_info.lIndex == ovutils::OV_INVALID)
              return false;
      } else {
-         pipe_info.rIndex = getMdpPipe(ctx, type);
-         pipe_info.lIndex = getMdpPipe(ctx, type);
+         pipe_info.lIndex = getMdpPipe(ctx, types[0]);
+         pipe_info.rIndex = getMdpPipe(ctx, types[1]);
          if(pipe_info.rIndex == ovutils::OV_INVALID ||
             pipe_info.lIndex == ovutils::OV_INVALID)
              return false;
@@ -1396,24 +1953,27 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
 
     currentFrame.count = layer_count;
     currentFrame.pipeLayer = (PipeLayerPair*)
-            malloc(sizeof(PipeLayerPair) * currentFrame.count);
+            calloc(currentFrame.count, sizeof(PipeLayerPair));
 
     if(isYuvPresent(ctx, dpy)) {
         int nYuvCount = ctx->listStats[dpy].yuvCount;
 
         for(int index = 0; index < nYuvCount; index ++) {
             int nYuvIndex = ctx->listStats[dpy].yuvIndices[index];
+            if(currentFrame.isFBComposed[nYuvIndex])
+                continue;
             hwc_layer_1_t* layer = &list->hwLayers[nYuvIndex];
             PipeLayerPair& info = currentFrame.pipeLayer[nYuvIndex];
             info.pipeInfo = new MdpPipeInfoHighRes;
             MdpPipeInfoHighRes& pipe_info = *(MdpPipeInfoHighRes*)info.pipeInfo;
-            if(!acquireMDPPipes(ctx, layer, pipe_info,MDPCOMP_OV_VG)) {
+            if(!acquireMDPPipes(ctx, layer, pipe_info,
+                    currentFrame.pipeType[nYuvIndex])) {
                 ALOGD_IF(isDebug(),"%s: Unable to get pipe for videos",
                                                             __FUNCTION__);
                 //TODO: windback pipebook data on fail
                 return false;
             }
-            pipe_info.zOrder = nYuvIndex;
+            pipe_info.zOrder = getMdpZ(nYuvIndex);
         }
     }
 
@@ -1421,25 +1981,20 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
         hwc_layer_1_t* layer = &list->hwLayers[index];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
 
-        if(isYuvBuffer(hnd))
+        if(isYuvBuffer(hnd) || currentFrame.isFBComposed[index])
             continue;
 
         PipeLayerPair& info = currentFrame.pipeLayer[index];
         info.pipeInfo = new MdpPipeInfoHighRes;
         MdpPipeInfoHighRes& pipe_info = *(MdpPipeInfoHighRes*)info.pipeInfo;
 
-        ePipeType type = MDPCOMP_OV_ANY;
-
-        if(!qhwc::needsScaling(layer) && !ctx->mNeedsRotator
-                             && ctx->mMDP.version >= qdutils::MDSS_V5)
-            type = MDPCOMP_OV_DMA;
-
-        if(!acquireMDPPipes(ctx, layer, pipe_info, type)) {
+        if(!acquireMDPPipes(ctx, layer, pipe_info,
+                currentFrame.pipeType[index])) {
             ALOGD_IF(isDebug(), "%s: Unable to get pipe for UI", __FUNCTION__);
             //TODO: windback pipebook data on fail
             return false;
         }
-        pipe_info.zOrder = index;
+        pipe_info.zOrder = getMdpZ(index);
     }
     return true;
 }
@@ -1483,6 +2038,11 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     int numHwLayers = ctx->listStats[dpy].numAppLayers;
     for(int i = 0; i < numHwLayers; i++ )
     {
+        //Layers in the FB batch have no pipe of their own
+        if(!(layerProp[i].mFlags & HWC_MDPCOMP)) {
+            continue;
+        }
+
         hwc_layer_1_t *layer = &list->hwLayers[i];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
         if(!hnd) {
@@ -1490,10 +2050,6 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             return false;
         }
 
-        if(!(layerProp[i].mFlags & HWC_MDPCOMP)) {
-            continue;
-        }
-
         MdpPipeInfoHighRes& pipe_info =
                 *(MdpPipeInfoHighRes*)mCurrentFrame.pipeLayer[i].pipeInfo;
         Rotator *rot = mCurrentFrame.pipeLayer[i].rot;
@@ -1504,6 +2060,7 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         int offset = hnd->offset;
 
         if(rot) {
+            rot->setSrcBuffer(hnd, !ctx->mLayerCache[dpy]->isStable(i));
             rot->queueBuffer(fd, offset);
             fd = rot->getDstMemId();
             offset = rot->getDstOffset();
@@ -25,6 +25,8 @@
 #include <idle_invalidator.h>
 #include <cutils/properties.h>
 #include <overlay.h>
+#include <mdp_bw_model.h>
+#include "hwc_pipe_solver.h"
 
 #define MAX_STATIC_PIPES 3
 #define MDPCOMP_INDEX_OFFSET 4
@@ -219,7 +221,9 @@ private:
     /* Is debug enabled */
     static bool isDebug() { return sDebugLogs ? true : false; };
 #define DEFAULT_IDLE_TIME 2000
-#define MAX_PIPES_PER_MIXER 4
+/* bounds of the idle time the policy picks, in ms */
+#define MIN_IDLE_TIME 100
+#define MAX_IDLE_TIME 10000
 
 namespace overlay {
     class Rotator;
@@ -233,6 +237,8 @@ public:
     virtual ~MDPComp(){};
     /*sets up mdp comp for the current frame */
     bool prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* repeats the last frame's setup if only the buffers changed */
+    bool prepareFast(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* draw */
     virtual bool draw(hwc_context_t *ctx, hwc_display_contents_1_t *list) = 0;
 
@@ -266,21 +272,48 @@ protected:
         overlay::Rotator* rot;
     };
 
+    /* what a layer's pipe configuration depends on, for prepareFast */
+    struct LayerGeometry {
+        uint32_t flags;
+        uint32_t transform;
+        int32_t blending;
+        hwc_rect_t sourceCrop;
+        hwc_rect_t displayFrame;
+        int format;
+        int width;
+        int height;
+        int privFlags;
+    };
+
     /* introduced for mixed mode implementation */
     struct FrameInfo {
         int count;
         struct PipeLayerPair* pipeLayer;
+        /* layers batched into the FB target, contiguous in z-order */
+        bool isFBComposed[MAX_NUM_LAYERS];
+        int fbStart;
+        int fbCount;
+        /* z-order the FB target is staged at among the MDP layers */
+        int fbZ;
+        int mdpCount;
+        /* estimated pixels the GPU composes for the batch */
+        uint32_t fbCost;
+        /* batch reuses the FB target of an earlier frame, no GPU work */
+        bool fbCached;
+        /* pipe type per layer, left (or only) and right mixer */
+        ePipeType pipeType[MAX_NUM_LAYERS][2];
     };
 
-    /* calculates pipes needed for the panel */
-    virtual int pipesNeeded(hwc_context_t *ctx,
-                            hwc_display_contents_1_t* list) = 0;
+    /* calculates pipes a layer needs on the panel */
+    virtual int pipesNeeded(hwc_context_t *ctx, hwc_layer_1_t* layer) = 0;
     /* allocates pipe from pipe book */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
                 hwc_display_contents_1_t* list,FrameInfo& current_frame) = 0;
     /* configures MPD pipes */
     virtual int configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
                 PipeLayerPair& pipeLayerPair) = 0;
+    /* pipes of a configured layer as a bitmask of ovutils::eDest */
+    virtual int getPipeMask(PipeLayerPair& pipeLayerPair) = 0;
 
 
     /* set/reset flags for MDPComp */
@@ -304,6 +337,31 @@ protected:
     static bool isEnabled() { return sEnabled; };
     /* checks for mdp comp width limitation */
     bool isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer);
+    /* checks the layers against the bandwidth and clock model */
+    bool isBwSufficient(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* picks the cheapest contiguous layer range to batch into FB target */
+    bool chooseFBBatch(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+            int availablePipes);
+    /* estimated cost for the GPU to compose a layer */
+    static uint32_t getGpuCost(hwc_context_t *ctx, hwc_layer_1_t* layer);
+    /* pipe types that can stage a layer, as a mask of 1 << ePipeType */
+    int getPipeCaps(hwc_context_t *ctx, hwc_layer_1_t* layer);
+    /* solves for the cheapest pipe type of every MDP layer */
+    bool assignPipeTypes(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* records the layer geometry of a frame set up by prepare */
+    void saveGeometry(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* layer geometry matches the saved one */
+    bool isSameGeometry(hwc_display_contents_1_t* list);
+    static void getGeometry(hwc_layer_1_t* layer, LayerGeometry& geom);
+    /* feeds the cost of the frame set up by prepare to the idle policy */
+    void updateIdlePolicy(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* the screen changed after an idle fallback */
+    void endIdleStatic();
+    /* z-order of an MDP layer once the FB batch is collapsed */
+    int getMdpZ(int index) {
+        return (mCurrentFrame.fbCount && index > mCurrentFrame.fbStart) ?
+                index - mCurrentFrame.fbCount + 1 : index;
+    };
 
     eState mState;
 
@@ -311,7 +369,56 @@ protected:
     static bool sDebugLogs;
     static bool sIdleFallBack;
     static IdleInvalidator *idleInvalidator;
+    static qdutils::MDPBwModel *sBwModel;
+    static bool sMixedMode;
     struct FrameInfo mCurrentFrame;
+    /* frames composed fully by MDP, mixed with the FB target, or by GPU */
+    uint32_t mFullFrames;
+    uint32_t mMixedFrames;
+    uint32_t mFBFrames;
+    /* pipe type solver, search nodes of the last frame and give-ups */
+    int mSolverNodes;
+    uint32_t mSolverTimeouts;
+    uint32_t mSolverInfeasible;
+    /* last frame set up by prepare, valid until the next prepare */
+    bool mGeometryValid;
+    int mGeometryLayers;
+    LayerGeometry mGeometry[MAX_NUM_LAYERS];
+    ListStats mGeometryStats;
+    /* frames that took prepareFast, and cached frames it turned down */
+    uint32_t mFastHits;
+    uint32_t mFastMisses;
+
+    /* Whether and when an idle screen falls back to the GPU. A static frame
+     * on MDP still costs the fetch of every layer at each refresh; after the
+     * fallback it costs one GPU composition, then the FB target fetch alone.
+     * The idle time is how long the MDP takes to fetch what that one GPU
+     * pass costs, doubled each time the screen changes again before the
+     * fallback has paid off. */
+    /* Owned by the composition thread. never and skipped are also used by
+     * timeout_handler on the IdleInvalidator thread, through atomics */
+    struct IdlePolicy {
+        /* MDP fetches no more than the FB target would, never fall back */
+        volatile int32_t never;
+        uint32_t timeoutMs;
+        uint32_t breakEvenMs;
+        uint32_t backoff; //shift applied to breakEvenMs
+        /* fallback frame prepared, 0 once the screen changed again */
+        nsecs_t fallbackTime;
+        uint32_t fired;
+        volatile int32_t skipped;
+        /* screen changed again before the break even time */
+        uint32_t wasted;
+        /* how long the screen stayed static after a fallback */
+        nsecs_t staticLast;
+        nsecs_t staticMax;
+        nsecs_t staticTotal;
+        uint32_t staticCount;
+    };
+    IdlePolicy mIdle;
+    /* debug.mdpcomp.idletime set, always fall back after that long */
+    static bool sIdleFixed;
+    static uint32_t sIdleTimeout;
 };
 
 class MDPCompLowRes : public MDPComp {
@@ -329,13 +436,14 @@ private:
     virtual int configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
             PipeLayerPair& pipeLayerPair);
 
+    virtual int getPipeMask(PipeLayerPair& pipeLayerPair);
+
     /* allocates pipes to selected candidates */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
             hwc_display_contents_1_t* list,
             FrameInfo& current_frame);
 
-    virtual int pipesNeeded(hwc_context_t *ctx,
-            hwc_display_contents_1_t* list);
+    virtual int pipesNeeded(hwc_context_t *ctx, hwc_layer_1_t* layer);
 };
 
 class MDPCompHighRes : public MDPComp {
@@ -350,18 +458,21 @@ private:
     };
 
     bool acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
-                        MdpPipeInfoHighRes& pipe_info, ePipeType type);
+                        MdpPipeInfoHighRes& pipe_info,
+                        const ePipeType types[2]);
 
     /* configure's overlay pipes for the frame */
     virtual int configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
             PipeLayerPair& pipeLayerPair);
 
+    virtual int getPipeMask(PipeLayerPair& pipeLayerPair);
+
     /* allocates pipes to selected candidates */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
             hwc_display_contents_1_t* list,
             FrameInfo& current_frame);
 
-    virtual int pipesNeeded(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    virtual int pipesNeeded(hwc_context_t *ctx, hwc_layer_1_t* layer);
 };
 }; //namespace
 #endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HWC_PIPE_SOLVER_H
+#define HWC_PIPE_SOLVER_H
+
+#include <string.h>
+#include <utils/Timers.h>
+#include <overlayUtils.h>
+
+#define MAX_PIPES_PER_MIXER 4
+
+namespace qhwc {
+
+/*
+ * Exact search over the pipe type of every layer slot, a slot being a layer
+ * or its half on one mixer. Slots with the fewest choices go first and a
+ * branch is cut once it can not beat the best assignment. Cost ranks the
+ * pipe types by how capable they are, so the cheapest solution keeps VG
+ * pipes for video and the rest for the next frame.
+ *
+ * Slots carry no mixer side. MDSS pipes are one pool per display, a pipe
+ * is bound to the left or right mixer by the request that stages it, so
+ * both halves of a split layer draw from the same free counts. The stages
+ * of each mixer are bounded by the callers, which never stage more than
+ * MAX_PIPES_PER_MIXER layers.
+ */
+struct PipeSolver {
+    enum {
+        MAX_SLOTS = MAX_PIPES_PER_MIXER * 2,
+        NUM_TYPES = 3,
+        BUDGET_NS = 200000,
+        CLOCK_NODES = 64,
+    };
+
+    int numSlots;
+    int caps[MAX_SLOTS];        //mask of 1 << eMdpPipeType
+    int order[MAX_SLOTS];
+    int bound[MAX_SLOTS + 1];
+    int freePipes[NUM_TYPES];
+    int choice[MAX_SLOTS];
+    int best[MAX_SLOTS];
+    int bestCost;
+    int nodes;
+    nsecs_t deadline;
+    bool timedOut;
+
+    static int typeCost(int type) {
+        switch(type) {
+            case overlay::utils::OV_MDP_PIPE_DMA: return 0;
+            case overlay::utils::OV_MDP_PIPE_RGB: return 1;
+            default: return 2;
+        }
+    }
+
+    bool solve() {
+        //Most constrained slots first
+        for(int i = 0; i < numSlots; i++)
+            order[i] = i;
+        for(int i = 1; i < numSlots; i++) {
+            for(int j = i; j > 0 && __builtin_popcount(caps[order[j]]) <
+                    __builtin_popcount(caps[order[j - 1]]); j--) {
+                int tmp = order[j];
+                order[j] = order[j - 1];
+                order[j - 1] = tmp;
+            }
+        }
+        bound[numSlots] = 0;
+        for(int i = numSlots - 1; i >= 0; i--) {
+            int cheapest = typeCost(overlay::utils::OV_MDP_PIPE_VG);
+            for(int type = 0; type < NUM_TYPES; type++) {
+                if((caps[order[i]] & (1 << type)) &&
+                        typeCost(type) < cheapest)
+                    cheapest = typeCost(type);
+            }
+            bound[i] = bound[i + 1] + cheapest;
+        }
+        bestCost = -1;
+        nodes = 0;
+        timedOut = false;
+        deadline = systemTime(SYSTEM_TIME_MONOTONIC) + BUDGET_NS;
+        search(0, 0);
+        return bestCost >= 0;
+    }
+
+    void search(int k, int cost) {
+        if(timedOut)
+            return;
+        if((++nodes % CLOCK_NODES) == 0 &&
+                systemTime(SYSTEM_TIME_MONOTONIC) > deadline) {
+            timedOut = true;
+            return;
+        }
+        if(bestCost >= 0 && cost + bound[k] >= bestCost)
+            return;
+        if(k == numSlots) {
+            bestCost = cost;
+            memcpy(best, choice, sizeof(best));
+            return;
+        }
+        int slot = order[k];
+        //Cheapest type first, the first complete solution is a good bound
+        static const int sTypes[NUM_TYPES] = {
+                overlay::utils::OV_MDP_PIPE_DMA,
+                overlay::utils::OV_MDP_PIPE_RGB,
+                overlay::utils::OV_MDP_PIPE_VG };
+        for(int i = 0; i < NUM_TYPES; i++) {
+            int type = sTypes[i];
+            if(!(caps[slot] & (1 << type)) || !freePipes[type])
+                continue;
+            freePipes[type]--;
+            choice[slot] = type;
+            search(k + 1, cost + typeCost(type));
+            freePipes[type]++;
+        }
+    }
+};
+
+}; //namespace qhwc
+
+#endif //HWC_PIPE_SOLVER_H
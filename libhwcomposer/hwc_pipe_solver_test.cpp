@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Runs PipeSolver over hand built layer mixes and compares it with the
+ * greedy order allocLayerPipes used before it: video takes VG first, then
+ * each UI layer in z order asks for DMA if it is unscaled on MDSS, or for
+ * any pipe, and falls back RGB then VG. The solver must stage every mix
+ * the greedy order staged validly, at no higher cost, and must never hand
+ * a layer a pipe type it can not use. A sweep then runs every single mixer
+ * mix of up to MAX_TEST_LAYERS layers and up to 3 free pipes per type,
+ * checks the solver against the cheapest assignment found by trying all of
+ * them, and counts the mixes the greedy order loses, staging fewer or
+ * paying more. Exits non zero if any check fails. */
+
+#include <stdio.h>
+#include "hwc_pipe_solver.h"
+
+using namespace qhwc;
+namespace ovutils = overlay::utils;
+
+#define MAX_TEST_LAYERS 4
+
+enum {
+    YUV,        //video, VG only
+    UI_SCALED,  //RGB or VG
+    UI_PLAIN,   //unscaled, DMA too on MDSS
+    UI_FLIPPED, //unscaled but flipped, DMA can not flip
+    NUM_KINDS,
+};
+
+struct TestLayer {
+    int kind;
+    int halves; //mixers the layer spans on a split panel
+};
+
+struct TestMix {
+    const char *name;
+    bool mdss;
+    bool needsRotator;
+    int freePipes[PipeSolver::NUM_TYPES]; //RGB, VG, DMA
+    bool greedyOk;  //greedy staged it with valid pipe types
+    bool solverOk;
+    int numLayers;
+    TestLayer layers[MAX_TEST_LAYERS];
+};
+
+#define L(kind) { kind, 1 }
+#define SPLIT(kind) { kind, 2 }
+
+static const TestMix sMixes[] = {
+    //MDP4.2, 2 RGB and 2 VG, DMA never for composition
+    { "mdp4 video + 3 ui", false, false, { 2, 2, 0 }, true, true,
+        4, { L(YUV), L(UI_SCALED), L(UI_PLAIN), L(UI_PLAIN) } },
+    { "mdp4 2 videos + 2 ui", false, false, { 2, 2, 0 }, true, true,
+        4, { L(YUV), L(UI_PLAIN), L(YUV), L(UI_SCALED) } },
+    { "mdp4 3 videos", false, false, { 2, 2, 0 }, false, false,
+        3, { L(YUV), L(YUV), L(YUV) } },
+    { "mdp4 video + 3 scaled ui", false, false, { 2, 2, 0 }, true, true,
+        4, { L(UI_SCALED), L(YUV), L(UI_SCALED), L(UI_SCALED) } },
+    //UI below the videos could take the VG pipes first, neither may
+    { "mdp4 ui under 2 videos", false, false, { 2, 2, 0 }, true, true,
+        4, { L(UI_SCALED), L(UI_PLAIN), L(YUV), L(YUV) } },
+    { "mdp4 ui would starve video", false, false, { 1, 2, 0 }, false, false,
+        4, { L(UI_PLAIN), L(UI_SCALED), L(UI_SCALED), L(YUV) } },
+
+    //MDSS, 3 RGB, 3 VG and 2 DMA when nothing else holds them
+    { "mdss 4 plain ui", true, false, { 3, 3, 2 }, true, true,
+        4, { L(UI_PLAIN), L(UI_PLAIN), L(UI_PLAIN), L(UI_PLAIN) } },
+    //Unscaled layers past the DMA pipes spill to RGB, then VG
+    { "mdss dma exhausted", true, false, { 1, 1, 2 }, true, true,
+        4, { L(UI_PLAIN), L(UI_PLAIN), L(UI_PLAIN), L(UI_PLAIN) } },
+    { "mdss dma exhausted + scaled", true, false, { 1, 1, 1 }, true, true,
+        3, { L(UI_PLAIN), L(UI_PLAIN), L(UI_SCALED) } },
+    { "mdss dma exhausted, no room", true, false, { 1, 0, 1 }, false, false,
+        3, { L(UI_PLAIN), L(UI_PLAIN), L(UI_SCALED) } },
+    //Greedy put the flipped layer on DMA, which the driver rejects
+    { "mdss flipped ui", true, false, { 1, 0, 2 }, false, true,
+        3, { L(UI_FLIPPED), L(UI_PLAIN), L(UI_PLAIN) } },
+    { "mdss rotator owns dma", true, true, { 1, 3, 2 }, true, true,
+        4, { L(YUV), L(UI_PLAIN), L(UI_PLAIN), L(UI_PLAIN) } },
+
+    //MDSS split panel, a layer across the middle takes a pipe per mixer
+    { "mdss split video + ui", true, false, { 3, 3, 2 }, true, true,
+        4, { SPLIT(YUV), SPLIT(UI_PLAIN), SPLIT(UI_SCALED), L(UI_PLAIN) } },
+    { "mdss split scaled ui on vg", true, false, { 3, 3, 2 }, true, true,
+        3, { SPLIT(YUV), SPLIT(UI_SCALED), SPLIT(UI_SCALED) } },
+    { "mdss split 2 videos", true, false, { 3, 3, 2 }, false, false,
+        2, { SPLIT(YUV), SPLIT(YUV) } },
+};
+
+static int getCaps(const TestMix& mix, int kind) {
+    if(kind == YUV)
+        return (1 << ovutils::OV_MDP_PIPE_VG);
+    int caps = (1 << ovutils::OV_MDP_PIPE_RGB) |
+            (1 << ovutils::OV_MDP_PIPE_VG);
+    if(kind == UI_PLAIN && mix.mdss && !mix.needsRotator)
+        caps |= (1 << ovutils::OV_MDP_PIPE_DMA);
+    return caps;
+}
+
+static bool takePipe(int freePipes[], int type) {
+    if(!freePipes[type])
+        return false;
+    freePipes[type]--;
+    return true;
+}
+
+//The allocLayerPipes order before PipeSolver. Returns the cost, -1 if a
+//layer got no pipe or a pipe type it can not use
+static int runGreedy(const TestMix& mix) {
+    int freePipes[PipeSolver::NUM_TYPES];
+    memcpy(freePipes, mix.freePipes, sizeof(freePipes));
+    int cost = 0;
+    bool valid = true;
+    for(int pass = 0; pass < 2; pass++) {
+        for(int i = 0; i < mix.numLayers; i++) {
+            const TestLayer& layer = mix.layers[i];
+            //Videos first, then the UI layers
+            if((layer.kind == YUV) != (pass == 0))
+                continue;
+            for(int h = 0; h < layer.halves; h++) {
+                int type = -1;
+                if(layer.kind == YUV) {
+                    if(takePipe(freePipes, ovutils::OV_MDP_PIPE_VG))
+                        type = ovutils::OV_MDP_PIPE_VG;
+                } else {
+                    //Unscaled went to DMA, flipped or not
+                    if(layer.kind != UI_SCALED && mix.mdss &&
+                            !mix.needsRotator &&
+                            takePipe(freePipes, ovutils::OV_MDP_PIPE_DMA))
+                        type = ovutils::OV_MDP_PIPE_DMA;
+                    else if(takePipe(freePipes, ovutils::OV_MDP_PIPE_RGB))
+                        type = ovutils::OV_MDP_PIPE_RGB;
+                    else if(takePipe(freePipes, ovutils::OV_MDP_PIPE_VG))
+                        type = ovutils::OV_MDP_PIPE_VG;
+                }
+                if(type < 0)
+                    return -1;
+                if(!(getCaps(mix, layer.kind) & (1 << type)))
+                    valid = false;
+                cost += PipeSolver::typeCost(type);
+            }
+        }
+    }
+    return valid ? cost : -1;
+}
+
+//Fills the solver the way MDPComp::assignPipeTypes does
+static bool runSolver(const TestMix& mix, PipeSolver& solver) {
+    solver.numSlots = 0;
+    for(int i = 0; i < mix.numLayers; i++) {
+        for(int h = 0; h < mix.layers[i].halves; h++)
+            solver.caps[solver.numSlots++] = getCaps(mix, mix.layers[i].kind);
+    }
+    memcpy(solver.freePipes, mix.freePipes, sizeof(solver.freePipes));
+    if(mix.needsRotator)
+        solver.freePipes[ovutils::OV_MDP_PIPE_DMA] = 0;
+    return solver.solve();
+}
+
+//Every slot on a type it can use, no type over its free count
+static bool isValid(const TestMix& mix, const PipeSolver& solver) {
+    int used[PipeSolver::NUM_TYPES] = { 0 };
+    for(int slot = 0; slot < solver.numSlots; slot++) {
+        int type = solver.best[slot];
+        if(!(solver.caps[slot] & (1 << type)))
+            return false;
+        used[type]++;
+    }
+    for(int type = 0; type < PipeSolver::NUM_TYPES; type++) {
+        if(used[type] > mix.freePipes[type])
+            return false;
+    }
+    return true;
+}
+
+//Cheapest valid assignment by trying every one, -1 if there is none
+static int bruteForce(const TestMix& mix) {
+    int caps[PipeSolver::MAX_SLOTS];
+    int numSlots = 0;
+    for(int i = 0; i < mix.numLayers; i++) {
+        for(int h = 0; h < mix.layers[i].halves; h++)
+            caps[numSlots++] = getCaps(mix, mix.layers[i].kind);
+    }
+    int combos = 1;
+    for(int slot = 0; slot < numSlots; slot++)
+        combos *= PipeSolver::NUM_TYPES;
+    int best = -1;
+    for(int c = 0; c < combos; c++) {
+        int used[PipeSolver::NUM_TYPES] = { 0 };
+        int cost = 0;
+        bool valid = true;
+        for(int slot = 0, rest = c; valid && slot < numSlots; slot++) {
+            int type = rest % PipeSolver::NUM_TYPES;
+            rest /= PipeSolver::NUM_TYPES;
+            valid = (caps[slot] & (1 << type)) &&
+                    ++used[type] <= mix.freePipes[type];
+            cost += PipeSolver::typeCost(type);
+        }
+        if(valid && (best < 0 || cost < best))
+            best = cost;
+    }
+    return best;
+}
+
+//Every single mixer mix, returns the number of failed checks
+static int runSweep() {
+    int failures = 0, mixes = 0, greedyLosses = 0;
+    TestMix mix;
+    memset(&mix, 0, sizeof(mix));
+    mix.name = "sweep";
+    for(int target = 0; target < 3; target++) {
+        //MDP4.2, MDSS, MDSS with the rotator on DMA
+        mix.mdss = target > 0;
+        mix.needsRotator = target == 2;
+        int maxDma = mix.mdss ? 2 : 0;
+        for(int free = 0; free < 4 * 4 * (maxDma + 1); free++) {
+            mix.freePipes[ovutils::OV_MDP_PIPE_RGB] = free % 4;
+            mix.freePipes[ovutils::OV_MDP_PIPE_VG] = (free / 4) % 4;
+            mix.freePipes[ovutils::OV_MDP_PIPE_DMA] = free / 16;
+            for(int n = 1; n <= MAX_TEST_LAYERS; n++) {
+                int kinds = 1;
+                for(int i = 0; i < n; i++)
+                    kinds *= NUM_KINDS;
+                mix.numLayers = n;
+                for(int k = 0; k < kinds; k++) {
+                    for(int i = 0, rest = k; i < n; i++, rest /= NUM_KINDS) {
+                        mix.layers[i].kind = rest % NUM_KINDS;
+                        mix.layers[i].halves = 1;
+                    }
+                    PipeSolver solver;
+                    int optimum = bruteForce(mix);
+                    int greedyCost = runGreedy(mix);
+                    bool found = runSolver(mix, solver);
+                    bool ok = found == (optimum >= 0) && !solver.timedOut;
+                    if(found) {
+                        ok = ok && isValid(mix, solver) &&
+                                solver.bestCost == optimum;
+                    }
+                    if(optimum >= 0 && greedyCost != optimum)
+                        greedyLosses++;
+                    if(!ok)
+                        failures++;
+                    mixes++;
+                }
+            }
+        }
+    }
+    printf("%s sweep of %d mixes, %d not solved optimally, greedy order "
+            "lost %d\n", failures ? "FAIL" : "PASS", mixes, failures,
+            greedyLosses);
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    const int count = sizeof(sMixes) / sizeof(sMixes[0]);
+    for(int i = 0; i < count; i++) {
+        const TestMix& mix = sMixes[i];
+        PipeSolver solver;
+        int greedyCost = runGreedy(mix);
+        bool found = runSolver(mix, solver);
+
+        bool ok = ((greedyCost >= 0) == mix.greedyOk) &&
+                (found == mix.solverOk) && !solver.timedOut;
+        if(found)
+            ok = ok && isValid(mix, solver);
+        if(found && greedyCost >= 0)
+            ok = ok && solver.bestCost <= greedyCost;
+        printf("%s %-28s greedy %-4s cost %2d, solver %-4s cost %2d, "
+                "%d nodes\n", ok ? "PASS" : "FAIL", mix.name,
+                greedyCost >= 0 ? "ok" : "fail", greedyCost,
+                found ? "ok" : "fail", found ? solver.bestCost : -1,
+                solver.nodes);
+        if(!ok)
+            failures++;
+    }
+    printf("%d of %d mixes failed\n", failures, count);
+    failures += runSweep();
+    return failures ? 1 : 0;
+}
@@ -30,6 +30,8 @@
 #include <hwc_qclient.h>
 #include <IQService.h>
 #include <hwc_utils.h>
+#include <overlayRotator.h>
+#include <cutils/atomic.h>
 
 #define QCLIENT_DEBUG 0
 
@@ -61,6 +63,12 @@ status_t QClient::notifyCallback(uint32_t msg, uint32_t value) {
         case IQService::SCREEN_REFRESH:
             return screenRefresh();
             break;
+        case IQService::RESET_PERF_STATS:
+            resetPerfStats();
+            break;
+        case IQService::REFRESH_PROPERTIES:
+            refreshProperties();
+            break;
         default:
             return NO_ERROR;
     }
@@ -73,6 +81,10 @@ void QClient::securing(uint32_t startEnd) {
     IMediaDeathNotifier::getMediaPlayerService();
 
     mHwcContext->mSecuring = startEnd;
+    //Secure playback needs its own rotator session and secure buffers, get
+    //them ready before the first secure frame shows up
+    if(startEnd == IQService::START && mHwcContext->mRotMgr)
+        mHwcContext->mRotMgr->prewarmSecure();
     //We're done securing
     if(startEnd == IQService::END)
         mHwcContext->mSecureMode = true;
@@ -97,6 +109,19 @@ void QClient::MPDeathNotifier::died() {
         mHwcContext->proc->invalidate(mHwcContext->proc);
 }
 
+void QClient::resetPerfStats() {
+    //Pipes and rotator sessions belong to the composition thread, the
+    //counters are cleared there at the start of the next prepare
+    mHwcContext->mResetPerfStats = true;
+}
+
+void QClient::refreshProperties() {
+    //Picked up by the next prepare, redraw so that it comes soon
+    android_atomic_release_store(1, &mHwcContext->mRefreshProps);
+    if(mHwcContext->proc)
+        mHwcContext->proc->invalidate(mHwcContext->proc);
+}
+
 android::status_t QClient::screenRefresh() {
     status_t result = NO_INIT;
 #ifdef QCOM_BSP
@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* hwcreplay: drives the hwcomposer module with a layer list trace captured
+ * through debug.hwc.capture. It installs FakeMdpBackend through setBackend,
+ * so liboverlay and hwc talk to it instead of the fb and rotator drivers,
+ * and an IonController over FakeIonAlloc, so neither the captured buffers
+ * nor the rotator's come from /dev/ion. Buffers are fake ION allocations
+ * with the captured geometry and nothing is rendered. Captured acquire fences are replayed as sw_sync fences: one
+ * that had signaled before prepare is handed in signaled, one still pending
+ * at prepare is signaled once prepare returns, so the HAL sees the same
+ * fences to dup, merge and close. Without sw_sync they are passed as -1.
+ *
+ * usage: hwcreplay [-v] <trace>
+ *   -v  print the MDP ioctls of every frame
+ *
+ * Per frame it prints the prepare and set CPU time, the acquire fences
+ * (pending at prepare, and how long before prepare the latest signaled one
+ * did), the composition decision of each layer (F framebuffer, O overlay,
+ * T FB target, B background) and marks frames whose decisions differ from
+ * the captured ones. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <hardware/hardware.h>
+#include <hardware/hwcomposer.h>
+#include <gralloc_priv.h>
+#include <alloc_controller.h>
+#include <memalloc.h>
+#include <fakeionalloc.h>
+#include <ion_msm.h>
+#include <mdpBackend.h>
+#include <mdpFakeBackend.h>
+#include <sw_sync.h>
+#include "hwc_trace.h"
+
+using namespace qhwc;
+using overlay::mdp_wrapper::FakeMdpBackend;
+using overlay::mdp_wrapper::RecordingMdpBackend;
+using gralloc::FakeIonAlloc;
+using gralloc::IAllocController;
+using gralloc::IonController;
+
+namespace {
+
+enum { MAX_BUFFERS = 256 };
+
+struct Buffer {
+    uint32_t id;
+    private_handle_t *hnd;
+};
+
+struct Timing {
+    uint64_t total;
+    uint64_t max;
+    void add(uint64_t us) {
+        total += us;
+        if(us > max)
+            max = us;
+    }
+};
+
+FakeIonAlloc *sIon;
+Buffer sBuffers[MAX_BUFFERS];
+uint32_t sNumBuffers;
+//Acquire fences are points on this timeline, -1 without sw_sync
+int sTimelineFd = -1;
+unsigned int sTimelineValue;
+
+uint64_t cpuTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Fake ION buffer with the captured geometry, mapped like a gralloc one */
+private_handle_t *newHandle(const TraceLayer& tl) {
+    gralloc::alloc_data data;
+    memset(&data, 0, sizeof(data));
+    data.fd = -1;
+    data.size = tl.size ? tl.size : 1;
+    data.flags = ION_HEAP(ION_SYSTEM_HEAP_ID);
+    int err = sIon->alloc_buffer(data);
+    if(err < 0) {
+        fprintf(stderr, "can't allocate %u bytes for buffer %u: %s\n",
+                (unsigned int)data.size, tl.handleId, strerror(-err));
+        return NULL;
+    }
+    private_handle_t *hnd = new private_handle_t(data.fd, data.size,
+            tl.handleFlags, tl.bufferType, tl.format, tl.width, tl.height);
+    hnd->base = int(data.base);
+    return hnd;
+}
+
+void freeHandle(private_handle_t *hnd) {
+    if(hnd == NULL)
+        return;
+    sIon->free_buffer((void *)hnd->base, hnd->size, 0, hnd->fd);
+    delete hnd;
+}
+
+/* Same id, same handle, so the HAL sees buffer swaps where the capture did.
+ * Geometry changes under an id get a fresh handle. */
+private_handle_t *getHandle(const TraceLayer& tl) {
+    if(tl.handleId == 0)
+        return NULL;
+    for(uint32_t i = 0; i < sNumBuffers; i++) {
+        Buffer& b = sBuffers[i];
+        if(b.id != tl.handleId)
+            continue;
+        if(b.hnd && b.hnd->format == tl.format && b.hnd->width == tl.width &&
+                b.hnd->height == tl.height && b.hnd->flags == tl.handleFlags)
+            return b.hnd;
+        freeHandle(b.hnd);
+        b.hnd = newHandle(tl);
+        return b.hnd;
+    }
+    Buffer& b = sBuffers[sNumBuffers % MAX_BUFFERS];
+    if(sNumBuffers >= MAX_BUFFERS)
+        freeHandle(b.hnd);
+    else
+        sNumBuffers++;
+    b.id = tl.handleId;
+    b.hnd = newHandle(tl);
+    return b.hnd;
+}
+
+char decisionChar(int32_t type) {
+    switch(type) {
+    case HWC_FRAMEBUFFER:        return 'F';
+    case HWC_OVERLAY:            return 'O';
+    case HWC_FRAMEBUFFER_TARGET: return 'T';
+    case HWC_BACKGROUND:         return 'B';
+    }
+    return '?';
+}
+
+/* Acquire fence for a captured layer, the HAL owns and closes it. A fence
+ * signaled at capture gets the current point, which already signaled. A
+ * pending one gets the next point, signaled by signalPending() */
+int createAcquireFence(const TraceLayer& tl) {
+    if(sTimelineFd < 0 || tl.acquireFence == TraceLayer::FENCE_NONE)
+        return -1;
+    unsigned int value = sTimelineValue;
+    if(tl.acquireFence == TraceLayer::FENCE_PENDING)
+        value++;
+    return sw_sync_fence_create(sTimelineFd, "hwcreplay", value);
+}
+
+void signalPending() {
+    if(sTimelineFd >= 0 && sw_sync_timeline_inc(sTimelineFd, 1) == 0)
+        sTimelineValue++;
+}
+
+void closeFences(hwc_display_contents_1_t *list) {
+    for(size_t i = 0; i < list->numHwLayers; i++) {
+        if(list->hwLayers[i].releaseFenceFd >= 0)
+            close(list->hwLayers[i].releaseFenceFd);
+        list->hwLayers[i].releaseFenceFd = -1;
+    }
+    if(list->retireFenceFd >= 0)
+        close(list->retireFenceFd);
+    list->retireFenceFd = -1;
+}
+
+void printIoctls(const RecordingMdpBackend& rec, uint32_t since) {
+    RecordingMdpBackend::Record recs[RecordingMdpBackend::MAX_RECORDS];
+    uint32_t count = rec.getTotal() - since;
+    if(count > RecordingMdpBackend::MAX_RECORDS) {
+        printf("    (%u ioctls not kept)\n",
+                count - RecordingMdpBackend::MAX_RECORDS);
+        count = RecordingMdpBackend::MAX_RECORDS;
+    }
+    count = rec.getRecords(recs, count);
+    for(uint32_t i = 0; i < count; i++) {
+        const RecordingMdpBackend::Record& r = recs[i];
+        const char *what = (r.op == RecordingMdpBackend::OP_OPEN) ? "open" :
+                (r.op == RecordingMdpBackend::OP_CLOSE) ? "close" :
+                overlay::mdp_wrapper::getRequestStr(r.request);
+        printf("    fd=%-4d %-30s ret=%d\n", r.fd, what, r.ret);
+    }
+}
+
+} //namespace
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    int opt;
+    while((opt = getopt(argc, argv, "v")) != -1) {
+        if(opt == 'v')
+            verbose = true;
+        else
+            break;
+    }
+    if(optind >= argc) {
+        fprintf(stderr, "usage: %s [-v] <trace>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if(file == NULL) {
+        fprintf(stderr, "can't open %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    TraceHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 ||
+            header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d hwc trace\n", argv[optind],
+                TRACE_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    //The fake has to be in place before the HAL opens fb0
+    FakeMdpBackend *fake = FakeMdpBackend::getInstance();
+    FakeMdpBackend::Config config =
+            FakeMdpBackend::getDefaultConfig(header.mdpVersion);
+    config.xres = header.xres;
+    config.yres = header.yres;
+    fake->configure(config);
+    RecordingMdpBackend rec(fake);
+    overlay::mdp_wrapper::setBackend(&rec);
+    //Same for the allocator, the HAL allocates rotator buffers through it
+    sIon = FakeIonAlloc::getInstance();
+    IonController ionController(sIon);
+    IAllocController *prevController =
+            IAllocController::setInstance(&ionController);
+
+    sTimelineFd = sw_sync_timeline_create();
+    if(sTimelineFd < 0) {
+        printf("no sw_sync timeline (%s), acquire fences are passed as -1\n",
+                strerror(errno));
+    }
+
+    const hw_module_t *module;
+    hwc_composer_device_1_t *hwc = NULL;
+    if(hw_get_module(HWC_HARDWARE_MODULE_ID, &module) != 0 ||
+            hwc_open_1(module, &hwc) != 0) {
+        fprintf(stderr, "can't open the hwcomposer module\n");
+        fclose(file);
+        return 1;
+    }
+    printf("trace: MDP %d %ux%u, replaying on the %s backend\n",
+            header.mdpVersion, header.xres, header.yres, fake->getName());
+
+    hwc_display_contents_1_t *lists[HWC_NUM_DISPLAY_TYPES];
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
+        lists[i] = (hwc_display_contents_1_t *)calloc(1,
+                sizeof(hwc_display_contents_1_t) +
+                TRACE_MAX_LAYERS * sizeof(hwc_layer_1_t));
+    }
+    //Indexed by display, like lists
+    TraceLayer captured[HWC_NUM_DISPLAY_TYPES][TRACE_MAX_LAYERS];
+    Timing prepareTime = {0, 0}, setTime = {0, 0};
+    uint32_t frames = 0, mismatched = 0;
+    uint32_t fences = 0, pendingFences = 0;
+
+    TraceFrame frame;
+    while(fread(&frame, sizeof(frame), 1, file) == 1) {
+        if(frame.magic != TRACE_FRAME_MAGIC ||
+                frame.numDisplays == 0 ||
+                frame.numDisplays > HWC_NUM_DISPLAY_TYPES) {
+            fprintf(stderr, "corrupt frame record after frame %u\n", frames);
+            break;
+        }
+        //hwc walks displays[0..numDisplays], hand it one slot more
+        hwc_display_contents_1_t *displays[HWC_NUM_DISPLAY_TYPES + 1];
+        memset(displays, 0, sizeof(displays));
+        bool ok = true;
+        uint32_t frameFences = 0, framePending = 0;
+        //Latest captured signal time, ns before prepare
+        int64_t lastSignaledNs = LLONG_MIN;
+        for(uint32_t d = 0; ok && d < frame.numDisplays; d++) {
+            TraceDisplay td;
+            ok = fread(&td, sizeof(td), 1, file) == 1 &&
+                    td.dpy >= 0 && td.dpy < HWC_NUM_DISPLAY_TYPES &&
+                    td.numHwLayers <= TRACE_MAX_LAYERS &&
+                    fread(captured[td.dpy], sizeof(TraceLayer),
+                    td.numHwLayers, file) == td.numHwLayers;
+            if(!ok || td.numHwLayers == 0)
+                continue;
+            hwc_display_contents_1_t *list = lists[td.dpy];
+            list->flags = td.flags;
+            list->numHwLayers = td.numHwLayers;
+            list->retireFenceFd = -1;
+            for(uint32_t j = 0; j < td.numHwLayers; j++) {
+                const TraceLayer& tl = captured[td.dpy][j];
+                hwc_layer_1_t& layer = list->hwLayers[j];
+                memset(&layer, 0, sizeof(layer));
+                layer.compositionType = tl.compositionType;
+                layer.hints = tl.hints;
+                layer.flags = tl.flags;
+                layer.handle = getHandle(tl);
+                layer.transform = tl.transform;
+                layer.blending = tl.blending;
+                layer.sourceCrop = tl.sourceCrop;
+                layer.displayFrame = tl.displayFrame;
+                layer.visibleRegionScreen.numRects = 1;
+                layer.visibleRegionScreen.rects = &layer.displayFrame;
+                layer.acquireFenceFd = createAcquireFence(tl);
+                layer.releaseFenceFd = -1;
+                if(tl.acquireFence == TraceLayer::FENCE_PENDING)
+                    framePending++;
+                if(tl.acquireFence != TraceLayer::FENCE_NONE)
+                    frameFences++;
+                if(tl.acquireFence == TraceLayer::FENCE_SIGNALED &&
+                        tl.acquireSignalNs > lastSignaledNs)
+                    lastSignaledNs = tl.acquireSignalNs;
+            }
+            displays[td.dpy] = list;
+        }
+        if(!ok) {
+            fprintf(stderr, "truncated trace after frame %u\n", frames);
+            break;
+        }
+
+        uint32_t ioctlsBefore = rec.getTotal();
+        uint64_t start = cpuTimeUs();
+        hwc->prepare(hwc, frame.numDisplays - 1, displays);
+        uint64_t prepared = cpuTimeUs();
+        //What was pending at capture is ready by the time set runs
+        if(framePending)
+            signalPending();
+        uint64_t setStart = cpuTimeUs();
+        hwc->set(hwc, frame.numDisplays - 1, displays);
+        uint64_t done = cpuTimeUs();
+        prepareTime.add(prepared - start);
+        setTime.add(done - setStart);
+
+        char decisions[HWC_NUM_DISPLAY_TYPES * (TRACE_MAX_LAYERS + 1) + 1];
+        size_t pos = 0;
+        bool same = true;
+        for(uint32_t d = 0; d < HWC_NUM_DISPLAY_TYPES; d++) {
+            hwc_display_contents_1_t *list = displays[d];
+            if(list == NULL)
+                continue;
+            if(pos)
+                decisions[pos++] = '|';
+            for(uint32_t j = 0; j < list->numHwLayers; j++) {
+                int32_t type = list->hwLayers[j].compositionType;
+                decisions[pos++] = decisionChar(type);
+                if(type != captured[d][j].decision)
+                    same = false;
+            }
+            closeFences(list);
+        }
+        decisions[pos] = '\0';
+        if(!same)
+            mismatched++;
+        fences += frameFences;
+        pendingFences += framePending;
+
+        char signaled[32] = "-";
+        if(lastSignaledNs != LLONG_MIN) {
+            snprintf(signaled, sizeof(signaled), "%lld",
+                    (long long)(-lastSignaledNs / 1000));
+        }
+        printf("frame %5u: prepare %4llu us (captured %4u) set %4llu us "
+                "(captured %4u) fences %2u (pending %2u, signaled %s us "
+                "ahead) ioctls %3u %s%s\n", frame.frame,
+                (unsigned long long)(prepared - start), frame.prepareUs,
+                (unsigned long long)(done - setStart), frame.setUs,
+                frameFences, framePending, signaled,
+                rec.getTotal() - ioctlsBefore, decisions,
+                same ? "" : " *differs*");
+        if(verbose)
+            printIoctls(rec, ioctlsBefore);
+        frames++;
+    }
+
+    if(frames) {
+        printf("%u frames: prepare avg %llu max %llu us, set avg %llu "
+                "max %llu us, %u with different decisions\n", frames,
+                (unsigned long long)(prepareTime.total / frames),
+                (unsigned long long)prepareTime.max,
+                (unsigned long long)(setTime.total / frames),
+                (unsigned long long)setTime.max, mismatched);
+        printf("acquire fences: %u, %u pending at prepare\n", fences,
+                pendingFences);
+    }
+    FakeIonAlloc::Stats ionStats;
+    sIon->getStats(ionStats);
+    printf("fake ion: %u allocs, %u failed, %u frees\n", ionStats.allocs,
+            ionStats.allocFailures, ionStats.frees);
+    char dump[4096] = {'\0'};
+    fake->getDump(dump, sizeof(dump));
+    printf("%s", dump);
+
+    hwc_close_1(hwc);
+    overlay::mdp_wrapper::setBackend(NULL);
+    IAllocController::setInstance(prevController);
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++)
+        free(lists[i]);
+    for(uint32_t i = 0; i < sNumBuffers; i++)
+        freeHandle(sBuffers[i].hnd);
+    if(sTimelineFd >= 0)
+        close(sTimelineFd);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <sync/sync.h>
+#include <gralloc_priv.h>
+#include "hwc_trace.h"
+
+namespace qhwc {
+
+#define DEFAULT_MAX_FRAMES 18000 //5 minutes at 60fps
+
+HwcTrace *HwcTrace::create(int mdpVersion, uint32_t xres, uint32_t yres,
+        uint32_t vsyncPeriodNs) {
+    char path[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.capture", path, NULL) <= 0)
+        return NULL;
+
+    uint32_t maxFrames = DEFAULT_MAX_FRAMES;
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.capture.frames", property, NULL) > 0)
+        maxFrames = atoi(property);
+
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        ALOGE("%s: failed to open %s: %s", __FUNCTION__, path,
+                strerror(errno));
+        return NULL;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.mdpVersion = mdpVersion;
+    header.xres = xres;
+    header.yres = yres;
+    header.vsyncPeriodNs = vsyncPeriodNs;
+    if(fwrite(&header, sizeof(header), 1, file) != 1) {
+        ALOGE("%s: failed to write %s", __FUNCTION__, path);
+        fclose(file);
+        return NULL;
+    }
+    ALOGI("%s: capturing up to %u frames to %s", __FUNCTION__, maxFrames,
+            path);
+    return new HwcTrace(file, path, maxFrames);
+}
+
+HwcTrace::HwcTrace(FILE *file, const char *path, uint32_t maxFrames) :
+        mFile(file), mMaxFrames(maxFrames), mFrame(0), mDropped(0),
+        mInFrame(false), mFirstFrame(0), mPrepareStart(0),
+        mNextHandleSlot(0), mNextHandleId(1) {
+    strlcpy(mPath, path, sizeof(mPath));
+    memset(&mCur, 0, sizeof(mCur));
+    memset(mHandles, 0, sizeof(mHandles));
+    memset(mHandleIds, 0, sizeof(mHandleIds));
+}
+
+HwcTrace::~HwcTrace() {
+    if(mFile)
+        fclose(mFile);
+}
+
+uint32_t HwcTrace::getHandleId(const void *hnd) {
+    if(hnd == NULL)
+        return 0;
+    for(int i = 0; i < MAX_HANDLES; i++) {
+        if(mHandles[i] == hnd)
+            return mHandleIds[i];
+    }
+    //A recycled slot may hand a new buffer at an old address a new id,
+    //replay just sees one more buffer swap
+    uint32_t slot = mNextHandleSlot++ % MAX_HANDLES;
+    mHandles[slot] = hnd;
+    mHandleIds[slot] = mNextHandleId++;
+    return mHandleIds[slot];
+}
+
+void HwcTrace::captureFence(int fd, TraceLayer& tl) {
+    tl.acquireFence = TraceLayer::FENCE_NONE;
+    tl.acquireSignalNs = 0;
+    if(fd < 0)
+        return;
+    tl.acquireFence = TraceLayer::FENCE_PENDING;
+    struct sync_fence_info_data *info = sync_fence_info(fd);
+    if(info == NULL)
+        return;
+    if(info->status == 1) {
+        //Signaled when its last point did
+        uint64_t signaled = 0;
+        struct sync_pt_info *pt = NULL;
+        while((pt = sync_pt_info(info, pt)) != NULL) {
+            if(pt->timestamp_ns > signaled)
+                signaled = pt->timestamp_ns;
+        }
+        tl.acquireFence = TraceLayer::FENCE_SIGNALED;
+        tl.acquireSignalNs = (int64_t)signaled - mPrepareStart;
+    }
+    sync_fence_info_free(info);
+}
+
+void HwcTrace::beginPrepare(size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    //Nothing is captured or counted once the file is closed
+    if(mFile == NULL)
+        return;
+    if(mFrame >= mMaxFrames) {
+        ALOGI("%s: %u frames captured to %s", __FUNCTION__, mFrame, mPath);
+        fclose(mFile);
+        mFile = NULL;
+        return;
+    }
+
+    mPrepareStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    if(mFrame == 0)
+        mFirstFrame = mPrepareStart;
+    memset(&mCur, 0, sizeof(mCur));
+    mCur.magic = TRACE_FRAME_MAGIC;
+    mCur.frame = mFrame;
+    mCur.timestamp = mPrepareStart - mFirstFrame;
+
+    //Same walk as hwc_prepare, displays[numDisplays] included
+    for(size_t i = 0; i <= numDisplays && i < HWC_NUM_DISPLAY_TYPES; i++) {
+        hwc_display_contents_1_t *list = displays[i];
+        TraceDisplay& td = mDisplays[mCur.numDisplays];
+        td.dpy = i;
+        td.flags = list ? list->flags : 0;
+        td.numHwLayers = list ? list->numHwLayers : 0;
+        if(td.numHwLayers > TRACE_MAX_LAYERS) {
+            mDropped++;
+            td.numHwLayers = TRACE_MAX_LAYERS;
+        }
+        for(uint32_t j = 0; j < td.numHwLayers; j++) {
+            const hwc_layer_1_t& layer = list->hwLayers[j];
+            const private_handle_t *hnd =
+                    (const private_handle_t *)layer.handle;
+            TraceLayer& tl = mLayers[mCur.numDisplays][j];
+            memset(&tl, 0, sizeof(tl));
+            tl.compositionType = layer.compositionType;
+            tl.hints = layer.hints;
+            tl.flags = layer.flags;
+            tl.transform = layer.transform;
+            tl.blending = layer.blending;
+            tl.sourceCrop = layer.sourceCrop;
+            tl.displayFrame = layer.displayFrame;
+            tl.handleId = getHandleId(hnd);
+            if(hnd) {
+                tl.format = hnd->format;
+                tl.width = hnd->width;
+                tl.height = hnd->height;
+                tl.handleFlags = hnd->flags;
+                tl.bufferType = hnd->bufferType;
+                tl.size = hnd->size;
+            }
+            captureFence(layer.acquireFenceFd, tl);
+        }
+        mCur.numDisplays++;
+    }
+    mInFrame = true;
+}
+
+void HwcTrace::endPrepare(hwc_display_contents_1_t** displays) {
+    if(!mInFrame)
+        return;
+    for(uint32_t i = 0; i < mCur.numDisplays; i++) {
+        const TraceDisplay& td = mDisplays[i];
+        hwc_display_contents_1_t *list = displays[td.dpy];
+        for(uint32_t j = 0; list && j < td.numHwLayers; j++) {
+            mLayers[i][j].decision = list->hwLayers[j].compositionType;
+        }
+    }
+    mCur.prepareUs = (uint32_t)ns2us(systemTime(SYSTEM_TIME_MONOTONIC) -
+            mPrepareStart);
+}
+
+void HwcTrace::endSet(nsecs_t setTime) {
+    if(!mInFrame || mFile == NULL)
+        return;
+    mInFrame = false;
+    mCur.setUs = (uint32_t)ns2us(setTime);
+
+    bool ok = fwrite(&mCur, sizeof(mCur), 1, mFile) == 1;
+    for(uint32_t i = 0; ok && i < mCur.numDisplays; i++) {
+        const TraceDisplay& td = mDisplays[i];
+        ok = fwrite(&td, sizeof(td), 1, mFile) == 1;
+        if(ok && td.numHwLayers) {
+            ok = fwrite(mLayers[i], sizeof(TraceLayer), td.numHwLayers,
+                    mFile) == td.numHwLayers;
+        }
+    }
+    if(!ok) {
+        ALOGE("%s: write to %s failed, capture stopped", __FUNCTION__,
+                mPath);
+        fclose(mFile);
+        mFile = NULL;
+        return;
+    }
+    mFrame++;
+}
+
+}; //namespace qhwc
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are
+ * retained for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HWC_TRACE_H
+#define HWC_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <hardware/hwcomposer.h>
+#include <utils/Timers.h>
+
+namespace qhwc {
+
+/* Layer list trace, written with debug.hwc.capture=<file> and read back by
+ * hwcreplay. A TraceHeader is followed by one record per frame:
+ * TraceFrame, then per display a TraceDisplay and its TraceLayers. All
+ * fields are host endian, the file is not meant to leave the device family
+ * it was captured on. */
+enum {
+    TRACE_MAGIC = 0x54435748,       //"HWCT"
+    TRACE_FRAME_MAGIC = 0x454d5246, //"FRME"
+    TRACE_VERSION = 1,
+    TRACE_MAX_LAYERS = 32,
+};
+
+struct TraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t mdpVersion;
+    uint32_t xres; //of the primary
+    uint32_t yres;
+    uint32_t vsyncPeriodNs;
+};
+
+struct TraceFrame {
+    uint32_t magic;
+    uint32_t frame;
+    int64_t timestamp;  //prepare start, ns since the first frame
+    uint32_t prepareUs; //wall time of hwc_prepare
+    uint32_t setUs;     //wall time of hwc_set
+    uint32_t numDisplays;
+};
+
+struct TraceDisplay {
+    int32_t dpy;
+    uint32_t flags;     //hwc_display_contents_1_t flags
+    uint32_t numHwLayers;
+};
+
+struct TraceLayer {
+    enum { FENCE_NONE, FENCE_PENDING, FENCE_SIGNALED };
+    int32_t compositionType; //as handed in by SurfaceFlinger
+    int32_t decision;        //compositionType once prepare returned
+    uint32_t hints;
+    uint32_t flags;
+    uint32_t transform;
+    int32_t blending;
+    hwc_rect_t sourceCrop;
+    hwc_rect_t displayFrame;
+    //Buffer, handleId 0 if the layer had no handle. The id stays the same
+    //while the same buffer is posted, so replay can tell a buffer swap
+    uint32_t handleId;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t handleFlags;
+    int32_t bufferType;
+    int32_t size;
+    //Acquire fence at prepare, and when it signaled, in ns relative to the
+    //frame's prepare start (negative: before prepare)
+    int32_t acquireFence;
+    int64_t acquireSignalNs;
+};
+
+/* Writes the trace. Lists are snapshotted when prepare starts, since prepare
+ * overwrites compositionType, and the frame is written once set returns */
+class HwcTrace {
+public:
+    /* NULL unless debug.hwc.capture names a writable file */
+    static HwcTrace *create(int mdpVersion, uint32_t xres, uint32_t yres,
+            uint32_t vsyncPeriodNs);
+    ~HwcTrace();
+    void beginPrepare(size_t numDisplays,
+            hwc_display_contents_1_t** displays);
+    void endPrepare(hwc_display_contents_1_t** displays);
+    void endSet(nsecs_t setTime);
+    uint32_t getFrameCount() const { return mFrame; }
+    uint32_t getDroppedCount() const { return mDropped; }
+    /* False once max frames were written or a write failed */
+    bool isCapturing() const { return mFile != NULL; }
+    const char *getPath() const { return mPath; }
+
+private:
+    enum { MAX_HANDLES = 64 };
+    HwcTrace(FILE *file, const char *path, uint32_t maxFrames);
+    uint32_t getHandleId(const void *hnd);
+    void captureFence(int fd, TraceLayer& tl);
+
+    FILE *mFile;
+    char mPath[PATH_MAX];
+    uint32_t mMaxFrames;
+    uint32_t mFrame;
+    uint32_t mDropped;  //layers over TRACE_MAX_LAYERS
+    bool mInFrame;
+    nsecs_t mFirstFrame;
+    nsecs_t mPrepareStart;
+    TraceFrame mCur;
+    TraceDisplay mDisplays[HWC_NUM_DISPLAY_TYPES];
+    TraceLayer mLayers[HWC_NUM_DISPLAY_TYPES][TRACE_MAX_LAYERS];
+    //Recently seen handles and their ids, replaced round robin
+    const void *mHandles[MAX_HANDLES];
+    uint32_t mHandleIds[MAX_HANDLES];
+    uint32_t mNextHandleSlot;
+    uint32_t mNextHandleId;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_TRACE_H
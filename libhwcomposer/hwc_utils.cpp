@@ -45,12 +45,15 @@ static void openFramebufferDevice(hwc_context_t *ctx)
 #define HWC_UTILS_DEBUG 0
 #include <sys/ioctl.h>
 #include <linux/fb.h>
+#include <sync/sync.h>
 #include <binder/IServiceManager.h>
 #include <EGL/egl.h>
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include <gralloc_priv.h>
 #include <overlay.h>
 #include <overlayRotator.h>
+#include <mdpBackend.h>
 #include "hwc_utils.h"
 #include "hwc_mdpcomp.h"
 #include "hwc_fbupdate.h"
@@ -59,12 +62,19 @@ static void openFramebufferDevice(hwc_context_t *ctx)
 #include "hwc_copybit.h"
 #include "external.h"
 #include "hwc_qclient.h"
+#include "hwc_trace.h"
+#include "hwc_frametiming.h"
 #include "QService.h"
 #include "comptype.h"
 
 using namespace qClient;
 using namespace qService;
 using namespace android;
+
+#ifndef MDP_MAX_FENCE_FD
+//Acquire fences MSMFB_BUFFER_SYNC takes, on kernels that don't say
+#define MDP_MAX_FENCE_FD 10
+#endif
 using namespace overlay;
 using namespace overlay::utils;
 namespace ovutils = overlay::utils;
@@ -82,10 +92,11 @@ static int openFramebufferDevice(hwc_context_t *ctx)
         return -errno;
     }
 
-    if (ioctl(fb_fd, FBIOGET_VSCREENINFO, &info) == -1) {
+    if (mdp_wrapper::getBackend()->ioctl(fb_fd, FBIOGET_VSCREENINFO,
+            &info) == -1) {
         ALOGE("%s:Error in ioctl FBIOGET_VSCREENINFO: %s", __FUNCTION__,
                                                        strerror(errno));
-        close(fb_fd);
+        mdp_wrapper::getBackend()->close(fb_fd);
         return -errno;
     }
 
@@ -104,10 +115,11 @@ static int openFramebufferDevice(hwc_context_t *ctx)
     memset(&metadata, 0 , sizeof(metadata));
     metadata.op = metadata_op_frame_rate;
 
-    if (ioctl(fb_fd, MSMFB_METADATA_GET, &metadata) == -1) {
+    if (mdp_wrapper::getBackend()->ioctl(fb_fd, MSMFB_METADATA_GET,
+            &metadata) == -1) {
         ALOGE("%s:Error retrieving panel frame rate: %s", __FUNCTION__,
                                                       strerror(errno));
-        close(fb_fd);
+        mdp_wrapper::getBackend()->close(fb_fd);
         return -errno;
     }
 
@@ -118,10 +130,11 @@ static int openFramebufferDevice(hwc_context_t *ctx)
     float fps  = info.reserved[3] & 0xFF;
 #endif
 
-    if (ioctl(fb_fd, FBIOGET_FSCREENINFO, &finfo) == -1) {
+    if (mdp_wrapper::getBackend()->ioctl(fb_fd, FBIOGET_FSCREENINFO,
+            &finfo) == -1) {
         ALOGE("%s:Error in ioctl FBIOGET_FSCREENINFO: %s", __FUNCTION__,
                                                        strerror(errno));
-        close(fb_fd);
+        mdp_wrapper::getBackend()->close(fb_fd);
         return -errno;
     }
 
@@ -213,6 +226,16 @@ void initContext(hwc_context_t *ctx)
     ctx->vstate.fakevsync = false;
     ctx->mExtDispConfiguring = false;
     ctx->mBasePipeSetup = false;
+    ctx->mResetPerfStats = false;
+    ctx->mRefreshProps = 0;
+    ctx->mCablYuv = -1;
+    refreshProps(ctx, true);
+    ctx->mTrace = HwcTrace::create(ctx->mMDP.version,
+            ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres,
+            ctx->dpyAttr[HWC_DISPLAY_PRIMARY].yres,
+            ctx->dpyAttr[HWC_DISPLAY_PRIMARY].vsync_period);
+    ctx->mFrameTiming = FrameTiming::create(
+            ctx->dpyAttr[HWC_DISPLAY_PRIMARY].vsync_period);
 
     //Right now hwc starts the service but anybody could do it, or it could be
     //independent process as well.
@@ -251,6 +274,16 @@ void closeContext(hwc_context_t *ctx)
         ctx->mRotMgr = NULL;
     }
 
+    if(ctx->mTrace) {
+        delete ctx->mTrace;
+        ctx->mTrace = NULL;
+    }
+
+    if(ctx->mFrameTiming) {
+        delete ctx->mFrameTiming;
+        ctx->mFrameTiming = NULL;
+    }
+
     for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++) {
         if(ctx->mCopyBit[i]) {
             delete ctx->mCopyBit[i];
@@ -259,7 +292,8 @@ void closeContext(hwc_context_t *ctx)
     }
 
     if(ctx->dpyAttr[HWC_DISPLAY_PRIMARY].fd) {
-        close(ctx->dpyAttr[HWC_DISPLAY_PRIMARY].fd);
+        mdp_wrapper::getBackend()->close(
+                ctx->dpyAttr[HWC_DISPLAY_PRIMARY].fd);
         ctx->dpyAttr[HWC_DISPLAY_PRIMARY].fd = -1;
     }
 
@@ -390,13 +424,9 @@ void getActionSafePosition(hwc_context_t *ctx, int dpy, uint32_t& x,
     float asY = 0;
     float asW = fbWidth;
     float asH= fbHeight;
-    char value[PROPERTY_VALUE_MAX];
-
     // Apply action safe parameters
-    property_get("hw.actionsafe.width", value, "0");
-    int asWidthRatio = atoi(value);
-    property_get("hw.actionsafe.height", value, "0");
-    int asHeightRatio = atoi(value);
+    int asWidthRatio = ctx->mProps.actionSafeWidth;
+    int asHeightRatio = ctx->mProps.actionSafeHeight;
     // based on the action safe ratio, get the Action safe rectangle
     asW = fbWidth * (1.0f -  asWidthRatio / 100.0f);
     asH = fbHeight * (1.0f -  asHeightRatio / 100.0f);
@@ -458,6 +488,83 @@ bool isAlphaPresent(hwc_layer_1_t const* layer) {
     return false;
 }
 
+//Rotator pre-downscale configureLowRes will use for a YUV layer
+static int getLayerRotDownscale(hwc_context_t *ctx,
+        hwc_layer_1_t const* layer, const int& mdpFormat) {
+    if(ctx->mMDP.version < qdutils::MDP_V4_2 ||
+            ctx->mMDP.version >= qdutils::MDSS_V5)
+        return 0;
+    hwc_rect_t crop = layer->sourceCrop;
+    hwc_rect_t dst = layer->displayFrame;
+    int srcW = crop.right - crop.left;
+    int srcH = crop.bottom - crop.top;
+    //Compare like axes, the rotator output is what the MDP scales
+    if(layer->transform & HWC_TRANSFORM_ROT_90)
+        swap(srcW, srcH);
+    return getDownscaleFactor(srcW, srcH,
+            dst.right - dst.left,
+            dst.bottom - dst.top,
+            mdpFormat, (layer->transform & HWC_TRANSFORM_ROT_90));
+}
+
+// Fix alignments the rotator needs for TILED format
+static inline void alignRotSource(Whf& whf) {
+    if(whf.format == MDP_Y_CRCB_H2V2_TILE ||
+            whf.format == MDP_Y_CBCR_H2V2_TILE) {
+        whf.w = utils::alignup(whf.w, 64);
+        whf.h = utils::alignup(whf.h, 32);
+    }
+}
+
+//Queues a rotator session for a YUV layer that will need one, the way
+//configureLowRes would configure it
+static void prewarmRotator(hwc_context_t *ctx, hwc_layer_1_t const* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    Whf whf(hnd->width, hnd->height,
+            getMdpFormat(hnd->format), hnd->size);
+    int downscale = getLayerRotDownscale(ctx, layer, whf.format);
+    if(!(layer->transform & HWC_TRANSFORM_ROT_90) && !downscale)
+        return;
+
+    eMdpFlags mdpFlags = OV_MDP_FLAGS_NONE;
+    if(isSecureBuffer(hnd))
+        ovutils::setMdpFlags(mdpFlags, OV_MDP_SECURE_OVERLAY_SESSION);
+    alignRotSource(whf);
+    ctx->mRotMgr->prewarm(whf, mdpFlags,
+            static_cast<eTransform>(layer->transform), downscale);
+}
+
+void refreshProps(hwc_context_t *ctx, bool force) {
+    HwcProps& props = ctx->mProps;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    //Taken and cleared in one step, a request that comes in while the
+    //properties are read is kept for the next call
+    const bool requested = android_atomic_and(0, &ctx->mRefreshProps) != 0;
+    if(!force && !requested &&
+            ns2ms(now - props.refreshTime) < HwcProps::REFRESH_MS)
+        return;
+
+    char property[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.swapinterval", property, "1");
+    props.swapInterval = atoi(property);
+    property_get("hw.actionsafe.width", property, "0");
+    props.actionSafeWidth = atoi(property);
+    property_get("hw.actionsafe.height", property, "0");
+    props.actionSafeHeight = atoi(property);
+
+    //Only an explicit refresh picks up a value changed behind our back
+    if(force || requested) {
+        props.cablSupported = false;
+        if(property_get("hw.cabl.yuv", property, NULL) > 0) {
+            props.cablSupported = true;
+            ctx->mCablYuv = atoi(property);
+        }
+    }
+
+    props.refreshTime = now;
+    props.refreshCount++;
+}
+
 void setListStats(hwc_context_t *ctx,
         const hwc_display_contents_1_t *list, int dpy) {
 
@@ -467,7 +574,6 @@ void setListStats(hwc_context_t *ctx,
     ctx->listStats[dpy].needsAlphaScale = false;
     ctx->listStats[dpy].preMultipliedAlpha = false;
     ctx->listStats[dpy].yuvCount = 0;
-    char property[PROPERTY_VALUE_MAX];
 
     for (size_t i = 0; i < list->numHwLayers; i++) {
         hwc_layer_1_t const* layer = &list->hwLayers[i];
@@ -495,19 +601,36 @@ void setListStats(hwc_context_t *ctx,
         if(!ctx->listStats[dpy].needsAlphaScale)
             ctx->listStats[dpy].needsAlphaScale = isAlphaScaled(layer);
     }
-    if(ctx->listStats[dpy].yuvCount > 0) {
-        if (property_get("hw.cabl.yuv", property, NULL) > 0) {
-            if (atoi(property) != 1) {
-                property_set("hw.cabl.yuv", "1");
-            }
-        }
-    } else {
-        if (property_get("hw.cabl.yuv", property, NULL) > 0) {
-            if (atoi(property) != 0) {
-                property_set("hw.cabl.yuv", "0");
-            }
+
+    //A video appeared or changed geometry, get its rotator session going
+    //while this and the next frames are composed
+    uint32_t yuvSignature = 0;
+    for(int i = 0; i < ctx->listStats[dpy].yuvCount; i++) {
+        hwc_layer_1_t const* layer =
+                &list->hwLayers[ctx->listStats[dpy].yuvIndices[i]];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        const hwc_rect_t& dst = layer->displayFrame;
+        uint32_t v[] = { (uint32_t)hnd->width, (uint32_t)hnd->height,
+                (uint32_t)hnd->format, layer->transform,
+                (uint32_t)(dst.right - dst.left),
+                (uint32_t)(dst.bottom - dst.top) };
+        for(size_t j = 0; j < sizeof(v) / sizeof(v[0]); j++)
+            yuvSignature = yuvSignature * 31 + v[j];
+    }
+    if(yuvSignature != ctx->mYuvSignature[dpy]) {
+        ctx->mYuvSignature[dpy] = yuvSignature;
+        for(int i = 0; ctx->mRotMgr && i < ctx->listStats[dpy].yuvCount;
+                i++) {
+            prewarmRotator(ctx,
+                    &list->hwLayers[ctx->listStats[dpy].yuvIndices[i]]);
         }
     }
+    //Tell CABL only when video comes or goes, a property_set wakes init
+    int cablYuv = (ctx->listStats[dpy].yuvCount > 0) ? 1 : 0;
+    if(ctx->mProps.cablSupported && cablYuv != ctx->mCablYuv) {
+        property_set("hw.cabl.yuv", cablYuv ? "1" : "0");
+        ctx->mCablYuv = cablYuv;
+    }
 }
 
 
@@ -710,15 +833,50 @@ bool isExternalActive(hwc_context_t* ctx) {
     return ctx->dpyAttr[HWC_DISPLAY_EXTERNAL].isActive;
 }
 
-void closeAcquireFds(hwc_display_contents_1_t* list) {
+int closeAcquireFds(hwc_display_contents_1_t* list) {
+    int closed = 0;
     for(uint32_t i = 0; list && i < list->numHwLayers; i++) {
         //Close the acquireFenceFds
         //HWC_FRAMEBUFFER are -1 already by SF, rest we close.
         if(list->hwLayers[i].acquireFenceFd >= 0) {
             close(list->hwLayers[i].acquireFenceFd);
             list->hwLayers[i].acquireFenceFd = -1;
+            closed++;
         }
     }
+    return closed;
+}
+
+//Folds the fences the driver can not take into the first one, in place.
+//A fence sync_merge fails on is kept as is after it, never waited on
+//here. Returns the number of fences left. mergedFd is the merged fence
+//the caller has to close, -1 while every fence left is borrowed.
+static int mergeAcquireFds(int *fds, int count, int& mergedFd,
+        FenceStats::Count& fc) {
+    int kept = 0;
+    mergedFd = -1;
+    for(int i = 0; i < count; i++) {
+        if(fds[i] < 0)
+            continue;
+        if(!kept) {
+            fds[kept++] = fds[i];
+            continue;
+        }
+        int fence = sync_merge("hwc_acquire", fds[0], fds[i]);
+        fc.merge++;
+        if(fence < 0) {
+            ALOGE("%s: sync_merge failed, err=%s", __FUNCTION__,
+                    strerror(errno));
+            fds[kept++] = fds[i];
+            continue;
+        }
+        if(mergedFd >= 0) {
+            close(mergedFd);
+            fc.close++;
+        }
+        fds[0] = mergedFd = fence;
+    }
+    return kept;
 }
 
 int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
@@ -726,12 +884,15 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     int ret = 0;
 
     int acquireFd[MAX_NUM_LAYERS];
+    //Rotator release fence of a rotated layer, what the MDP waits on
+    int rotFenceFd[MAX_NUM_LAYERS];
     int count = 0;
     int releaseFd = -1;
     int fbFd = -1;
-    int rotFd = -1;
+    int mergedFd = -1;
     bool swapzero = false;
     int mdpVersion = qdutils::MDPVersion::getInstance().getMDPVersion();
+    FenceStats::Count& fc = ctx->mFenceStats[dpy].cur;
 
     struct mdp_buf_sync data;
     memset(&data, 0, sizeof(data));
@@ -742,11 +903,11 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     data.acq_fen_fd = acquireFd;
     data.rel_fen_fd = &releaseFd;
 
-    char property[PROPERTY_VALUE_MAX];
-    if(property_get("debug.egl.swapinterval", property, "1") > 0) {
-        if(atoi(property) == 0)
-            swapzero = true;
-    }
+    if(ctx->mProps.swapInterval == 0)
+        swapzero = true;
+
+    for(uint32_t i = 0; i < list->numHwLayers && i < MAX_NUM_LAYERS; i++)
+        rotFenceFd[i] = -1;
 
     //Send acquireFenceFds to rotator
     if(mdpVersion < qdutils::MDSS_V5) {
@@ -754,33 +915,41 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
         int rotFd = ctx->mRotMgr->getRotDevFd();
         struct msm_rotator_buf_sync rotData;
 
+        //One sync per session, the rotator takes no fence arrays
         for(uint32_t i = 0; i < ctx->mLayerRotMap[dpy]->getCount(); i++) {
             memset(&rotData, 0, sizeof(rotData));
-            int& acquireFenceFd =
-                ctx->mLayerRotMap[dpy]->getLayer(i)->acquireFenceFd;
-            rotData.acq_fen_fd = acquireFenceFd;
+            hwc_layer_1_t *layer = ctx->mLayerRotMap[dpy]->getLayer(i);
+            rotData.acq_fen_fd = layer->acquireFenceFd;
             rotData.session_id = ctx->mLayerRotMap[dpy]->getRot(i)->getSessId();
-            ioctl(rotFd, MSM_ROTATOR_IOCTL_BUFFER_SYNC, &rotData);
-            close(acquireFenceFd);
-             //For MDP to wait on.
-            acquireFenceFd = dup(rotData.rel_fen_fd);
+            mdp_wrapper::getBackend()->ioctl(rotFd,
+                    MSM_ROTATOR_IOCTL_BUFFER_SYNC, &rotData);
+            fc.ioctl++;
+            //For MDP to wait on. The layer keeps its acquire fence, closed
+            //with the others once set is done, and the rotator's fence is
+            //handed to MDP as is rather than dup'ed over it.
+            uint32_t index = layer - list->hwLayers;
+            if(index < list->numHwLayers && index < MAX_NUM_LAYERS)
+                rotFenceFd[index] = rotData.rel_fen_fd;
             //A buffer is free to be used by producer as soon as its copied to
             //rotator.
-            ctx->mLayerRotMap[dpy]->getLayer(i)->releaseFenceFd =
-                    rotData.rel_fen_fd;
+            layer->releaseFenceFd = rotData.rel_fen_fd;
         }
     } else {
         //TODO B-family
     }
 
     //Accumulate acquireFenceFds for MDP
-    for(uint32_t i = 0; i < list->numHwLayers; i++) {
+    for(uint32_t i = 0; i < list->numHwLayers && count < MAX_NUM_LAYERS;
+            i++) {
+        int acquireFenceFd = list->hwLayers[i].acquireFenceFd;
+        if(i < MAX_NUM_LAYERS && rotFenceFd[i] >= 0)
+            acquireFenceFd = rotFenceFd[i];
         if(list->hwLayers[i].compositionType == HWC_OVERLAY &&
-                        list->hwLayers[i].acquireFenceFd >= 0) {
+                        acquireFenceFd >= 0) {
             if(UNLIKELY(swapzero))
                 acquireFd[count++] = -1;
             else
-                acquireFd[count++] = list->hwLayers[i].acquireFenceFd;
+                acquireFd[count++] = acquireFenceFd;
         }
         if(list->hwLayers[i].compositionType == HWC_FRAMEBUFFER_TARGET) {
             if(UNLIKELY(swapzero))
@@ -791,27 +960,53 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
                 // Buffer sync IOCTL should be async when using c2d fence is
                 // used
                 data.flags &= ~MDP_BUF_SYNC_FLAG_WAIT;
-            } else if(list->hwLayers[i].acquireFenceFd >= 0)
-                acquireFd[count++] = list->hwLayers[i].acquireFenceFd;
+            } else if(acquireFenceFd >= 0)
+                acquireFd[count++] = acquireFenceFd;
         }
     }
 
+    //The driver drops the frame if handed more fences than it takes. If
+    //a merge fails the extra fences still go to it rather than blocking
+    //the composition thread on them.
+    if(!swapzero && count > MDP_MAX_FENCE_FD) {
+        count = MDP_MAX_FENCE_FD - 1 +
+                mergeAcquireFds(acquireFd + MDP_MAX_FENCE_FD - 1,
+                count - MDP_MAX_FENCE_FD + 1, mergedFd, fc);
+        if(count > MDP_MAX_FENCE_FD)
+            ALOGE("%s: %d acquire fences left unmerged", __FUNCTION__,
+                    count);
+    }
+
     data.acq_fen_fd_cnt = count;
     fbFd = ctx->dpyAttr[dpy].fd;
 
     //Waits for acquire fences, returns a release fence
     if(LIKELY(!swapzero)) {
         uint64_t start = systemTime();
-        ret = ioctl(fbFd, MSMFB_BUFFER_SYNC, &data);
+        ret = mdp_wrapper::getBackend()->ioctl(fbFd, MSMFB_BUFFER_SYNC,
+                &data);
+        fc.ioctl++;
+        if(ctx->mFrameTiming) {
+            ctx->mFrameTiming->stamp(dpy, FrameTiming::BUFFER_SYNC_DONE);
+            fc.dup += ctx->mFrameTiming->setReleaseFence(dpy, releaseFd);
+        }
         ALOGD_IF(HWC_UTILS_DEBUG, "%s: time taken for MSMFB_BUFFER_SYNC IOCTL = %d",
                             __FUNCTION__, (size_t) ns2ms(systemTime() - start));
     }
 
+    if(mergedFd >= 0) {
+        close(mergedFd);
+        fc.close++;
+    }
+
     if(ret < 0) {
         ALOGE("ioctl MSMFB_BUFFER_SYNC failed, err=%s",
                 strerror(errno));
     }
 
+    //SurfaceFlinger closes every layer's release fence on its own, so each
+    //layer needs an fd of its own. The retire fence takes the one the sync
+    //returned.
     for(uint32_t i = 0; i < list->numHwLayers; i++) {
         if(list->hwLayers[i].compositionType == HWC_OVERLAY ||
            list->hwLayers[i].compositionType == HWC_FRAMEBUFFER_TARGET) {
@@ -821,22 +1016,26 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
             } else if(list->hwLayers[i].releaseFenceFd < 0) {
                 //If rotator has not already populated this field.
                 list->hwLayers[i].releaseFenceFd = dup(releaseFd);
+                if(list->hwLayers[i].releaseFenceFd >= 0)
+                    fc.dup++;
             }
         }
     }
 
     if(fd >= 0) {
         close(fd);
+        fc.close++;
         fd = -1;
     }
 
-    if (ctx->mCopyBit[dpy])
-        ctx->mCopyBit[dpy]->setReleaseFd(releaseFd);
+    if (ctx->mCopyBit[dpy]) {
+        fc.dup += ctx->mCopyBit[dpy]->setReleaseFd(releaseFd);
+    }
 
     //A-family
     if(mdpVersion < qdutils::MDSS_V5) {
         //Signals when MDP finishes reading rotator buffers.
-        ctx->mLayerRotMap[dpy]->setReleaseFd(releaseFd);
+        fc.dup += ctx->mLayerRotMap[dpy]->setReleaseFd(releaseFd);
     }
 
     if(UNLIKELY(swapzero)){
@@ -909,12 +1108,7 @@ void setMdpFlags(hwc_layer_1_t *layer,
 static inline int configRotator(Rotator *rot, Whf& whf,
         const eMdpFlags& mdpFlags, const eTransform& orient,
         const int& downscale) {
-    // Fix alignments for TILED format
-    if(whf.format == MDP_Y_CRCB_H2V2_TILE ||
-                            whf.format == MDP_Y_CBCR_H2V2_TILE) {
-        whf.w =  utils::alignup(whf.w, 64);
-        whf.h = utils::alignup(whf.h, 32);
-    }
+    alignRotSource(whf);
     rot->setSource(whf);
     rot->setFlags(mdpFlags);
     rot->setTransform(orient);
@@ -948,14 +1142,16 @@ bool setupBasePipe(hwc_context_t *ctx) {
     ovInfo.dst_rect.h = fb_height;
     ovInfo.id = MSMFB_NEW_REQUEST;
 
-    if (ioctl(fb_fd, MSMFB_OVERLAY_SET, &ovInfo) < 0) {
+    if (mdp_wrapper::getBackend()->ioctl(fb_fd, MSMFB_OVERLAY_SET,
+            &ovInfo) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_SET err=%s",
                 strerror(errno));
         return false;
     }
 
     ovData.id = ovInfo.id;
-    if (ioctl(fb_fd, MSMFB_OVERLAY_PLAY, &ovData) < 0) {
+    if (mdp_wrapper::getBackend()->ioctl(fb_fd, MSMFB_OVERLAY_PLAY,
+            &ovData) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_PLAY err=%s",
                 strerror(errno));
         return false;
@@ -1021,13 +1217,8 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
     Whf whf(hnd->width, hnd->height,
             getMdpFormat(hnd->format), hnd->size);
 
-    if(isYuvBuffer(hnd) && ctx->mMDP.version >= qdutils::MDP_V4_2 &&
-                ctx->mMDP.version < qdutils::MDSS_V5) {
-        downscale = getDownscaleFactor(
-                crop.right - crop.left,
-                crop.bottom - crop.top,
-                dst.right - dst.left,
-                dst.bottom - dst.top);
+    if(isYuvBuffer(hnd)) {
+        downscale = getLayerRotDownscale(ctx, layer, whf.format);
         if(downscale) {
             rotFlags = ROT_DOWNSCALE_ENABLED;
         }
@@ -1038,7 +1229,9 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
 
     if(isYuvBuffer(hnd) && //if 90 component or downscale, use rot
             ((transform & HWC_TRANSFORM_ROT_90) || downscale)) {
-        *rot = ctx->mRotMgr->getNext();
+        //A session prewarmed for this exact config is adopted if there is one
+        alignRotSource(whf);
+        *rot = ctx->mRotMgr->getNext(whf, mdpFlags, orient, downscale);
         if(*rot == NULL) return -1;
         //Configure rotator for pre-rotation
         if(configRotator(*rot, whf, mdpFlags, orient, downscale) < 0)
@@ -1053,7 +1246,8 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
     orient = OVERLAY_TRANSFORM_0;
     transform = 0;
 
-    PipeArgs parg(mdpFlags, whf, z, isFg, static_cast<eRotFlags>(rotFlags));
+    PipeArgs parg(mdpFlags, whf, z, isFg, static_cast<eRotFlags>(rotFlags),
+            downscale);
     if(configMdp(ctx->mOverlay, parg, orient, crop, dst, dest) < 0) {
         ALOGE("%s: commit failed for low res panel", __FUNCTION__);
         return -1;
@@ -1087,7 +1281,8 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
     trimLayer(ctx, dpy, transform, crop, dst);
 
     if(isYuvBuffer(hnd) && (transform & HWC_TRANSFORM_ROT_90)) {
-        (*rot) = ctx->mRotMgr->getNext();
+        alignRotSource(whf);
+        (*rot) = ctx->mRotMgr->getNext(whf, mdpFlagsL, orient, downscale);
         if((*rot) == NULL) return -1;
         //Configure rotator for pre-rotation
         if(configRotator(*rot, whf, mdpFlagsL, orient, downscale) < 0)
@@ -1169,72 +1364,6 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
     return 0;
 }
 
-void LayerCache::resetLayerCache(int num) {
-    for(uint32_t i = 0; i < MAX_NUM_LAYERS; i++) {
-        hnd[i] = NULL;
-    }
-    numHwLayers = num;
-}
-
-void LayerCache::updateLayerCache(hwc_display_contents_1_t* list) {
-
-    int numFbLayers = 0;
-    int numCacheableLayers = 0;
-
-    canUseLayerCache = false;
-    //Bail if geometry changed or num of layers changed
-    if(list->flags & HWC_GEOMETRY_CHANGED ||
-       list->numHwLayers != numHwLayers ) {
-        resetLayerCache(list->numHwLayers);
-        return;
-    }
-
-    for(uint32_t i = 0; i < list->numHwLayers; i++) {
-        //Bail on skip layers
-        if(list->hwLayers[i].flags & HWC_SKIP_LAYER) {
-            resetLayerCache(list->numHwLayers);
-            return;
-        }
-
-        if(list->hwLayers[i].compositionType == HWC_FRAMEBUFFER) {
-            numFbLayers++;
-            if(hnd[i] == NULL) {
-                hnd[i] = list->hwLayers[i].handle;
-            } else if (hnd[i] ==
-                       list->hwLayers[i].handle) {
-                numCacheableLayers++;
-            } else {
-                hnd[i] = NULL;
-                return;
-            }
-        } else {
-            hnd[i] = NULL;
-        }
-    }
-    if(numFbLayers == numCacheableLayers)
-        canUseLayerCache = true;
-
-    //XXX: The marking part is separate, if MDP comp wants
-    // to use it in the future. Right now getting MDP comp
-    // to use this is more trouble than it is worth.
-    markCachedLayersAsOverlay(list);
-}
-
-void LayerCache::markCachedLayersAsOverlay(hwc_display_contents_1_t* list) {
-    //This optimization only works if ALL the layer handles
-    //that were on the framebuffer didn't change.
-    if(canUseLayerCache){
-        for(uint32_t i = 0; i < list->numHwLayers; i++) {
-            if (list->hwLayers[i].handle &&
-                list->hwLayers[i].handle == hnd[i] &&
-                list->hwLayers[i].compositionType != HWC_FRAMEBUFFER_TARGET)
-            {
-                list->hwLayers[i].compositionType = HWC_OVERLAY;
-            }
-        }
-    }
-}
-
 void LayerRotMap::add(hwc_layer_1_t* layer, Rotator *rot) {
     if(mCount >= MAX_SESS) return;
     mLayer[mCount] = layer;
@@ -1250,10 +1379,15 @@ void LayerRotMap::reset() {
     mCount = 0;
 }
 
-void LayerRotMap::setReleaseFd(const int& fence) {
+uint32_t LayerRotMap::setReleaseFd(const int& fence) {
+    uint32_t dups = 0;
     for(uint32_t i = 0; i < mCount; i++) {
-        mRot[i]->setReleaseFd(dup(fence));
+        int fd = dup(fence);
+        if(fd >= 0)
+            dups++;
+        mRot[i]->setReleaseFd(fd);
     }
+    return dups;
 }
 
 };//namespace qhwc
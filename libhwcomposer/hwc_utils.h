@@ -30,8 +30,11 @@
 #include <gr.h>
 #include <gralloc_priv.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include "qdMetaData.h"
 #include <overlayUtils.h>
+#include <mdpBackend.h>
+#include "hwc_layer_cache.h"
 
 #define ALIGN_TO(x, align)     (((x) + ((align)-1)) & ~((align)-1))
 #define LIKELY( exp )       (__builtin_expect( (exp) != 0, true  ))
@@ -47,7 +50,6 @@ class HWComposerService;
 
 namespace overlay {
 class Overlay;
-#define MAX_NUM_LAYERS 32 //includes fb layer
 #define MAX_DISPLAY_DIM 2048
 
 //Fwrd decls
@@ -70,6 +72,8 @@ class IFBUpdate;
 class IVideoOverlay;
 class MDPComp;
 class CopyBit;
+class HwcTrace;
+class FrameTiming;
 
 struct MDPInfo {
     int version;
@@ -128,6 +132,64 @@ struct ListStats {
     bool preMultipliedAlpha;
 };
 
+//System properties the per-frame paths use, a snapshot taken by
+//refreshProps rather than a property_get on every use
+struct HwcProps {
+    enum { REFRESH_MS = 1000 };
+    int swapInterval; //debug.egl.swapinterval
+    int actionSafeWidth; //hw.actionsafe.width, percent
+    int actionSafeHeight; //hw.actionsafe.height, percent
+    bool cablSupported; //hw.cabl.yuv exists
+    nsecs_t refreshTime;
+    uint32_t refreshCount;
+};
+
+//Wall time of the set path, in ns
+struct SetTiming {
+    nsecs_t last;
+    nsecs_t max;
+    nsecs_t total;
+    uint32_t count;
+    void add(nsecs_t t) {
+        last = t;
+        if(t > max)
+            max = t;
+        total += t;
+        count++;
+    }
+    nsecs_t avg() const { return count ? total / count : 0; }
+};
+
+//Fence syscalls of a display's set path, hwc_sync and closeAcquireFds
+struct FenceStats {
+    struct Count {
+        uint32_t ioctl; //rotator and MDP buffer syncs
+        //Every fd made from the release fence, as reported back by the
+        //layers, frame timing, copybit and rotators that keep one
+        uint32_t dup;
+        uint32_t close;
+        uint32_t merge;
+        uint32_t total() const { return ioctl + dup + close + merge; }
+    };
+    Count cur;
+    Count last;
+    uint32_t max;
+    uint64_t total;
+    uint32_t frames;
+    void endFrame() {
+        //Inactive displays make no syscalls, and are not frames
+        if(!cur.total())
+            return;
+        last = cur;
+        if(cur.total() > max)
+            max = cur.total();
+        total += cur.total();
+        frames++;
+        memset(&cur, 0, sizeof(cur));
+    }
+    uint32_t avg() const { return frames ? (uint32_t)(total / frames) : 0; }
+};
+
 struct LayerProp {
     uint32_t mFlags; //qcom specific layer flags
     LayerProp():mFlags(0) {};
@@ -139,26 +201,6 @@ enum {
     HWC_COPYBIT = 0x00000002,
 };
 
-class LayerCache {
-    public:
-    LayerCache() {
-        canUseLayerCache = false;
-        numHwLayers = 0;
-        for(uint32_t i = 0; i < MAX_NUM_LAYERS; i++) {
-            hnd[i] = NULL;
-        }
-    }
-    //LayerCache optimization
-    void updateLayerCache(hwc_display_contents_1_t* list);
-    void resetLayerCache(int num);
-    void markCachedLayersAsOverlay(hwc_display_contents_1_t* list);
-    private:
-    uint32_t numHwLayers;
-    bool canUseLayerCache;
-    buffer_handle_t hnd[MAX_NUM_LAYERS];
-
-};
-
 class LayerRotMap {
 public:
     LayerRotMap() { reset(); }
@@ -168,7 +210,8 @@ public:
     uint32_t getCount() const;
     hwc_layer_1_t* getLayer(uint32_t index) const;
     overlay::Rotator* getRot(uint32_t index) const;
-    void setReleaseFd(const int& fence);
+    //Hands each rotator a dup of the fence, returns the number of fds dup'ed
+    uint32_t setReleaseFd(const int& fence);
 private:
     hwc_layer_1_t* mLayer[MAX_SESS];
     overlay::Rotator* mRot[MAX_SESS];
@@ -222,12 +265,16 @@ int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable);
 //Helper function to dump logs
 void dumpsys_log(android::String8& buf, const char* fmt, ...);
 
+/* Re-reads the property snapshot when it is older than REFRESH_MS, when a
+ * refresh was requested over binder, or when forced */
+void refreshProps(hwc_context_t *ctx, bool force);
+
 /* Calculates the destination position based on the action safe rectangle */
 void getActionSafePosition(hwc_context_t *ctx, int dpy, uint32_t& x,
                                         uint32_t& y, uint32_t& w, uint32_t& h);
 
-//Close acquireFenceFds of all layers of incoming list
-void closeAcquireFds(hwc_display_contents_1_t* list);
+//Close acquireFenceFds of all layers of incoming list, returns the count
+int closeAcquireFds(hwc_display_contents_1_t* list);
 
 //Sync point impl.
 int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
@@ -317,7 +364,8 @@ static inline int openFb(int dpy) {
     const char *devtmpl = "/dev/graphics/fb%u";
     char name[64] = {0};
     snprintf(name, 64, devtmpl, dpy);
-    fd = open(name, O_RDWR);
+    //Through the MDP backend, so a fake driver can stand in for fbN
+    fd = overlay::mdp_wrapper::getBackend()->open(name, O_RDWR);
     return fd;
 }
 
@@ -337,6 +385,21 @@ struct vsync_state {
     bool fakevsync;
 };
 
+//Runs the non primary displays' set path while primary commits.
+//The job is posted by hwc_set, which waits for it before returning.
+struct set_worker {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond; //job posted or exit
+    pthread_cond_t  done; //job finished
+    pthread_t thread;
+    bool enabled; //debug.hwc.parallelset, read once at init
+    bool exit;
+    bool pending;
+    size_t numDisplays;
+    hwc_display_contents_1_t** displays;
+    int ret;
+};
+
 // -----------------------------------------------------------------------------
 // HWC context
 // This structure contains overall state
@@ -415,6 +478,26 @@ struct hwc_context_t {
     bool mNeedsRotator;
     //Check if base pipe is set up
     bool mBasePipeSetup;
+    //Hash of the YUV layer geometry of the last frame, rotator prewarm
+    uint32_t mYuvSignature[HWC_NUM_DISPLAY_TYPES];
+    //Overlay and rotator counters to be cleared on the next prepare
+    volatile bool mResetPerfStats;
+    //Property snapshot, and a refresh requested for the next prepare
+    qhwc::HwcProps mProps;
+    //Set by QClient, consumed atomically by refreshProps
+    volatile int32_t mRefreshProps;
+    //Last value written to hw.cabl.yuv, -1 before the first write
+    int mCablYuv;
+    //Parallel set, and the set latency per display and for the whole call
+    struct set_worker mSetWorker;
+    qhwc::SetTiming mSetTiming[HWC_NUM_DISPLAY_TYPES];
+    qhwc::SetTiming mSetTotal;
+    //Fence syscalls per frame and display
+    qhwc::FenceStats mFenceStats[HWC_NUM_DISPLAY_TYPES];
+    //Layer list capture, NULL unless debug.hwc.capture is set
+    qhwc::HwcTrace *mTrace;
+    //Per frame timeline, NULL unless debug.hwc.frametiming is set
+    qhwc::FrameTiming *mFrameTiming;
 };
 
 namespace qhwc {
@@ -466,6 +466,8 @@ bool VideoOverlayLowRes::draw(hwc_context_t *ctx,
     Rotator *rot = mRot;
 
     if(rot) {
+        rot->setSrcBuffer(hnd,
+                !ctx->mLayerCache[mDpy]->isStable(yuvIndex));
         if(!rot->queueBuffer(fd, offset))
             return false;
         fd = rot->getDstMemId();
@@ -643,6 +645,8 @@ bool VideoOverlayHighRes::draw(hwc_context_t *ctx,
     Rotator *rot = mRot;
 
     if(rot) {
+        rot->setSrcBuffer(hnd,
+                !ctx->mLayerCache[mDpy]->isStable(yuvIndex));
         if(!rot->queueBuffer(fd, offset))
             return false;
         fd = rot->getDstMemId();
@@ -15,7 +15,8 @@ LOCAL_SRC_FILES := \
       overlayUtils.cpp \
       overlayMdp.cpp \
       overlayRotator.cpp
-LOCAL_SHARED_LIBRARIES        := $(common_libs) libqdutils libmemalloc libsync
+LOCAL_SHARED_LIBRARIES        := $(common_libs) libqdutils libqdbwmodel libmemalloc \
+                                 libsync
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdoverlay\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
 LOCAL_SRC_FILES := \
@@ -25,6 +26,24 @@ LOCAL_SRC_FILES := \
       overlayRotator.cpp \
       overlayMdpRot.cpp \
       overlayMdssRot.cpp \
+      mdpBackend.cpp \
+      mdpFakeBackend.cpp \
       pipes/overlayGenPipe.cpp
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Checks the fake and the recording backend
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := mdp_backend_test
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(common_libs) libqdutils
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdoverlay_test\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES := \
+      mdp_backend_test.cpp \
+      mdpBackend.cpp \
+      mdpFakeBackend.cpp
+
+include $(BUILD_EXECUTABLE)
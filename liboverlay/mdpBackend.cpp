@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/msm_mdp.h>
+#include <linux/msm_rotator.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include "mdpBackend.h"
+
+namespace overlay {
+
+namespace mdp_wrapper {
+
+using android::Mutex;
+
+//------------------ KernelMdpBackend ------------------------
+
+int KernelMdpBackend::open(const char* path, int flags) {
+    return ::open(path, flags, 0);
+}
+
+int KernelMdpBackend::close(int fd) {
+    return ::close(fd);
+}
+
+int KernelMdpBackend::ioctl(int fd, unsigned long request, void *arg) {
+    return ::ioctl(fd, request, arg);
+}
+
+//------------------ RecordingMdpBackend ---------------------
+
+RecordingMdpBackend::RecordingMdpBackend(IMdpBackend *next) : mNext(next) {
+    reset();
+}
+
+void RecordingMdpBackend::reset() {
+    Mutex::Autolock lock(mLock);
+    memset(mRecords, 0, sizeof(mRecords));
+    mTotal = 0;
+}
+
+void RecordingMdpBackend::record(int op, int fd, unsigned long request,
+        int ret, nsecs_t start) {
+    //Everything but the copy into the ring stays outside the lock
+    int err = (ret < 0) ? errno : 0;
+    uint32_t durUs = (uint32_t)ns2us(systemTime() - start);
+    Mutex::Autolock lock(mLock);
+    Record& r = mRecords[mTotal % MAX_RECORDS];
+    r.start = start;
+    r.durUs = durUs;
+    r.op = op;
+    r.fd = fd;
+    r.request = request;
+    r.ret = ret;
+    r.err = err;
+    mTotal++;
+}
+
+int RecordingMdpBackend::open(const char* path, int flags) {
+    nsecs_t start = systemTime();
+    int ret = mNext->open(path, flags);
+    record(OP_OPEN, ret, 0, ret, start);
+    return ret;
+}
+
+int RecordingMdpBackend::close(int fd) {
+    nsecs_t start = systemTime();
+    int ret = mNext->close(fd);
+    record(OP_CLOSE, fd, 0, ret, start);
+    return ret;
+}
+
+int RecordingMdpBackend::ioctl(int fd, unsigned long request, void *arg) {
+    nsecs_t start = systemTime();
+    int ret = mNext->ioctl(fd, request, arg);
+    //record() reads errno, keep it intact for the caller too
+    int err = errno;
+    record(OP_IOCTL, fd, request, ret, start);
+    errno = err;
+    return ret;
+}
+
+uint32_t RecordingMdpBackend::getTotal() const {
+    Mutex::Autolock lock(mLock);
+    return mTotal;
+}
+
+size_t RecordingMdpBackend::getRecords(Record *out, size_t max) const {
+    Mutex::Autolock lock(mLock);
+    size_t count = mTotal;
+    if(count > MAX_RECORDS)
+        count = MAX_RECORDS;
+    if(count > max)
+        count = max;
+    //oldest of the requested tail first
+    uint32_t first = mTotal - count;
+    for(size_t i = 0; i < count; i++) {
+        out[i] = mRecords[(first + i) % MAX_RECORDS];
+    }
+    return count;
+}
+
+void RecordingMdpBackend::getDump(char *buf, size_t len) const {
+    enum { DUMP_RECORDS = 32 };
+    Record recs[DUMP_RECORDS];
+    size_t count = getRecords(recs, DUMP_RECORDS);
+    char str[128] = {'\0'};
+    snprintf(str, 128, "MDP backend calls recorded: %u, last %zu:\n",
+            getTotal(), count);
+    strncat(buf, str, len - strlen(buf) - 1);
+    for(size_t i = 0; i < count; i++) {
+        const Record& r = recs[i];
+        const char *what = (r.op == OP_OPEN) ? "open" :
+                (r.op == OP_CLOSE) ? "close" : getRequestStr(r.request);
+        snprintf(str, 128, "  %+8lldus fd=%-3d %-26s ret=%d err=%d "
+                "took=%uus\n",
+                (long long)ns2us(r.start - recs[0].start), r.fd, what,
+                r.ret, r.err, r.durUs);
+        strncat(buf, str, len - strlen(buf) - 1);
+    }
+}
+
+//------------------ Backend selection -----------------------
+
+static KernelMdpBackend sKernelBackend;
+static IMdpBackend *sDefaultBackend = NULL;
+static IMdpBackend *sBackend = NULL;
+
+static IMdpBackend* getDefaultBackend() {
+    if(sDefaultBackend == NULL) {
+        IMdpBackend *backend = &sKernelBackend;
+        char property[PROPERTY_VALUE_MAX];
+        if(property_get("debug.overlay.record_ioctls", property, NULL) > 0 &&
+                atoi(property) > 0) {
+            backend = new RecordingMdpBackend(backend);
+        }
+        ALOGD("%s: using %s backend", __FUNCTION__, backend->getName());
+        sDefaultBackend = backend;
+    }
+    return sDefaultBackend;
+}
+
+IMdpBackend* getBackend() {
+    if(sBackend == NULL) {
+        sBackend = getDefaultBackend();
+    }
+    return sBackend;
+}
+
+IMdpBackend* setBackend(IMdpBackend *backend) {
+    IMdpBackend *prev = getBackend();
+    sBackend = backend ? backend : getDefaultBackend();
+    return prev;
+}
+
+const char* getRequestStr(unsigned long request) {
+    switch(request) {
+    case FBIOGET_FSCREENINFO:      return "FBIOGET_FSCREENINFO";
+    case FBIOGET_VSCREENINFO:      return "FBIOGET_VSCREENINFO";
+    case FBIOPUT_VSCREENINFO:      return "FBIOPUT_VSCREENINFO";
+    case MSMFB_OVERLAY_SET:        return "MSMFB_OVERLAY_SET";
+    case MSMFB_OVERLAY_UNSET:      return "MSMFB_OVERLAY_UNSET";
+    case MSMFB_OVERLAY_GET:        return "MSMFB_OVERLAY_GET";
+    case MSMFB_OVERLAY_PLAY:       return "MSMFB_OVERLAY_PLAY";
+    case MSMFB_OVERLAY_3D:         return "MSMFB_OVERLAY_3D";
+    case MSMFB_MIXER_INFO:         return "MSMFB_MIXER_INFO";
+    case MSM_ROTATOR_IOCTL_START:  return "MSM_ROTATOR_IOCTL_START";
+    case MSM_ROTATOR_IOCTL_ROTATE: return "MSM_ROTATOR_IOCTL_ROTATE";
+    case MSM_ROTATOR_IOCTL_FINISH: return "MSM_ROTATOR_IOCTL_FINISH";
+    case MSM_ROTATOR_IOCTL_BUFFER_SYNC:
+                                   return "MSM_ROTATOR_IOCTL_BUFFER_SYNC";
+    case MSMFB_DISPLAY_COMMIT:     return "MSMFB_DISPLAY_COMMIT";
+    case MSMFB_BUFFER_SYNC:        return "MSMFB_BUFFER_SYNC";
+#ifdef MSMFB_METADATA_GET
+    case MSMFB_METADATA_GET:       return "MSMFB_METADATA_GET";
+#endif
+    }
+    return "unknown";
+}
+
+} // mdp_wrapper
+
+} // overlay
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OVERLAY_MDP_BACKEND_H
+#define OVERLAY_MDP_BACKEND_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace overlay {
+
+namespace mdp_wrapper {
+
+/* Everything liboverlay hands to the fb and rotator drivers (open, close and
+ * the MSMFB / MSM_ROTATOR ioctls) goes through the current backend. The
+ * default one calls into the kernel. Setting a different backend lets the
+ * pipe allocation and commit paths run without the driver, e.g. against
+ * FakeMdpBackend on a host or in a regression run. */
+class IMdpBackend {
+public:
+    virtual ~IMdpBackend() {}
+    virtual int open(const char* path, int flags) = 0;
+    virtual int close(int fd) = 0;
+    /* Same contract as ioctl(2): < 0 on failure with errno set */
+    virtual int ioctl(int fd, unsigned long request, void *arg) = 0;
+    virtual const char* getName() const = 0;
+};
+
+/* Pass through to the kernel */
+class KernelMdpBackend : public IMdpBackend {
+public:
+    virtual int open(const char* path, int flags);
+    virtual int close(int fd);
+    virtual int ioctl(int fd, unsigned long request, void *arg);
+    virtual const char* getName() const { return "kernel"; }
+};
+
+/* Wraps another backend and keeps the last MAX_RECORDS calls in a ring, with
+ * the time each one took. Enabled with debug.overlay.record_ioctls=1 or by
+ * setting it as the backend explicitly. Calls come from the composition and
+ * the rotator prewarm threads, the ring is guarded by mLock */
+class RecordingMdpBackend : public IMdpBackend {
+public:
+    enum { MAX_RECORDS = 256 };
+    enum { OP_OPEN, OP_CLOSE, OP_IOCTL };
+
+    struct Record {
+        nsecs_t start;
+        uint32_t durUs;
+        int op;
+        int fd;
+        unsigned long request; //ioctl request, 0 for open/close
+        int ret;
+        int err;               //errno, if ret < 0
+    };
+
+    explicit RecordingMdpBackend(IMdpBackend *next);
+    virtual int open(const char* path, int flags);
+    virtual int close(int fd);
+    virtual int ioctl(int fd, unsigned long request, void *arg);
+    virtual const char* getName() const { return "recording"; }
+
+    /* Copies out up to max records, oldest first. Returns the count */
+    size_t getRecords(Record *out, size_t max) const;
+    /* Total calls seen, including those that fell out of the ring */
+    uint32_t getTotal() const;
+    void reset();
+    void getDump(char *buf, size_t len) const;
+
+private:
+    void record(int op, int fd, unsigned long request, int ret,
+            nsecs_t start);
+
+    IMdpBackend *mNext;
+    Record mRecords[MAX_RECORDS];
+    uint32_t mTotal;
+    mutable android::Mutex mLock;
+};
+
+/* Current backend, never NULL */
+IMdpBackend* getBackend();
+/* Installs a backend, NULL restores the default one. Returns the previous.
+ * Not synchronized against in flight calls, switch while the HAL is idle */
+IMdpBackend* setBackend(IMdpBackend *backend);
+/* Name of an MSMFB / MSM_ROTATOR / FBIO request, for dumps */
+const char* getRequestStr(unsigned long request);
+
+} // mdp_wrapper
+
+} // overlay
+
+#endif // OVERLAY_MDP_BACKEND_H
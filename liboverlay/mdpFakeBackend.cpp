@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <mdp_version.h>
+#include "overlayUtils.h"
+#include "mdpFakeBackend.h"
+
+#ifndef MDSS_MDP_ROT_ONLY
+#define MDSS_MDP_ROT_ONLY 0x80
+#endif
+
+#define FAKE_MDP_DEBUG 0
+
+namespace overlay {
+
+namespace mdp_wrapper {
+
+using android::Mutex;
+
+FakeMdpBackend* FakeMdpBackend::sInstance = NULL;
+
+FakeMdpBackend* FakeMdpBackend::getInstance() {
+    if(sInstance == NULL) {
+        sInstance = new FakeMdpBackend();
+    }
+    return sInstance;
+}
+
+FakeMdpBackend::FakeMdpBackend() {
+    //Model whatever the device reports, a plain MDP4 if that is unknown
+    //(as on a host)
+    int version = qdutils::MDPVersion::getInstance().getMDPVersion();
+    if(version == qdutils::MDP_V_UNKNOWN)
+        version = qdutils::MDP_V4_2;
+    configure(getDefaultConfig(version));
+}
+
+FakeMdpBackend::Config FakeMdpBackend::getDefaultConfig(int mdpVersion) {
+    Config c;
+    memset(&c, 0, sizeof(c));
+    c.mdpVersion = mdpVersion;
+    c.maxUpscale = utils::HW_OV_MAGNIFICATION_LIMIT;
+    c.xres = 1280;
+    c.yres = 720;
+    if(mdpVersion >= qdutils::MDSS_V5) {
+        c.vgPipes = 3;
+        c.rgbPipes = 3;
+        c.dmaPipes = 2;
+        c.maxStagesPerMixer = 4;
+        c.maxRotSessions = 8;
+        c.maxDownscale = 4;
+    } else if(mdpVersion >= qdutils::MDP_V4_0) {
+        c.vgPipes = 2;
+        c.rgbPipes = 2;
+        c.dmaPipes = (mdpVersion >= qdutils::MDP_V4_2) ? 1 : 0;
+        c.maxStagesPerMixer = 4;
+        c.maxRotSessions = 4;
+        c.maxDownscale = utils::HW_OV_MINIFICATION_LIMIT;
+    } else {
+        c.vgPipes = 1;
+        c.rgbPipes = 1;
+        c.maxStagesPerMixer = 2;
+        c.maxRotSessions = 2;
+        c.maxDownscale = 4;
+    }
+    return c;
+}
+
+void FakeMdpBackend::configure(const Config& config) {
+    Mutex::Autolock lock(mLock);
+    mConfig = config;
+    uint32_t total = config.vgPipes + config.rgbPipes + config.dmaPipes;
+    if(total > MAX_PIPES) {
+        ALOGE("%s: %u pipes requested, modeling %d", __FUNCTION__, total,
+                MAX_PIPES);
+        total = MAX_PIPES;
+    }
+    if(mConfig.maxRotSessions > MAX_ROT_SESSIONS)
+        mConfig.maxRotSessions = MAX_ROT_SESSIONS;
+    //VG pipes first, the same order as the MDP4 pipe indices
+    mNumPipes = total;
+    for(uint32_t i = 0; i < mNumPipes; i++) {
+        if(i < config.vgPipes)
+            mPipes[i].type = PIPE_VG;
+        else if(i < config.vgPipes + config.rgbPipes)
+            mPipes[i].type = PIPE_RGB;
+        else
+            mPipes[i].type = PIPE_DMA;
+    }
+    memset(mFds, 0, sizeof(mFds));
+    memset(mRules, 0, sizeof(mRules));
+    memset(&mStats, 0, sizeof(mStats));
+    for(uint32_t i = 0; i < mNumPipes; i++)
+        mPipes[i].mixer = -1;
+    memset(mRots, 0, sizeof(mRots));
+}
+
+void FakeMdpBackend::reset() {
+    Config config;
+    {
+        Mutex::Autolock lock(mLock);
+        config = mConfig;
+    }
+    configure(config);
+}
+
+void FakeMdpBackend::injectFailure(unsigned long request, uint32_t count,
+        int err) {
+    Mutex::Autolock lock(mLock);
+    Rule *rule = getRule(request, count != 0);
+    if(rule) {
+        rule->failCount = count;
+        rule->err = err;
+    }
+}
+
+void FakeMdpBackend::setLatency(unsigned long request, uint32_t us) {
+    Mutex::Autolock lock(mLock);
+    Rule *rule = getRule(request, us != 0);
+    if(rule) {
+        rule->latencyUs = us;
+    }
+}
+
+FakeMdpBackend::Stats FakeMdpBackend::getStats() const {
+    Mutex::Autolock lock(mLock);
+    return mStats;
+}
+
+uint32_t FakeMdpBackend::getPipesInUse(int mixer) const {
+    Mutex::Autolock lock(mLock);
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < mNumPipes; i++) {
+        if(mPipes[i].mixer >= 0 && (mixer < 0 || mPipes[i].mixer == mixer))
+            count++;
+    }
+    return count;
+}
+
+uint32_t FakeMdpBackend::getRotSessionsInUse() const {
+    Mutex::Autolock lock(mLock);
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < mConfig.maxRotSessions; i++) {
+        if(mRots[i].used)
+            count++;
+    }
+    return count;
+}
+
+FakeMdpBackend::FdSlot* FakeMdpBackend::getFdSlot(int fd) {
+    int i = fd - FD_BASE;
+    if(i < 0 || i >= MAX_FDS || mFds[i].type == FD_NONE)
+        return NULL;
+    return &mFds[i];
+}
+
+FakeMdpBackend::Rule* FakeMdpBackend::getRule(unsigned long request,
+        bool create) {
+    Rule *freeRule = NULL;
+    for(int i = 0; i < MAX_RULES; i++) {
+        if(mRules[i].request == request)
+            return &mRules[i];
+        if(!freeRule && mRules[i].request == 0)
+            freeRule = &mRules[i];
+    }
+    if(create && freeRule) {
+        memset(freeRule, 0, sizeof(*freeRule));
+        freeRule->request = request;
+        return freeRule;
+    }
+    if(create)
+        ALOGE("%s: out of rules for %s", __FUNCTION__,
+                getRequestStr(request));
+    return NULL;
+}
+
+uint32_t FakeMdpBackend::countStages(int mixer) const {
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < mNumPipes; i++) {
+        if(mPipes[i].mixer == mixer)
+            count++;
+    }
+    return count;
+}
+
+bool FakeMdpBackend::checkGeometry(int pipeType,
+        const mdp_overlay& ov) const {
+    if(utils::isYuv(ov.src.format) && pipeType != PIPE_VG)
+        return false;
+    if(!ov.src_rect.w || !ov.src_rect.h || !ov.dst_rect.w || !ov.dst_rect.h)
+        return false;
+    if(ov.src_rect.x + ov.src_rect.w > ov.src.width ||
+            ov.src_rect.y + ov.src_rect.h > ov.src.height)
+        return false;
+
+    uint32_t srcW = ov.src_rect.w;
+    uint32_t srcH = ov.src_rect.h;
+    if(ov.flags & MDP_ROT_90) {
+        srcW = ov.src_rect.h;
+        srcH = ov.src_rect.w;
+    }
+    if(pipeType == PIPE_DMA)
+        return (srcW == ov.dst_rect.w && srcH == ov.dst_rect.h);
+    if(srcW > ov.dst_rect.w * mConfig.maxDownscale ||
+            srcH > ov.dst_rect.h * mConfig.maxDownscale)
+        return false;
+    if(ov.dst_rect.w > srcW * mConfig.maxUpscale ||
+            ov.dst_rect.h > srcH * mConfig.maxUpscale)
+        return false;
+    return true;
+}
+
+int FakeMdpBackend::allocPipe(int mixer, const mdp_overlay& ov) {
+    if(countStages(mixer) >= mConfig.maxStagesPerMixer)
+        return -EBUSY;
+
+    int types[2];
+    int numTypes = 0;
+    if(ov.flags & MDP_OV_PIPE_FORCE_DMA) {
+        types[numTypes++] = PIPE_DMA;
+    } else if(utils::isYuv(ov.src.format)) {
+        types[numTypes++] = PIPE_VG;
+    } else {
+        types[numTypes++] = PIPE_RGB;
+        if((ov.flags & MDP_OV_PIPE_SHARE) ||
+                mConfig.mdpVersion >= qdutils::MDSS_V5)
+            types[numTypes++] = PIPE_VG;
+    }
+
+    int err = -EBUSY;
+    for(int t = 0; t < numTypes; t++) {
+        if(!checkGeometry(types[t], ov)) {
+            err = -EINVAL;
+            continue;
+        }
+        for(uint32_t i = 0; i < mNumPipes; i++) {
+            if(mPipes[i].type == types[t] && mPipes[i].mixer < 0) {
+                mPipes[i].mixer = mixer;
+                return i;
+            }
+        }
+    }
+    return err;
+}
+
+int FakeMdpBackend::allocRotSession(int fd, bool mdss) {
+    for(uint32_t i = 0; i < mConfig.maxRotSessions; i++) {
+        if(!mRots[i].used) {
+            mRots[i].used = true;
+            mRots[i].fd = fd;
+            mRots[i].mdss = mdss;
+            return i;
+        }
+    }
+    return -EBUSY;
+}
+
+int FakeMdpBackend::setOverlay(const FdSlot& slot, int fd,
+        mdp_overlay *ov) {
+    if(ov->flags & MDSS_MDP_ROT_ONLY) {
+        if(MSMFB_NEW_REQUEST == static_cast<int>(ov->id)) {
+            int i = allocRotSession(fd, true);
+            if(i < 0)
+                return i;
+            ov->id = ROT_ID_BASE + i;
+            return 0;
+        }
+        uint32_t i = ov->id - ROT_ID_BASE;
+        if(i >= mConfig.maxRotSessions || !mRots[i].used)
+            return -EINVAL;
+        return 0;
+    }
+
+    if(ov->z_order >= mConfig.maxStagesPerMixer)
+        return -EINVAL;
+
+    if(MSMFB_NEW_REQUEST == static_cast<int>(ov->id)) {
+        int i = allocPipe(slot.fbnum, *ov);
+        if(i < 0)
+            return i;
+        ov->id = i;
+        mPipes[i].ov = *ov;
+        return 0;
+    }
+
+    if(ov->id >= mNumPipes || mPipes[ov->id].mixer != slot.fbnum)
+        return -EINVAL;
+    if(!checkGeometry(mPipes[ov->id].type, *ov))
+        return -EINVAL;
+    mPipes[ov->id].ov = *ov;
+    return 0;
+}
+
+int FakeMdpBackend::unsetOverlay(const FdSlot& slot, int id) {
+    uint32_t rot = id - ROT_ID_BASE;
+    if(rot < mConfig.maxRotSessions && mRots[rot].used && mRots[rot].mdss) {
+        mRots[rot].used = false;
+        return 0;
+    }
+    if(id < 0 || (uint32_t)id >= mNumPipes ||
+            mPipes[id].mixer != slot.fbnum)
+        return -EINVAL;
+    mPipes[id].mixer = -1;
+    return 0;
+}
+
+int FakeMdpBackend::getOverlay(const FdSlot& slot, mdp_overlay *ov) {
+    if(ov->id >= mNumPipes || mPipes[ov->id].mixer != slot.fbnum)
+        return -EINVAL;
+    *ov = mPipes[ov->id].ov;
+    return 0;
+}
+
+int FakeMdpBackend::play(const FdSlot& slot, int fd,
+        const msmfb_overlay_data *od) {
+    uint32_t rot = od->id - ROT_ID_BASE;
+    if(rot < mConfig.maxRotSessions && mRots[rot].used &&
+            mRots[rot].fd == fd)
+        return 0;
+    if(od->id >= mNumPipes || mPipes[od->id].mixer != slot.fbnum)
+        return -EINVAL;
+    return 0;
+}
+
+int FakeMdpBackend::getMixerInfo(msmfb_mixer_info_req *req) {
+    if(req->mixer_num < 0 || req->mixer_num >= MAX_MIXERS)
+        return -EINVAL;
+    req->cnt = 0;
+    for(uint32_t i = 0; i < mNumPipes && req->cnt < MAX_PIPE_PER_MIXER;
+            i++) {
+        if(mPipes[i].mixer != req->mixer_num)
+            continue;
+        mdp_mixer_info& info = req->info[req->cnt++];
+        info.pndx = i;
+        info.pnum = i;
+        info.ptype = mPipes[i].type;
+        info.mixer_num = req->mixer_num;
+        info.z_order = mPipes[i].ov.z_order;
+    }
+    return 0;
+}
+
+int FakeMdpBackend::getFScreenInfo(const FdSlot& slot,
+        fb_fix_screeninfo *finfo) {
+    memset(finfo, 0, sizeof(*finfo));
+    //Same id layout the drivers use, MDPVersion parses it
+    if(mConfig.mdpVersion >= qdutils::MDSS_V5)
+        snprintf(finfo->id, sizeof(finfo->id), "mdssfb_%d", slot.fbnum);
+    else
+        snprintf(finfo->id, sizeof(finfo->id), "msmfb%03d_",
+                mConfig.mdpVersion);
+    finfo->line_length = mConfig.xres * 4;
+    finfo->smem_len = finfo->line_length * mConfig.yres * 2;
+    return 0;
+}
+
+int FakeMdpBackend::getVScreenInfo(fb_var_screeninfo *vinfo) {
+    memset(vinfo, 0, sizeof(*vinfo));
+    vinfo->xres = mConfig.xres;
+    vinfo->yres = mConfig.yres;
+    vinfo->xres_virtual = mConfig.xres;
+    vinfo->yres_virtual = mConfig.yres * 2;
+    vinfo->bits_per_pixel = 32;
+    vinfo->reserved[3] = FAKE_FPS; //where older drivers report the fps
+    return 0;
+}
+
+#ifdef MSMFB_METADATA_GET
+int FakeMdpBackend::getMetadata(msmfb_metadata *metadata) {
+    if(metadata->op != metadata_op_frame_rate)
+        return -EINVAL;
+    metadata->data.panel_frame_rate = FAKE_FPS;
+    return 0;
+}
+#endif
+
+int FakeMdpBackend::startRotator(int fd, msm_rotator_img_info *info) {
+    //A known session is reconfigured in place, like the driver does
+    uint32_t i = info->session_id - 1;
+    if(i < mConfig.maxRotSessions && mRots[i].used && !mRots[i].mdss &&
+            mRots[i].fd == fd)
+        return 0;
+    int slot = allocRotSession(fd, false);
+    if(slot < 0)
+        return slot;
+    info->session_id = slot + 1;
+    return 0;
+}
+
+int FakeMdpBackend::rotate(const msm_rotator_data_info *info) {
+    uint32_t i = info->session_id - 1;
+    if(i >= mConfig.maxRotSessions || !mRots[i].used || mRots[i].mdss)
+        return -EINVAL;
+    return 0;
+}
+
+int FakeMdpBackend::endRotator(const uint32_t *sessionId) {
+    uint32_t i = *sessionId - 1;
+    if(i >= mConfig.maxRotSessions || !mRots[i].used || mRots[i].mdss)
+        return -EINVAL;
+    mRots[i].used = false;
+    return 0;
+}
+
+int FakeMdpBackend::open(const char* path, int flags) {
+    (void)flags;
+    Mutex::Autolock lock(mLock);
+    int type = FD_NONE;
+    unsigned int fbnum = 0;
+    if(sscanf(path, FB_DEVICE_TEMPLATE, &fbnum) == 1 &&
+            fbnum < MAX_MIXERS) {
+        type = FD_FB;
+    } else if(!strcmp(path, "/dev/msm_rotator")) {
+        type = FD_ROT;
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+    for(int i = 0; i < MAX_FDS; i++) {
+        if(mFds[i].type == FD_NONE) {
+            mFds[i].type = type;
+            mFds[i].fbnum = fbnum;
+            mStats.opens++;
+            return FD_BASE + i;
+        }
+    }
+    errno = EMFILE;
+    return -1;
+}
+
+int FakeMdpBackend::close(int fd) {
+    Mutex::Autolock lock(mLock);
+    FdSlot *slot = getFdSlot(fd);
+    if(slot == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    //Sessions die with the fd that started them
+    for(uint32_t i = 0; i < mConfig.maxRotSessions; i++) {
+        if(mRots[i].used && mRots[i].fd == fd)
+            mRots[i].used = false;
+    }
+    int fbnum = slot->fbnum;
+    bool isFb = (slot->type == FD_FB);
+    slot->type = FD_NONE;
+    mStats.closes++;
+
+    //The driver releases a mixer's pipes when its last fd goes away
+    if(isFb) {
+        for(int i = 0; i < MAX_FDS; i++) {
+            if(mFds[i].type == FD_FB && mFds[i].fbnum == fbnum)
+                return 0;
+        }
+        for(uint32_t i = 0; i < mNumPipes; i++) {
+            if(mPipes[i].mixer == fbnum)
+                mPipes[i].mixer = -1;
+        }
+    }
+    return 0;
+}
+
+int FakeMdpBackend::ioctl(int fd, unsigned long request, void *arg) {
+    int ret = 0;
+    uint32_t latencyUs = 0;
+    {
+        Mutex::Autolock lock(mLock);
+        FdSlot *slot = getFdSlot(fd);
+        Rule *rule = getRule(request, false);
+        if(rule)
+            latencyUs = rule->latencyUs;
+
+        if(slot == NULL) {
+            ret = -EBADF;
+        } else if(rule && rule->failCount) {
+            rule->failCount--;
+            mStats.injected++;
+            ret = -rule->err;
+        } else if(slot->type == FD_ROT) {
+            switch(request) {
+            case MSM_ROTATOR_IOCTL_START:
+                mStats.rotStart++;
+                ret = startRotator(fd, (msm_rotator_img_info*)arg);
+                break;
+            case MSM_ROTATOR_IOCTL_ROTATE:
+                mStats.rotate++;
+                ret = rotate((msm_rotator_data_info*)arg);
+                break;
+            case MSM_ROTATOR_IOCTL_FINISH:
+                mStats.rotFinish++;
+                ret = endRotator((uint32_t*)arg);
+                break;
+            case MSM_ROTATOR_IOCTL_BUFFER_SYNC:
+                mStats.bufSync++;
+                ((msm_rotator_buf_sync*)arg)->rel_fen_fd = -1;
+                break;
+            default:
+                ret = -ENOTTY;
+            }
+        } else {
+            switch(request) {
+            case MSMFB_OVERLAY_SET:
+                mStats.set++;
+                ret = setOverlay(*slot, fd, (mdp_overlay*)arg);
+                break;
+            case MSMFB_OVERLAY_UNSET:
+                mStats.unset++;
+                ret = unsetOverlay(*slot, *(int*)arg);
+                break;
+            case MSMFB_OVERLAY_GET:
+                mStats.get++;
+                ret = getOverlay(*slot, (mdp_overlay*)arg);
+                break;
+            case MSMFB_OVERLAY_PLAY:
+                mStats.play++;
+                ret = play(*slot, fd, (msmfb_overlay_data*)arg);
+                break;
+            case MSMFB_MIXER_INFO:
+                ret = getMixerInfo((msmfb_mixer_info_req*)arg);
+                break;
+            case FBIOGET_FSCREENINFO:
+                ret = getFScreenInfo(*slot, (fb_fix_screeninfo*)arg);
+                break;
+            case FBIOGET_VSCREENINFO:
+                ret = getVScreenInfo((fb_var_screeninfo*)arg);
+                break;
+            case MSMFB_DISPLAY_COMMIT:
+                mStats.commit++;
+                break;
+            case MSMFB_BUFFER_SYNC:
+                mStats.bufSync++;
+                *((mdp_buf_sync*)arg)->rel_fen_fd = -1;
+                break;
+#ifdef MSMFB_METADATA_GET
+            case MSMFB_METADATA_GET:
+                ret = getMetadata((msmfb_metadata*)arg);
+                break;
+#endif
+            case FBIOPUT_VSCREENINFO:
+            case MSMFB_OVERLAY_3D:
+                break;
+            default:
+                ret = -ENOTTY;
+            }
+        }
+        if(ret < 0)
+            mStats.failed++;
+        ALOGD_IF(FAKE_MDP_DEBUG, "%s: fd=%d %s ret=%d", __FUNCTION__, fd,
+                getRequestStr(request), ret);
+    }
+
+    if(latencyUs)
+        usleep(latencyUs);
+    if(ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return 0;
+}
+
+void FakeMdpBackend::getDump(char *buf, size_t len) const {
+    static const char *const typeStr[] = { "VG", "RGB", "DMA" };
+    Mutex::Autolock lock(mLock);
+    char str[256] = {'\0'};
+    snprintf(str, 256, "Fake MDP %d: VG %u RGB %u DMA %u, %u stages, "
+            "%u rot sessions\n", mConfig.mdpVersion, mConfig.vgPipes,
+            mConfig.rgbPipes, mConfig.dmaPipes, mConfig.maxStagesPerMixer,
+            mConfig.maxRotSessions);
+    strncat(buf, str, len - strlen(buf) - 1);
+    for(uint32_t i = 0; i < mNumPipes; i++) {
+        if(mPipes[i].mixer < 0)
+            continue;
+        const mdp_overlay& ov = mPipes[i].ov;
+        snprintf(str, 256, "  pipe %u %s mixer %d z %d src %ux%u fmt %u "
+                "crop [%u,%u %ux%u] dst [%u,%u %ux%u]\n", i,
+                typeStr[mPipes[i].type], mPipes[i].mixer, ov.z_order,
+                ov.src.width, ov.src.height, ov.src.format,
+                ov.src_rect.x, ov.src_rect.y, ov.src_rect.w, ov.src_rect.h,
+                ov.dst_rect.x, ov.dst_rect.y, ov.dst_rect.w, ov.dst_rect.h);
+        strncat(buf, str, len - strlen(buf) - 1);
+    }
+    for(uint32_t i = 0; i < mConfig.maxRotSessions; i++) {
+        if(!mRots[i].used)
+            continue;
+        snprintf(str, 256, "  rot session %u fd %d %s\n", i, mRots[i].fd,
+                mRots[i].mdss ? "mdss" : "msm_rotator");
+        strncat(buf, str, len - strlen(buf) - 1);
+    }
+    snprintf(str, 256, "  set %u unset %u get %u play %u rot start %u "
+            "rotate %u finish %u commit %u buf sync %u failed %u "
+            "(injected %u)\n",
+            mStats.set, mStats.unset, mStats.get, mStats.play,
+            mStats.rotStart, mStats.rotate, mStats.rotFinish,
+            mStats.commit, mStats.bufSync,
+            mStats.failed, mStats.injected);
+    strncat(buf, str, len - strlen(buf) - 1);
+    for(int i = 0; i < MAX_RULES; i++) {
+        const Rule& r = mRules[i];
+        if(!r.request || (!r.failCount && !r.latencyUs))
+            continue;
+        snprintf(str, 256, "  %s: fail next %u (err %d), latency %uus\n",
+                getRequestStr(r.request), r.failCount, r.err, r.latencyUs);
+        strncat(buf, str, len - strlen(buf) - 1);
+    }
+}
+
+} // mdp_wrapper
+
+} // overlay
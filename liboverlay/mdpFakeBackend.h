@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OVERLAY_MDP_FAKE_BACKEND_H
+#define OVERLAY_MDP_FAKE_BACKEND_H
+
+#include <linux/msm_mdp.h>
+#include <linux/msm_rotator.h>
+#include <utils/threads.h>
+#include "mdpBackend.h"
+
+namespace overlay {
+
+namespace mdp_wrapper {
+
+/* Software model of the fb / rotator drivers, built into liboverlay and
+ * installed only through setBackend(), by tests and hwcreplay. It hands out pipes per type and per mixer the way
+ * the MDP does, rejects geometry the hardware would, tracks rotator sessions
+ * (msm_rotator and MDSS ROT_ONLY), and lets tests inject failures and
+ * latencies per request. No pixels are moved and fence syncs return no
+ * release fence (-1), everything is treated as already signaled. */
+class FakeMdpBackend : public IMdpBackend {
+public:
+    enum { MAX_MIXERS = 3, MAX_FDS = 16, MAX_PIPES = 12,
+            MAX_ROT_SESSIONS = 8 };
+
+    struct Config {
+        int mdpVersion;
+        uint32_t vgPipes;
+        uint32_t rgbPipes;
+        uint32_t dmaPipes;
+        uint32_t maxStagesPerMixer;
+        uint32_t maxRotSessions;
+        uint32_t maxDownscale;  //max src/dst ratio
+        uint32_t maxUpscale;    //max dst/src ratio
+        uint32_t xres;          //of every fb
+        uint32_t yres;
+    };
+
+    struct Stats {
+        uint32_t opens;
+        uint32_t closes;
+        uint32_t set;
+        uint32_t unset;
+        uint32_t get;
+        uint32_t play;
+        uint32_t rotStart;
+        uint32_t rotate;
+        uint32_t rotFinish;
+        uint32_t commit;        //MSMFB_DISPLAY_COMMIT
+        uint32_t bufSync;       //MSMFB_BUFFER_SYNC and rotator buffer sync
+        uint32_t failed;        //includes injected
+        uint32_t injected;
+    };
+
+    static FakeMdpBackend* getInstance();
+    /* Approximate pipe and scaling limits of an MDP revision */
+    static Config getDefaultConfig(int mdpVersion);
+
+    /* Reconfigures the model and drops all state, open fds included */
+    void configure(const Config& config);
+    void reset();
+    /* The next count calls of request fail with err. count 0 clears */
+    void injectFailure(unsigned long request, uint32_t count, int err);
+    /* Every call of request sleeps us before returning. 0 clears */
+    void setLatency(unsigned long request, uint32_t us);
+
+    Stats getStats() const;
+    /* Pipes staged on a mixer, -1 for all mixers */
+    uint32_t getPipesInUse(int mixer) const;
+    uint32_t getRotSessionsInUse() const;
+    void getDump(char *buf, size_t len) const;
+
+    virtual int open(const char* path, int flags);
+    virtual int close(int fd);
+    virtual int ioctl(int fd, unsigned long request, void *arg);
+    virtual const char* getName() const { return "fake"; }
+
+private:
+    enum { FD_BASE = 1000, ROT_ID_BASE = 0x1000, MAX_RULES = 8,
+            FAKE_FPS = 60 };
+    enum { FD_NONE, FD_FB, FD_ROT };
+    enum { PIPE_VG, PIPE_RGB, PIPE_DMA };
+
+    struct FdSlot {
+        int type;
+        int fbnum;
+    };
+    struct PipeSlot {
+        int type;
+        int mixer;          //-1 if free
+        mdp_overlay ov;
+    };
+    struct RotSlot {
+        bool used;
+        int fd;
+        bool mdss;          //MDSS_MDP_ROT_ONLY session on an fb fd
+    };
+    struct Rule {
+        unsigned long request;
+        uint32_t failCount;
+        int err;
+        uint32_t latencyUs;
+    };
+
+    FakeMdpBackend();
+    FdSlot* getFdSlot(int fd);
+    Rule* getRule(unsigned long request, bool create);
+    int allocPipe(int mixer, const mdp_overlay& ov);
+    int allocRotSession(int fd, bool mdss);
+    bool checkGeometry(int pipeType, const mdp_overlay& ov) const;
+    uint32_t countStages(int mixer) const;
+
+    int setOverlay(const FdSlot& slot, int fd, mdp_overlay *ov);
+    int unsetOverlay(const FdSlot& slot, int id);
+    int getOverlay(const FdSlot& slot, mdp_overlay *ov);
+    int play(const FdSlot& slot, int fd, const msmfb_overlay_data *od);
+    int getMixerInfo(msmfb_mixer_info_req *req);
+    int getFScreenInfo(const FdSlot& slot, fb_fix_screeninfo *finfo);
+    int getVScreenInfo(fb_var_screeninfo *vinfo);
+#ifdef MSMFB_METADATA_GET
+    int getMetadata(msmfb_metadata *metadata);
+#endif
+    int startRotator(int fd, msm_rotator_img_info *info);
+    int rotate(const msm_rotator_data_info *info);
+    int endRotator(const uint32_t *sessionId);
+
+    Config mConfig;
+    FdSlot mFds[MAX_FDS];
+    PipeSlot mPipes[MAX_PIPES];
+    uint32_t mNumPipes;
+    RotSlot mRots[MAX_ROT_SESSIONS];
+    Rule mRules[MAX_RULES];
+    Stats mStats;
+    mutable android::Mutex mLock;
+    static FakeMdpBackend *sInstance;
+};
+
+} // mdp_wrapper
+
+} // overlay
+
+#endif // OVERLAY_MDP_FAKE_BACKEND_H
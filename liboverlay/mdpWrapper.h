@@ -42,11 +42,32 @@
 #include <sys/ioctl.h>
 #include <utils/Log.h>
 #include <errno.h>
+#include <cutils/atomic.h>
 #include "overlayUtils.h"
+#include "mdpBackend.h"
 
 namespace overlay{
 
 namespace mdp_wrapper{
+/* Running count of the ioctls issued by this process. Overlay diffs them
+ * per frame for the dump. skippedSet counts OVERLAY_SETs avoided because the
+ * mdp_overlay was unchanged */
+struct IoctlStats {
+    uint32_t set;
+    uint32_t unset;
+    uint32_t play;
+    uint32_t rotStart;
+    uint32_t rotate;
+    uint32_t rotFinish;
+    uint32_t skippedSet;
+};
+IoctlStats& getIoctlStats();
+
+/* Displays may be set from different threads, so bump atomically */
+inline void countIoctl(uint32_t& counter) {
+    android_atomic_inc(reinterpret_cast<volatile int32_t*>(&counter));
+}
+
 /* FBIOGET_FSCREENINFO */
 bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo);
 
@@ -101,7 +122,7 @@ void dump(const char* const s, const fb_var_screeninfo& vinfo);
 //---------------Inlines -------------------------------------
 
 inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
+    if (getBackend()->ioctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_FSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -110,7 +131,7 @@ inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
 }
 
 inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
+    if (getBackend()->ioctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -119,7 +140,7 @@ inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
+    if (getBackend()->ioctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOPUT_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -128,7 +149,8 @@ inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool startRotator(int fd, msm_rotator_img_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
+    countIoctl(getIoctlStats().rotStart);
+    if (getBackend()->ioctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_START err=%s",
                 strerror(errno));
         return false;
@@ -137,7 +159,8 @@ inline bool startRotator(int fd, msm_rotator_img_info& rot) {
 }
 
 inline bool rotate(int fd, msm_rotator_data_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
+    countIoctl(getIoctlStats().rotate);
+    if (getBackend()->ioctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_ROTATE err=%s",
                 strerror(errno));
         return false;
@@ -146,7 +169,8 @@ inline bool rotate(int fd, msm_rotator_data_info& rot) {
 }
 
 inline bool setOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
+    countIoctl(getIoctlStats().set);
+    if (getBackend()->ioctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_SET err=%s",
                 strerror(errno));
         return false;
@@ -156,7 +180,8 @@ inline bool setOverlay(int fd, mdp_overlay& ov) {
 
 inline bool endRotator(int fd, int sessionId) {
 inline bool endRotator(int fd, uint32_t sessionId) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
+    countIoctl(getIoctlStats().rotFinish);
+    if (getBackend()->ioctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_FINISH err=%s",
                 strerror(errno));
         return false;
@@ -165,7 +190,8 @@ inline bool endRotator(int fd, uint32_t sessionId) {
 }
 
 inline bool unsetOverlay(int fd, int ovId) {
-    if (ioctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
+    countIoctl(getIoctlStats().unset);
+    if (getBackend()->ioctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_UNSET err=%s",
                 strerror(errno));
         return false;
@@ -174,7 +200,7 @@ inline bool unsetOverlay(int fd, int ovId) {
 }
 
 inline bool getOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
+    if (getBackend()->ioctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_GET err=%s",
                 strerror(errno));
         return false;
@@ -183,7 +209,8 @@ inline bool getOverlay(int fd, mdp_overlay& ov) {
 }
 
 inline bool play(int fd, msmfb_overlay_data& od) {
-    if (ioctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
+    countIoctl(getIoctlStats().play);
+    if (getBackend()->ioctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_PLAY err=%s",
                 strerror(errno));
         return false;
@@ -192,7 +219,7 @@ inline bool play(int fd, msmfb_overlay_data& od) {
 }
 
 inline bool set3D(int fd, msmfb_overlay_3d& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
+    if (getBackend()->ioctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_3D err=%s",
                 strerror(errno));
         return false;
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Runs the fake MDP backend through the calls liboverlay makes, and checks
+ * that RecordingMdpBackend keeps an exact count and a consistent ring when
+ * several threads go through it at once. The fake is built into this test
+ * directly and used without setBackend, so the backend liboverlay would
+ * pick is left alone. Exits non zero if any check fails. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <mdp_version.h>
+#include "mdpFakeBackend.h"
+
+using namespace overlay::mdp_wrapper;
+
+#define NUM_THREADS 4
+#define CALLS_PER_THREAD 20000
+
+static int sFailures = 0;
+static int sChecks = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+    sChecks++;
+    if(!ok)
+        sFailures++;
+}
+
+static int setPipe(IMdpBackend *b, int fd, uint32_t srcW, uint32_t dstW,
+        uint32_t *id) {
+    mdp_overlay ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.id = MSMFB_NEW_REQUEST;
+    ov.src.format = MDP_RGBA_8888;
+    ov.src.width = srcW;
+    ov.src.height = 64;
+    ov.src_rect.w = srcW;
+    ov.src_rect.h = 64;
+    ov.dst_rect.w = dstW;
+    ov.dst_rect.h = 64;
+    int ret = b->ioctl(fd, MSMFB_OVERLAY_SET, &ov);
+    if(id)
+        *id = ov.id;
+    return (ret < 0) ? -errno : 0;
+}
+
+static void testFake(FakeMdpBackend *fake) {
+    FakeMdpBackend::Config config =
+            FakeMdpBackend::getDefaultConfig(qdutils::MDP_V4_2);
+    fake->configure(config);
+
+    int fd = fake->open("/dev/graphics/fb0", O_RDWR);
+    check(fd >= 0, "fake open fb0");
+
+    //RGB layers take the RGB pipes, then the driver runs out
+    uint32_t id = 0;
+    bool ok = true;
+    for(uint32_t i = 0; i < config.rgbPipes; i++)
+        ok = ok && (setPipe(fake, fd, 256, 256, &id) == 0);
+    check(ok, "fake hands out every RGB pipe");
+    check(setPipe(fake, fd, 256, 256, NULL) == -EBUSY,
+            "fake rejects one RGB pipe too many");
+    check(fake->getPipesInUse(0) == config.rgbPipes, "fake pipes in use");
+
+    //Geometry the hardware cannot scale
+    int unset = id;
+    fake->ioctl(fd, MSMFB_OVERLAY_UNSET, &unset);
+    check(setPipe(fake, fd, 256 * (config.maxDownscale + 1), 256, NULL) ==
+            -EINVAL, "fake rejects a downscale past the limit");
+
+    //Injected failures hit exactly the requested count
+    check(setPipe(fake, fd, 256, 256, &id) == 0, "fake reuses a freed pipe");
+    msmfb_overlay_data od;
+    memset(&od, 0, sizeof(od));
+    od.id = id;
+    fake->injectFailure(MSMFB_OVERLAY_PLAY, 1, EIO);
+    int ret = fake->ioctl(fd, MSMFB_OVERLAY_PLAY, &od);
+    check(ret < 0 && errno == EIO, "fake injects a play failure");
+    check(fake->ioctl(fd, MSMFB_OVERLAY_PLAY, &od) == 0,
+            "fake play succeeds once the failure is used up");
+
+    //Rotator sessions live and die with their fd
+    int rotFd = fake->open("/dev/msm_rotator", O_RDWR);
+    msm_rotator_img_info info;
+    memset(&info, 0, sizeof(info));
+    check(fake->ioctl(rotFd, MSM_ROTATOR_IOCTL_START, &info) == 0 &&
+            fake->getRotSessionsInUse() == 1, "fake starts a rotator session");
+    fake->close(rotFd);
+    check(fake->getRotSessionsInUse() == 0,
+            "fake ends the session with its fd");
+
+    //Closing the last fb fd releases the mixer's pipes
+    fake->close(fd);
+    check(fake->getPipesInUse(-1) == 0, "fake releases pipes on close");
+}
+
+struct RecordArgs {
+    IMdpBackend *backend;
+    int fd;
+};
+
+static void *recordThread(void *data) {
+    RecordArgs *args = (RecordArgs*)data;
+    fb_var_screeninfo vinfo;
+    for(int i = 0; i < CALLS_PER_THREAD; i++)
+        args->backend->ioctl(args->fd, FBIOGET_VSCREENINFO, &vinfo);
+    return NULL;
+}
+
+static void testRecording(FakeMdpBackend *fake) {
+    fake->reset();
+    RecordingMdpBackend rec(fake);
+    RecordArgs args;
+    args.backend = &rec;
+    args.fd = rec.open("/dev/graphics/fb0", O_RDWR);
+
+    pthread_t threads[NUM_THREADS];
+    for(int i = 0; i < NUM_THREADS; i++)
+        pthread_create(&threads[i], NULL, recordThread, &args);
+    for(int i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    check(rec.getTotal() == 1 + NUM_THREADS * CALLS_PER_THREAD,
+            "recording counts every call across threads");
+
+    RecordingMdpBackend::Record recs[RecordingMdpBackend::MAX_RECORDS];
+    size_t count = rec.getRecords(recs, RecordingMdpBackend::MAX_RECORDS);
+    bool ok = (count == RecordingMdpBackend::MAX_RECORDS);
+    for(size_t i = 0; i < count; i++) {
+        ok = ok && recs[i].op == RecordingMdpBackend::OP_IOCTL &&
+                recs[i].fd == args.fd &&
+                recs[i].request == FBIOGET_VSCREENINFO &&
+                recs[i].ret == 0 && recs[i].err == 0;
+    }
+    check(ok, "recording ring holds only whole records");
+
+    rec.close(args.fd);
+    rec.reset();
+    check(rec.getTotal() == 0 && rec.getRecords(recs, 1) == 0,
+            "recording reset");
+}
+
+int main(int argc, char **argv) {
+    FakeMdpBackend *fake = FakeMdpBackend::getInstance();
+    testFake(fake);
+    testRecording(fake);
+    printf("%d of %d checks failed\n", sFailures, sChecks);
+    return sFailures ? 1 : 0;
+}
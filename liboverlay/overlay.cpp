@@ -215,11 +215,31 @@ Overlay::Overlay() {
         PipeBook::NUM_PIPES = qdutils::MDPVersion::getInstance().getTotalPipes();
     }
 
+    if (property_get("debug.overlay.park.frames", property, NULL) > 0) {
+        PipeBook::sParkFrames = atoi(property);
+    }
+    if (property_get("debug.overlay.park.ms", property, NULL) > 0) {
+        PipeBook::sParkMs = atoi(property);
+    }
+
+    memset(mDpyMask, 0, sizeof(mDpyMask));
+    mParkedMask = 0;
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
         mPipeBook[i].init();
+        updatePipeMask(i);
     }
 
-    mDumpStr[0] = '\0';
+    mFrameCount = 0;
+    mParkCount = 0;
+    mReuseCount = 0;
+    mEvictCount = 0;
+    mTxnDpy = PipeBook::DPY_UNUSED;
+    mTxnPending = 0;
+    mTxnFailCount = 0;
+    mFrameStartIoctls = mdp_wrapper::getIoctlStats();
+    memset(&mLastFrameIoctls, 0, sizeof(mLastFrameIoctls));
+    memset(mEvents, 0, sizeof(mEvents));
+    mEventCount = 0;
 }
 
 Overlay::~Overlay() {
@@ -234,65 +254,122 @@ void Overlay::configBegin() {
         PipeBook::resetUse(i);
         PipeBook::resetAllocation(i);
     }
-    mDumpStr[0] = '\0';
+
+    //A frame spans prepare and set, so the ioctls of the previous one,
+    //plays included, are complete by now.
+    const mdp_wrapper::IoctlStats& now = mdp_wrapper::getIoctlStats();
+    mLastFrameIoctls.set = now.set - mFrameStartIoctls.set;
+    mLastFrameIoctls.unset = now.unset - mFrameStartIoctls.unset;
+    mLastFrameIoctls.play = now.play - mFrameStartIoctls.play;
+    mLastFrameIoctls.rotStart = now.rotStart - mFrameStartIoctls.rotStart;
+    mLastFrameIoctls.rotate = now.rotate - mFrameStartIoctls.rotate;
+    mLastFrameIoctls.rotFinish = now.rotFinish - mFrameStartIoctls.rotFinish;
+    mLastFrameIoctls.skippedSet =
+            now.skippedSet - mFrameStartIoctls.skippedSet;
+    mFrameStartIoctls = now;
 }
 
 void Overlay::configDone() {
-    if(PipeBook::pipeUsageUnchanged()) return;
+    if(not PipeBook::pipeUsageUnchanged() || mParkedMask) {
+        nsecs_t now = systemTime();
+        for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+            if(PipeBook::isUsed(i) || not mPipeBook[i].valid()) {
+                continue;
+            }
+            if(not mPipeBook[i].mParked && PipeBook::sParkFrames) {
+                //Forces UNSET on the pipe, but holds on to the rotator
+                //session, rotator memory and fds in case the display wants
+                //it back.
+                mPipeBook[i].park(mFrameCount, now);
+                if(mPipeBook[i].mParked) {
+                    logEvent(EV_PARK, i);
+                    mParkCount++;
+                    mPipeBook[i].mParks++;
+                } else {
+                    logEvent(EV_UNSET, i);
+                }
+                updatePipeMask(i);
+            } else if(not mPipeBook[i].mParked ||
+                    mPipeBook[i].parkExpired(mFrameCount, now)) {
+                //Forces UNSET on pipes, flushes rotator memory and session,
+                //closes fds
+                if(mPipeBook[i].mParked) {
+                    logEvent(EV_EVICT, i);
+                    mEvictCount++;
+                    mPipeBook[i].mEvicts++;
+                } else {
+                    logEvent(EV_UNSET, i);
+                }
+                mPipeBook[i].destroy();
+                updatePipeMask(i);
+            }
+        }
+        dump();
+        PipeBook::save();
+    }
+    mFrameCount++;
+}
 
+void Overlay::clear() {
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-        if(PipeBook::isNotUsed(i)) {
-            //Forces UNSET on pipes, flushes rotator memory and session, closes
-            //fds
-            if(mPipeBook[i].valid()) {
-                char str[32];
-                sprintf(str, "Unset pipe=%s dpy=%d; ",
-                        PipeBook::getDestStr((eDest)i), mPipeBook[i].mDisplay);
-                strncat(mDumpStr, str, strlen(str));
-            }
+        if(mPipeBook[i].mParked) {
+            logEvent(EV_EVICT, i);
             mPipeBook[i].destroy();
+            updatePipeMask(i);
+            mEvictCount++;
+            mPipeBook[i].mEvicts++;
         }
     }
-    dump();
-    PipeBook::save();
 }
 
 eDest Overlay::nextPipe(eMdpPipeType type, int dpy) {
-    eDest dest = OV_INVALID;
-
-    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-        //Match requested pipe type
-        if(type == OV_MDP_PIPE_ANY || type == PipeBook::getPipeType((eDest)i)) {
-            //If the pipe is not allocated to any display or used by the
-            //requesting display already in previous round.
-            if((mPipeBook[i].mDisplay == PipeBook::DPY_UNUSED ||
-                    mPipeBook[i].mDisplay == dpy) &&
-                    PipeBook::isNotAllocated(i)) {
-                dest = (eDest)i;
-                PipeBook::setAllocation(i);
-                break;
-            }
-        }
+    OVASSERT(dpy >= 0 && dpy <= PipeBook::DPY_UNUSED,
+            "%s: invalid display %d", __FUNCTION__, dpy);
+    const int avail = PipeBook::getFreeMask(type);
+
+    //Prefer a pipe the requesting display already owns, active or parked,
+    //since that needs no new fds or rotator session. Then a free one.
+    int pick = avail & mDpyMask[dpy];
+    if(!pick)
+        pick = avail & mDpyMask[PipeBook::DPY_UNUSED];
+    if(!pick && (avail & mParkedMask)) {
+        //Last resort, take over a pipe parked by another display. It is
+        //already UNSET, but the fds belong to the other fb, so it has to be
+        //rebuilt.
+        pick = avail & mParkedMask;
+        int index = __builtin_ctz(pick);
+        logEvent(EV_EVICT, index);
+        mPipeBook[index].destroy();
+        mEvictCount++;
+        mPipeBook[index].mEvicts++;
     }
 
-    if(dest != OV_INVALID) {
-        int index = (int)dest;
-        //If the pipe is not registered with any display OR if the pipe is
-        //requested again by the same display using it, then go ahead.
-        mPipeBook[index].mDisplay = dpy;
-        if(not mPipeBook[index].valid()) {
-            mPipeBook[index].mPipe = new GenericPipe(dpy);
-            char str[32];
-            snprintf(str, 32, "Set pipe=%s dpy=%d; ",
-                     PipeBook::getDestStr(dest), dpy);
-            strncat(mDumpStr, str, strlen(str));
-        }
-    } else {
+    if(!pick) {
         ALOGD_IF(PIPE_DEBUG, "Pipe unavailable type=%d display=%d",
                 (int)type, dpy);
+        return OV_INVALID;
     }
 
-    return dest;
+    //Lowest index first, same order the pipes were handed out before
+    int index = __builtin_ctz(pick);
+    PipeBook::setAllocation(index);
+    if(mPipeBook[index].mParked) {
+        mPipeBook[index].mParked = false;
+        logEvent(EV_REUSE, index);
+        mReuseCount++;
+        mPipeBook[index].mReuses++;
+    }
+    //If the pipe is not registered with any display OR if the pipe is
+    //requested again by the same display using it, then go ahead.
+    mPipeBook[index].mDisplay = dpy;
+    if(not mPipeBook[index].valid()) {
+        mPipeBook[index].mPipe = new GenericPipe(dpy);
+        mPipeBook[index].mCreates++;
+        logEvent(EV_SET, index);
+    }
+    updatePipeMask(index);
+
+    return (eDest)index;
 }
 
 bool Overlay::commit(utils::eDest dest) {
@@ -300,10 +377,18 @@ bool Overlay::commit(utils::eDest dest) {
     int index = (int)dest;
     validate(index);
 
+    if(mTxnDpy != PipeBook::DPY_UNUSED &&
+            mPipeBook[index].mDisplay == mTxnDpy) {
+        //Applied in endTransaction
+        mTxnPending |= (1 << index);
+        return true;
+    }
+
     if(mPipeBook[index].mPipe->commit()) {
         ret = true;
         PipeBook::setUse((int)dest);
     } else {
+        mPipeBook[index].mCommitFails++;
         PipeBook::resetUse((int)dest);
         int dpy = mPipeBook[index].mDisplay;
         for(int i = 0; i < PipeBook::NUM_PIPES; i++)
@@ -313,6 +398,84 @@ bool Overlay::commit(utils::eDest dest) {
     return ret;
 }
 
+void Overlay::beginTransaction(int dpy) {
+    OVASSERT(mTxnDpy == PipeBook::DPY_UNUSED,
+            "%s: transaction already open for dpy=%d", __FUNCTION__, mTxnDpy);
+    mTxnDpy = dpy;
+    mTxnPending = 0;
+}
+
+void Overlay::abortTransaction(int dpy) {
+    if(mTxnDpy != dpy)
+        return;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mTxnPending & (1 << i))
+            PipeBook::resetUse(i);
+        if(mPipeBook[i].mDisplay == dpy)
+            PipeBook::resetAllocation(i);
+    }
+    mTxnDpy = PipeBook::DPY_UNUSED;
+    mTxnPending = 0;
+    mTxnFailCount++;
+}
+
+bool Overlay::keepPipes(int dpy, int mask) {
+    if(!mask || mTxnDpy != PipeBook::DPY_UNUSED)
+        return false;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(!(mask & (1 << i)))
+            continue;
+        if(not mPipeBook[i].valid() || mPipeBook[i].mParked ||
+                mPipeBook[i].mDisplay != dpy || PipeBook::isAllocated(i)) {
+            ALOGD_IF(PIPE_DEBUG, "%s: pipe=%s can not be kept", __FUNCTION__,
+                    PipeBook::getDestStr((eDest)i));
+            return false;
+        }
+    }
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mask & (1 << i)) {
+            PipeBook::setAllocation(i);
+            PipeBook::setUse(i);
+        }
+    }
+    return true;
+}
+
+bool Overlay::endTransaction(int dpy) {
+    if(mTxnDpy != dpy) {
+        ALOGE("%s: no transaction open for dpy=%d", __FUNCTION__, dpy);
+        return false;
+    }
+
+    //Validate everything before the first ioctl, a frame that can not
+    //be shown costs nothing then.
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if((mTxnPending & (1 << i)) && !mPipeBook[i].mPipe->validate()) {
+            ALOGD_IF(PIPE_DEBUG, "%s: pipe=%s failed validation",
+                    __FUNCTION__, PipeBook::getDestStr((eDest)i));
+            abortTransaction(dpy);
+            return false;
+        }
+    }
+
+    //Pipes with an unchanged mdp_overlay skip the SET in MdpCtrl::set
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if((mTxnPending & (1 << i)) && !mPipeBook[i].mPipe->commit()) {
+            mPipeBook[i].mCommitFails++;
+            abortTransaction(dpy);
+            return false;
+        }
+    }
+
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mTxnPending & (1 << i))
+            PipeBook::setUse(i);
+    }
+    mTxnDpy = PipeBook::DPY_UNUSED;
+    mTxnPending = 0;
+    return true;
+}
+
 bool Overlay::queueBuffer(int fd, uint32_t offset,
         utils::eDest dest) {
     int index = (int)dest;
@@ -394,6 +557,7 @@ int Overlay::initOverlay() {
     for(int X = 0; X < (int)OV_MDP_PIPE_ANY; X++) { //iterate over types
         for(int j = 0; j < numPipesXType[X]; j++) { //iterate over num
             PipeBook::pipeTypeLUT[index] = (utils::eMdpPipeType)X;
+            PipeBook::sTypeMask[X] |= (1 << index);
             index++;
         }
     }
@@ -406,16 +570,17 @@ int Overlay::initOverlay() {
         for(int i = 0; i < NUM_FB_DEVICES; i++) {
             snprintf(name, 64, FB_DEVICE_TEMPLATE, i);
             ALOGD("initoverlay:: opening the device:: %s", name);
-            fd = ::open(name, O_RDWR, 0);
+            fd = mdp_wrapper::getBackend()->open(name, O_RDWR);
             if(fd < 0) {
                 ALOGE("cannot open framebuffer(%d)", i);
                 return -1;
             }
             //Get the mixer configuration */
             req.mixer_num = i;
-            if (ioctl(fd, MSMFB_MIXER_INFO, &req) == -1) {
+            if (mdp_wrapper::getBackend()->ioctl(fd, MSMFB_MIXER_INFO,
+                    &req) == -1) {
                 ALOGE("ERROR: MSMFB_MIXER_INFO ioctl failed");
-                close(fd);
+                mdp_wrapper::getBackend()->close(fd);
                 return -1;
             }
             minfo = req.info;
@@ -427,15 +592,15 @@ int Overlay::initOverlay() {
                         (minfo->z_order) != -1) {
                     int index = minfo->pndx;
                     ALOGD("Unset overlay with index: %d at mixer %d", index, i);
-                    if(ioctl(fd, MSMFB_OVERLAY_UNSET, &index) == -1) {
+                    if(!mdp_wrapper::unsetOverlay(fd, index)) {
                         ALOGE("ERROR: MSMFB_OVERLAY_UNSET failed");
-                        close(fd);
+                        mdp_wrapper::getBackend()->close(fd);
                         return -1;
                     }
                 }
                 minfo++;
             }
-            close(fd);
+            mdp_wrapper::getBackend()->close(fd);
             fd = -1;
         }
     }
@@ -443,32 +608,119 @@ int Overlay::initOverlay() {
 }
 
 void Overlay::dump() const {
-    if(strlen(mDumpStr)) { //dump only on state change
-        ALOGD_IF(PIPE_DEBUG, "%s\n", mDumpStr);
+    if(!PIPE_DEBUG)
+        return;
+    //Events of the current frame only, i.e. the state changes
+    uint32_t n = mEventCount < EVENT_RING ? mEventCount : EVENT_RING;
+    for(uint32_t i = mEventCount - n; i < mEventCount; i++) {
+        const PipeEvent& ev = mEvents[i % EVENT_RING];
+        if(ev.frame != mFrameCount)
+            continue;
+        ALOGD("%s pipe=%s dpy=%d", getEventStr(ev.type),
+                PipeBook::getDestStr((eDest)ev.pipe), ev.dpy);
     }
 }
 
+const char* Overlay::getEventStr(int type) {
+    switch(type) {
+        case EV_SET: return "Set";
+        case EV_PARK: return "Park";
+        case EV_REUSE: return "Reuse";
+        case EV_UNSET: return "Unset";
+        case EV_EVICT: return "Evict";
+        default: return "Invalid";
+    }
+    return "Invalid";
+}
+
 void Overlay::getDump(char *buf, size_t len) {
     int totalPipes = 0;
+    int parkedPipes = 0;
     const char *str = "\nOverlay State\n==========================\n";
-    strncat(buf, str, strlen(str));
+    strlcat(buf, str, len);
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
         if(mPipeBook[i].valid()) {
             mPipeBook[i].mPipe->getDump(buf, len);
             char str[64] = {'\0'};
-            snprintf(str, 64, "Attached to dpy=%d\n\n", mPipeBook[i].mDisplay);
-            strncat(buf, str, strlen(str));
-            totalPipes++;
+            if(mPipeBook[i].mParked) {
+                snprintf(str, 64, "Parked for dpy=%d since frame %u\n\n",
+                        mPipeBook[i].mDisplay, mPipeBook[i].mParkFrame);
+                parkedPipes++;
+            } else {
+                snprintf(str, 64, "Attached to dpy=%d\n\n",
+                        mPipeBook[i].mDisplay);
+                totalPipes++;
+            }
+            strlcat(buf, str, len);
         }
     }
-    char str_pipes[64] = {'\0'};
-    snprintf(str_pipes, 64, "Pipes used=%d\n\n", totalPipes);
-    strncat(buf, str_pipes, strlen(str_pipes));
+    char str_pipes[256] = {'\0'};
+    snprintf(str_pipes, 256, "Pipes used=%d parked=%d\n"
+            "Park window frames=%u ms=%u parks=%u reuses=%u evictions=%u\n"
+            "Last frame ioctls: set=%u (skipped %u) unset=%u play=%u "
+            "rot start=%u rotate=%u finish=%u\n"
+            "Failed transactions=%u\n\n",
+            totalPipes, parkedPipes, PipeBook::sParkFrames, PipeBook::sParkMs,
+            mParkCount, mReuseCount, mEvictCount,
+            mLastFrameIoctls.set, mLastFrameIoctls.skippedSet,
+            mLastFrameIoctls.unset, mLastFrameIoctls.play,
+            mLastFrameIoctls.rotStart, mLastFrameIoctls.rotate,
+            mLastFrameIoctls.rotFinish, mTxnFailCount);
+    strlcat(buf, str_pipes, len);
+
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        const PipeBook& pb = mPipeBook[i];
+        if(!pb.mCreates && !pb.mPipe)
+            continue;
+        char str[128] = {'\0'};
+        snprintf(str, 128, "Pipe %s created=%u parked=%u reused=%u "
+                "evicted=%u commit fails=%u\n", PipeBook::getDestStr((eDest)i),
+                pb.mCreates, pb.mParks, pb.mReuses, pb.mEvicts,
+                pb.mCommitFails);
+        strlcat(buf, str, len);
+    }
+
+    uint32_t n = mEventCount < EVENT_RING ? mEventCount : EVENT_RING;
+    if(n) {
+        strlcat(buf, "Recent pipe events:\n", len);
+    }
+    for(uint32_t i = mEventCount - n; i < mEventCount; i++) {
+        const PipeEvent& ev = mEvents[i % EVENT_RING];
+        char str[64] = {'\0'};
+        snprintf(str, 64, "  frame=%u %s pipe%d(%s) dpy=%d\n", ev.frame,
+                getEventStr(ev.type), ev.pipe,
+                PipeBook::getDestStr((eDest)ev.pipe), ev.dpy);
+        strlcat(buf, str, len);
+    }
+}
+
+void Overlay::resetStats() {
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].valid())
+            mPipeBook[i].mPipe->resetStats();
+        mPipeBook[i].mCreates = 0;
+        mPipeBook[i].mParks = 0;
+        mPipeBook[i].mReuses = 0;
+        mPipeBook[i].mEvicts = 0;
+        mPipeBook[i].mCommitFails = 0;
+    }
+    mParkCount = 0;
+    mReuseCount = 0;
+    mEvictCount = 0;
+    mTxnFailCount = 0;
 }
 
 void Overlay::PipeBook::init() {
     mPipe = NULL;
     mDisplay = DPY_UNUSED;
+    mParked = false;
+    mParkFrame = 0;
+    mParkTime = 0;
+    mCreates = 0;
+    mParks = 0;
+    mReuses = 0;
+    mEvicts = 0;
+    mCommitFails = 0;
 }
 
 void Overlay::PipeBook::destroy() {
@@ -477,6 +729,18 @@ void Overlay::PipeBook::destroy() {
         mPipe = NULL;
     }
     mDisplay = DPY_UNUSED;
+    mParked = false;
+}
+
+void Overlay::PipeBook::park(uint32_t frame, nsecs_t now) {
+    if(not mPipe->park()) {
+        //Could not detach cleanly, do not hold on to it
+        destroy();
+        return;
+    }
+    mParked = true;
+    mParkFrame = frame;
+    mParkTime = now;
 }
 
 Overlay* Overlay::sInstance = 0;
@@ -485,7 +749,10 @@ int Overlay::PipeBook::NUM_PIPES = 0;
 int Overlay::PipeBook::sPipeUsageBitmap = 0;
 int Overlay::PipeBook::sLastUsageBitmap = 0;
 int Overlay::PipeBook::sAllocatedBitmap = 0;
+uint32_t Overlay::PipeBook::sParkFrames = 5;
+uint32_t Overlay::PipeBook::sParkMs = 100;
 utils::eMdpPipeType Overlay::PipeBook::pipeTypeLUT[utils::OV_MAX] =
     {utils::OV_MDP_PIPE_ANY};
+int Overlay::PipeBook::sTypeMask[utils::OV_MDP_PIPE_ANY] = {0};
 
 }; // namespace overlay
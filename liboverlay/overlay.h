@@ -39,6 +39,8 @@
 namespace overlay {
 /**/
 #include "utils/threads.h"
+#include <utils/Timers.h>
+#include "mdpWrapper.h"
 
 namespace overlay {
 class GenericPipe;
@@ -101,8 +103,10 @@ private:
     void configBegin();
 
     /* Marks the end of config for this drawing round
-     * Will do garbage collection of pipe objects and thus calling UNSETs,
-     * closing FDs, removing rotator objects and memory, if allocated.
+     * Pipes not used in this round are UNSET and parked: the fds, rotator
+     * objects and memory are kept, so the same display can re-acquire them
+     * cheaply. Parked pipes that stay unused past the park window are garbage
+     * collected, closing FDs and removing rotator objects and memory.
      * Should be called after all pipe configs are done.
      */
     void configDone();
@@ -121,12 +125,32 @@ private:
     bool commit(utils::eDest dest);
     bool queueBuffer(int fd, uint32_t offset, utils::eDest dest);
 
+    /* Frame transaction for a display. Between beginTransaction and
+     * endTransaction, commit() on that display's pipes only stages them.
+     * endTransaction validates all staged pipes first, and only then issues
+     * the OVERLAY_SETs. If any pipe fails, none of the display's pipes is
+     * marked used, so configDone UNSETs whatever got programmed before the
+     * panel ever sees it. Returns false in that case.
+     * abortTransaction drops staged pipes, e.g. when a layer fails config.
+     */
+    void beginTransaction(int dpy);
+    bool endTransaction(int dpy);
+    void abortTransaction(int dpy);
+
+    /* Stages the pipes in mask (bits of eDest) again for a frame, with the
+     * configuration they already have. All must be open, not parked and
+     * last configured by dpy, else nothing is kept and false is returned.
+     */
+    bool keepPipes(int dpy, int mask);
+
     /* Closes open pipes, called during startup */
     static int initOverlay();
     /* Returns the singleton instance of overlay */
     static Overlay* getInstance();
     /* Returns available ("unallocated") pipes for a display */
     int availablePipes(int dpy);
+    /* Returns available pipes of one type for a display */
+    int availablePipes(int dpy, utils::eMdpPipeType type);
     /* set the framebuffer index for external display */
     void setExtFbNum(int fbNum);
     /* Returns framebuffer index of the current external display */
@@ -135,6 +159,12 @@ private:
      * to populate.
      */
     void getDump(char *buf, size_t len);
+    /* Clears the per pipe and overall counters reported in getDump */
+    void resetStats();
+    /* Evicts all parked pipes right away. Used when the pipes have to be
+     * given back for real, e.g. on blank.
+     */
+    void clear();
 
 private:
     /* Ctor setup */
@@ -142,6 +172,20 @@ private:
     /*Validate index range, abort if invalid */
     void validate(int index);
     void dump() const;
+    /* Pipe bookkeeping events. Recorded as is into a ring, formatted only
+     * when a dump is asked for */
+    enum { EV_SET, EV_PARK, EV_REUSE, EV_UNSET, EV_EVICT };
+    enum { EVENT_RING = 16 };
+    struct PipeEvent {
+        uint32_t frame;
+        uint8_t type;
+        int8_t pipe;
+        int8_t dpy;
+    };
+    void logEvent(int type, int index);
+    static const char* getEventStr(int type);
+    /* Syncs the display and parked bitmaps with the PipeBook of index */
+    void updatePipeMask(int index);
 
     /* Just like a Facebook for pipes, but much less profile info */
     struct PipeBook {
@@ -151,11 +195,27 @@ private:
         void destroy();
         /* Check if pipe exists and return true, false otherwise */
         bool valid();
+        /* UNSET the pipe but keep the object alive for mDisplay */
+        void park(uint32_t frame, nsecs_t now);
+        /* Whether a parked pipe has outlived the park window */
+        bool parkExpired(uint32_t frame, nsecs_t now) const;
 
         /* Hardware pipe wrapper */
         GenericPipe *mPipe;
         /* Display using this pipe. Refer to enums above */
         int mDisplay;
+        /* Pipe is detached from the mixer, waiting to be reused or evicted */
+        bool mParked;
+        /* Frame and time at which the pipe got parked */
+        uint32_t mParkFrame;
+        nsecs_t mParkTime;
+        /* Counters of this h/w pipe, kept across pipe objects so pipes
+         * being torn down and rebuilt every few frames stand out */
+        uint32_t mCreates;
+        uint32_t mParks;
+        uint32_t mReuses;
+        uint32_t mEvicts;
+        uint32_t mCommitFails;
 
         /* operations on bitmap */
         static bool pipeUsageUnchanged();
@@ -169,12 +229,20 @@ private:
         static void resetAllocation(int index);
         static bool isAllocated(int index);
         static bool isNotAllocated(int index);
+        /* Pipes of type, ANY for all, not allocated in this round */
+        static int getFreeMask(utils::eMdpPipeType type);
 
         static utils::eMdpPipeType getPipeType(utils::eDest dest);
         static const char* getDestStr(utils::eDest dest);
 
         static int NUM_PIPES;
         static utils::eMdpPipeType pipeTypeLUT[utils::OV_MAX];
+        /* Bitmap of the pipes of each type, built along with the LUT */
+        static int sTypeMask[utils::OV_MDP_PIPE_ANY];
+        /* Park window. A parked pipe is evicted once either limit is hit.
+         * 0 frames disables parking, 0 ms disables the time limit */
+        static uint32_t sParkFrames;
+        static uint32_t sParkMs;
 
 
     private:
@@ -193,8 +261,29 @@ private:
 
     PipeBook mPipeBook[utils::OV_INVALID]; //Used as max
 
-    /* Dump string */
-    char mDumpStr[256];
+    /* Frames seen by configDone, used to age parked pipes */
+    uint32_t mFrameCount;
+    /* Parking stats, reported in getDump */
+    uint32_t mParkCount;
+    uint32_t mReuseCount;
+    uint32_t mEvictCount;
+
+    /* Display with an open transaction, DPY_UNUSED if none */
+    int mTxnDpy;
+    /* Pipes staged in the open transaction */
+    int mTxnPending;
+    uint32_t mTxnFailCount;
+    /* ioctl counters at the start of this frame, and the last frame's diff */
+    mdp_wrapper::IoctlStats mFrameStartIoctls;
+    mdp_wrapper::IoctlStats mLastFrameIoctls;
+
+    /* Last EVENT_RING events, mEventCount % EVENT_RING is the next slot */
+    PipeEvent mEvents[EVENT_RING];
+    uint32_t mEventCount;
+    /* Pipes per mDisplay value, DPY_UNUSED holding the free ones, and the
+     * parked pipes. Turn nextPipe into a few mask operations */
+    int mDpyMask[PipeBook::DPY_UNUSED + 1];
+    int mParkedMask;
 
     /* Singleton Instance*/
     static Overlay *sInstance;
@@ -209,14 +298,33 @@ inline void Overlay::validate(int index) {
 }
 
 inline int Overlay::availablePipes(int dpy) {
-     int avail = 0;
-     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-       if((mPipeBook[i].mDisplay == PipeBook::DPY_UNUSED ||
-           mPipeBook[i].mDisplay == dpy) && PipeBook::isNotAllocated(i)) {
-                avail++;
-        }
+    return availablePipes(dpy, utils::OV_MDP_PIPE_ANY);
+}
+
+inline int Overlay::availablePipes(int dpy, utils::eMdpPipeType type) {
+    //Pipes parked by another display can be evicted on demand
+    return __builtin_popcount(PipeBook::getFreeMask(type) &
+            (mDpyMask[PipeBook::DPY_UNUSED] | mDpyMask[dpy] | mParkedMask));
+}
+
+inline void Overlay::logEvent(int type, int index) {
+    PipeEvent& ev = mEvents[mEventCount++ % EVENT_RING];
+    ev.frame = mFrameCount;
+    ev.type = (uint8_t)type;
+    ev.pipe = (int8_t)index;
+    ev.dpy = (int8_t)mPipeBook[index].mDisplay;
+}
+
+inline void Overlay::updatePipeMask(int index) {
+    const int bit = 1 << index;
+    for(int d = 0; d <= PipeBook::DPY_UNUSED; d++) {
+        mDpyMask[d] &= ~bit;
     }
-    return avail;
+    mDpyMask[mPipeBook[index].mDisplay] |= bit;
+    if(mPipeBook[index].mParked)
+        mParkedMask |= bit;
+    else
+        mParkedMask &= ~bit;
 }
 
 inline void Overlay::setExtFbNum(int fbNum) {
@@ -231,6 +339,13 @@ inline bool Overlay::PipeBook::valid() {
     return (mPipe != NULL);
 }
 
+inline bool Overlay::PipeBook::parkExpired(uint32_t frame,
+        nsecs_t now) const {
+    if(frame - mParkFrame >= sParkFrames)
+        return true;
+    return sParkMs && (ns2ms(now - mParkTime) >= (nsecs_t)sParkMs);
+}
+
 inline bool Overlay::PipeBook::pipeUsageUnchanged() {
     return (sPipeUsageBitmap == sLastUsageBitmap);
 }
@@ -271,6 +386,13 @@ inline bool Overlay::PipeBook::isNotAllocated(int index) {
     return !isAllocated(index);
 }
 
+inline int Overlay::PipeBook::getFreeMask(utils::eMdpPipeType type) {
+    int mask = (1 << NUM_PIPES) - 1;
+    if(type != utils::OV_MDP_PIPE_ANY)
+        mask &= sTypeMask[type];
+    return mask & ~sAllocatedBitmap;
+}
+
 inline utils::eMdpPipeType Overlay::PipeBook::getPipeType(utils::eDest dest) {
     return pipeTypeLUT[(int)dest];
 }
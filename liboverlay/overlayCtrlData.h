@@ -58,6 +58,10 @@ public:
     bool init(uint32_t fbnum);
     /* close underlying mdp */
     bool close();
+    /* detach from mixer, keep fd and cached params */
+    bool unset();
+    /* check cached params before commit */
+    bool validate() const;
 
     /* set source using whf, orient and wait flag */
     bool setSource(const utils::PipeArgs& args);
@@ -113,6 +117,8 @@ private:
     void dump() const;
     /* Return the dump in the specified buffer */
     void getDump(char *buf, size_t len);
+    /* Clear the ioctl counters */
+    void resetStats();
 
 private:
     // mdp ctrl struct(info e.g.)
@@ -161,6 +167,8 @@ public:
     void dump() const;
     /* Return the dump in the specified buffer */
     void getDump(char *buf, size_t len);
+    /* Clear the ioctl counters */
+    void resetStats();
 
 private:
     // mdp data struct
@@ -241,6 +249,14 @@ inline bool Ctrl::commit() {
     return true;
 }
 
+inline bool Ctrl::unset() {
+    return mMdp.unset();
+}
+
+inline bool Ctrl::validate() const {
+    return mMdp.validate();
+}
+
 inline int Ctrl::getPipeId() const {
     return mMdp.getPipeId();
 }
@@ -271,6 +287,10 @@ inline void Ctrl::getDump(char *buf, size_t len) {
     mMdp.getDump(buf, len);
 }
 
+inline void Ctrl::resetStats() {
+    mMdp.resetStats();
+}
+
 inline Data::Data() {
     mMdp.reset();
 }
@@ -310,6 +330,10 @@ inline void Data::dump() const {
 inline void Data::getDump(char *buf, size_t len) {
     mMdp.getDump(buf, len);
 }
+
+inline void Data::resetStats() {
+    mMdp.resetStats();
+}
 } // overlay
 
 #endif
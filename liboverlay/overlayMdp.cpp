@@ -85,9 +85,11 @@ bool MdpCtrl::setSource(const utils::PipeArgs& args) {
 bool MdpCtrl::close() {
     bool result = true;
     if(MSMFB_NEW_REQUEST != static_cast<int>(mOVInfo.id)) {
-        if(!mdp_wrapper::unsetOverlay(mFd.getFD(), mOVInfo.id)) {
+        nsecs_t start = systemTime();
+        result = mdp_wrapper::unsetOverlay(mFd.getFD(), mOVInfo.id);
+        mUnsetStats.add(start, result);
+        if(!result) {
             ALOGE("MdpCtrl close error in unset");
-            result = false;
         }
     }
 
@@ -100,6 +102,25 @@ bool MdpCtrl::close() {
     return result;
 }
 
+bool MdpCtrl::unset() {
+    bool result = true;
+    if(MSMFB_NEW_REQUEST != static_cast<int>(mOVInfo.id)) {
+        nsecs_t start = systemTime();
+        result = mdp_wrapper::unsetOverlay(mFd.getFD(), mOVInfo.id);
+        mUnsetStats.add(start, result);
+        if(!result) {
+            ALOGE("MdpCtrl unset error");
+        }
+    }
+
+    //Keep the cached params, but make the next set() a new request. Clearing
+    //the lkgo guarantees ovChanged() so the ioctl is not skipped.
+    mOVInfo.id = MSMFB_NEW_REQUEST;
+    utils::memset0(mLkgo);
+    mLkgo.id = MSMFB_NEW_REQUEST;
+    return result;
+}
+
 void MdpCtrl::setSource(const utils::PipeArgs& args) {
     setSrcWhf(args.whf);
 
@@ -207,7 +228,10 @@ bool MdpCtrl::set() {
     }
 
     if(this->ovChanged()) {
-        if(!mdp_wrapper::setOverlay(mFd.getFD(), mOVInfo)) {
+        nsecs_t start = systemTime();
+        bool ret = mdp_wrapper::setOverlay(mFd.getFD(), mOVInfo);
+        mSetStats.add(start, ret);
+        if(!ret) {
             ALOGE("MdpCtrl failed to setOverlay, restoring last known "
                   "good ov info");
             mdp_wrapper::dump("== Bad OVInfo is: ", mOVInfo);
@@ -216,6 +240,28 @@ bool MdpCtrl::set() {
             return false;
         }
         this->save();
+    } else {
+        mdp_wrapper::countIoctl(
+                mdp_wrapper::getIoctlStats().skippedSet);
+        mSkippedSets++;
+    }
+    return true;
+}
+
+bool MdpCtrl::validate() const {
+    if(!mOVInfo.src.width || !mOVInfo.src.height) {
+        ALOGE("%s: source not set", __FUNCTION__);
+        return false;
+    }
+    if(!mOVInfo.src_rect.w || !mOVInfo.src_rect.h ||
+            mOVInfo.src_rect.x + mOVInfo.src_rect.w > mOVInfo.src.width ||
+            mOVInfo.src_rect.y + mOVInfo.src_rect.h > mOVInfo.src.height) {
+        ALOGE("%s: crop outside of source", __FUNCTION__);
+        return false;
+    }
+    if(!mOVInfo.dst_rect.w || !mOVInfo.dst_rect.h) {
+        ALOGE("%s: empty destination", __FUNCTION__);
+        return false;
     }
     return true;
 }
@@ -279,6 +325,19 @@ void MdpCtrl::dump() const {
 
 void MdpCtrl::getDump(char *buf, size_t len) {
     ovutils::getDump(buf, len, "Ctrl(mdp_overlay)", mOVInfo);
+    ovutils::getDump(buf, len, "\tset", mSetStats);
+    ovutils::getDump(buf, len, "\tunset", mUnsetStats);
+    if(mSkippedSets) {
+        char str[64] = {'\0'};
+        snprintf(str, 64, "\tskipped sets=%u\n", mSkippedSets);
+        strlcat(buf, str, len);
+    }
+}
+
+void MdpCtrl::resetStats() {
+    mSetStats.reset();
+    mUnsetStats.reset();
+    mSkippedSets = 0;
 }
 
 void MdpData::dump() const {
@@ -290,6 +349,7 @@ void MdpData::dump() const {
 
 void MdpData::getDump(char *buf, size_t len) {
     ovutils::getDump(buf, len, "Data(msmfb_overlay_data)", mOvData);
+    ovutils::getDump(buf, len, "\tplay", mPlayStats);
 }
 
 void MdpCtrl3D::dump() const {
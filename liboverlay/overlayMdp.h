@@ -167,6 +167,11 @@ private:
     /* init underlying device using fbnum */
     bool init(uint32_t fbnum);
     /* unset overlay, reset and close fd */
+    /* unset overlay but keep the fd open, so the pipe can be set again
+     * with a fresh MSMFB_NEW_REQUEST without reopening the device */
+    bool unset();
+    /* sanity check the cached params, without calling into the driver */
+    bool validate() const;
     bool close();
     /* reset and set ov id to -1 / MSMFB_NEW_REQUEST */
     void reset();
@@ -195,6 +200,8 @@ private:
     void dump() const;
     /* Return the dump in the specified buffer */
     void getDump(char *buf, size_t len);
+    /* clear the set/unset counters */
+    void resetStats();
 
     /* returns session id */
     int getPipeId() const;
@@ -248,6 +255,10 @@ private:
     /* FD for the mdp fbnum */
     OvFD          mFd;
     int mDownscale;
+    /* OVERLAY_SET/UNSET counters, SETs skipped for an unchanged ov */
+    utils::OpStats mSetStats;
+    utils::OpStats mUnsetStats;
+    uint32_t mSkippedSets;
 };
 
 
@@ -332,6 +343,8 @@ public:
     void dump() const;
     /* Return the dump in the specified buffer */
     void getDump(char *buf, size_t len);
+    /* clear the play counters */
+    void resetStats();
 
 private:
 
@@ -340,6 +353,8 @@ private:
 
     /* fd to mdp fbnum */
     OvFD mFd;
+    /* OVERLAY_PLAY counters */
+    utils::OpStats mPlayStats;
 };
 
 //--------------Inlines---------------------------------
@@ -359,7 +374,7 @@ int compute(uint32_t x, uint32_t y, uint32_t z) {
 
 /////   MdpCtrl  //////
 
-inline MdpCtrl::MdpCtrl() {
+inline MdpCtrl::MdpCtrl() : mSkippedSets(0) {
     reset();
 }
 
@@ -602,7 +617,10 @@ inline int MdpData::getFd() const { return mFd.getFD(); }
 inline bool MdpData::play(int fd, uint32_t offset) {
     mOvData.data.memory_id = fd;
     mOvData.data.offset = offset;
-    if(!mdp_wrapper::play(mFd.getFD(), mOvData)){
+    nsecs_t start = systemTime();
+    bool ret = mdp_wrapper::play(mFd.getFD(), mOvData);
+    mPlayStats.add(start, ret);
+    if(!ret){
         ALOGE("MdpData failed to play");
         dump();
         return false;
@@ -610,6 +628,8 @@ inline bool MdpData::play(int fd, uint32_t offset) {
     return true;
 }
 
+inline void MdpData::resetStats() { mPlayStats.reset(); }
+
 } // overlay
 
 #endif // OVERLAY_MDP_H
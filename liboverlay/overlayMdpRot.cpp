@@ -118,8 +118,12 @@ void MdpRot::doTransform() {
 bool MdpRot::commit() {
     doTransform();
     if(rotConfChanged()) {
+        mConfigChanged = true;
         mRotImgInfo.enable = 1;
-        if(!overlay::mdp_wrapper::startRotator(mFd.getFD(), mRotImgInfo)) {
+        nsecs_t start = systemTime();
+        bool ret = overlay::mdp_wrapper::startRotator(mFd.getFD(), mRotImgInfo);
+        mCommitStats.add(start, ret);
+        if(!ret) {
             ALOGE("MdpRot commit failed");
             dump();
             mRotImgInfo.enable = 0;
@@ -143,7 +147,9 @@ bool MdpRot::open_i(uint32_t numbufs, uint32_t bufsz)
 
     OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
 
-    if(!mem.open(numbufs, bufsz, mRotImgInfo.secure)){
+    //Borrow from the shared pool, it falls back to a fresh allocation
+    if(!RotBufPool::getInstance()->get(mem, numbufs, bufsz,
+            mRotImgInfo.secure)){
         ALOGE("%s: Failed to open", __func__);
         mem.close();
         return false;
@@ -182,13 +188,15 @@ bool MdpRot::close() {
 bool MdpRot::remap(uint32_t numbufs) {
     // if current size changed, remap
     uint32_t opBufSize = calcOutputBufSize();
-    if(opBufSize == mMem.curr().size()) {
+    if(opBufSize == mMem.curr().size() &&
+            numbufs == mMem.curr().m.numBufs()) {
         ALOGE_IF(DEBUG_OVERLAY, "%s: same size %d", __FUNCTION__, opBufSize);
         return true;
     }
 
     ALOGE_IF(DEBUG_OVERLAY, "%s: size changed - remapping", __FUNCTION__);
     OVASSERT(!mMem.prev().valid(), "Prev should not be valid");
+    mRemapCount++;
 
     // ++mMem will make curr to be prev, and prev will be curr
     ++mMem;
@@ -215,10 +223,12 @@ void MdpRot::reset() {
 
 bool MdpRot::queueBuffer(int fd, uint32_t offset) {
     if(enabled()) {
+        if(skipRotate(fd, offset))
+            return true;
         mRotDataInfo.src.memory_id = fd;
         mRotDataInfo.src.offset = offset;
 
-        remap(RotMem::Mem::ROT_NUM_BUFS);
+        remap(mNumBufs);
         OVASSERT(mMem.curr().m.numBufs(),
                 "queueBuffer numbufs is 0");
         mRotDataInfo.dst.offset =
@@ -226,7 +236,10 @@ bool MdpRot::queueBuffer(int fd, uint32_t offset) {
         mMem.curr().mCurrOffset =
                 (mMem.curr().mCurrOffset + 1) % mMem.curr().m.numBufs();
 
-        if(!overlay::mdp_wrapper::rotate(mFd.getFD(), mRotDataInfo)) {
+        nsecs_t start = systemTime();
+        bool ret = overlay::mdp_wrapper::rotate(mFd.getFD(), mRotDataInfo);
+        mRotateStats.add(start, ret);
+        if(!ret) {
             ALOGE("MdpRot failed rotate");
             dump();
             return false;
@@ -246,6 +259,12 @@ bool MdpRot::queueBuffer(int fd, uint32_t offset) {
     return true;
 }
 
+bool MdpRot::prepare() {
+    if(!enabled())
+        return false;
+    return remap(mNumBufs);
+}
+
 void MdpRot::dump() const {
     ALOGE("== Dump MdpRot start ==");
     mFd.dump();
@@ -258,6 +277,7 @@ void MdpRot::dump() const {
 void MdpRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdpRotCtrl(msm_rotator_img_info)", mRotImgInfo);
     ovutils::getDump(buf, len, "MdpRotData(msm_rotator_data_info)", mRotDataInfo);
+    getStatsDump(buf, len);
 }
 
 } // namespace overlay
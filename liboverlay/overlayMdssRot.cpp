@@ -111,12 +111,19 @@ bool MdssRot::commit() {
     doTransform();
     mRotInfo.flags |= MDSS_MDP_ROT_ONLY;
     mEnabled = true;
-    if(!overlay::mdp_wrapper::setOverlay(mFd.getFD(), mRotInfo)) {
+    if(::memcmp(&mRotInfo, &mLSRotInfo, sizeof(mdp_overlay))) {
+        mConfigChanged = true;
+    }
+    nsecs_t start = systemTime();
+    bool ret = overlay::mdp_wrapper::setOverlay(mFd.getFD(), mRotInfo);
+    mCommitStats.add(start, ret);
+    if(!ret) {
         ALOGE("MdssRot commit failed!");
         dump();
         return (mEnabled = false);
     }
     mRotData.id = mRotInfo.id;
+    mLSRotInfo = mRotInfo;
     // reset rotation flags to avoid stale orientation values
     mRotInfo.flags &= ~MDSS_ROT_MASK;
     return true;
@@ -124,10 +131,12 @@ bool MdssRot::commit() {
 
 bool MdssRot::queueBuffer(int fd, uint32_t offset) {
     if(enabled()) {
+        if(skipRotate(fd, offset))
+            return true;
         mRotData.data.memory_id = fd;
         mRotData.data.offset = offset;
 
-        remap(RotMem::Mem::ROT_NUM_BUFS);
+        remap(mNumBufs);
         OVASSERT(mMem.curr().m.numBufs(), "queueBuffer numbufs is 0");
 
         mRotData.dst_data.offset =
@@ -135,7 +144,10 @@ bool MdssRot::queueBuffer(int fd, uint32_t offset) {
         mMem.curr().mCurrOffset =
                 (mMem.curr().mCurrOffset + 1) % mMem.curr().m.numBufs();
 
-        if(!overlay::mdp_wrapper::play(mFd.getFD(), mRotData)) {
+        nsecs_t start = systemTime();
+        bool ret = overlay::mdp_wrapper::play(mFd.getFD(), mRotData);
+        mRotateStats.add(start, ret);
+        if(!ret) {
             ALOGE("MdssRot play failed!");
             dump();
             return false;
@@ -161,7 +173,8 @@ bool MdssRot::open_i(uint32_t numbufs, uint32_t bufsz)
     OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
     bool isSecure = mRotInfo.flags & utils::OV_MDP_SECURE_OVERLAY_SESSION;
 
-    if(!mem.open(numbufs, bufsz, isSecure)){
+    //Borrow from the shared pool, it falls back to a fresh allocation
+    if(!RotBufPool::getInstance()->get(mem, numbufs, bufsz, isSecure)){
         ALOGE("%s: Failed to open", __func__);
         mem.close();
         return false;
@@ -180,13 +193,15 @@ bool MdssRot::remap(uint32_t numbufs) {
     // Calculate the size based on rotator's dst format, w and h.
     uint32_t opBufSize = calcOutputBufSize();
     // If current size changed, remap
-    if(opBufSize == mMem.curr().size()) {
+    if(opBufSize == mMem.curr().size() &&
+            numbufs == mMem.curr().m.numBufs()) {
         ALOGE_IF(DEBUG_OVERLAY, "%s: same size %d", __FUNCTION__, opBufSize);
         return true;
     }
 
     ALOGE_IF(DEBUG_OVERLAY, "%s: size changed - remapping", __FUNCTION__);
     OVASSERT(!mMem.prev().valid(), "Prev should not be valid");
+    mRemapCount++;
 
     // ++mMem will make curr to be prev, and prev will be curr
     ++mMem;
@@ -224,6 +239,7 @@ bool MdssRot::close() {
 
 void MdssRot::reset() {
     ovutils::memset0(mRotInfo);
+    ovutils::memset0(mLSRotInfo);
     ovutils::memset0(mRotData);
     mRotData.data.memory_id = -1;
     mRotInfo.id = MSMFB_NEW_REQUEST;
@@ -234,6 +250,12 @@ void MdssRot::reset() {
     mOrientation = utils::OVERLAY_TRANSFORM_0;
 }
 
+bool MdssRot::prepare() {
+    if(!enabled())
+        return false;
+    return remap(mNumBufs);
+}
+
 void MdssRot::dump() const {
     ALOGE("== Dump MdssRot start ==");
     mFd.dump();
@@ -259,6 +281,7 @@ uint32_t MdssRot::calcOutputBufSize() {
 void MdssRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdssRotCtrl(mdp_overlay)", mRotInfo);
     ovutils::getDump(buf, len, "MdssRotData(msmfb_overlay_data)", mRotData);
+    getStatsDump(buf, len);
 }
 
 } // namespace overlay
@@ -81,6 +81,16 @@ public:
     /* return number of bufs */
     uint32_t numBufs() const ;
 
+    /* return the size actually allocated, can exceed bufSz * numBufs */
+    uint32_t allocSz() const;
+
+    /* return true if allocated for a secure session */
+    bool isSecure() const;
+
+    /* Carve the allocation into numbufs of bufSz each, without reallocating.
+     * Fails if the layout does not fit */
+    bool reshape(uint32_t numbufs, uint32_t bufSz);
+
 private:
     /* actual os fd */
     int mFd;
@@ -97,6 +107,12 @@ private:
     /* num of bufs */
     uint32_t mNumBuffers;
 
+    /* size of the underlying allocation */
+    uint32_t mAllocSz;
+
+    /* allocated for a secure session */
+    bool mIsSecure;
+
     /* gralloc alloc controller */
     gralloc::IAllocController* mAlloc;
 };
@@ -112,6 +128,8 @@ inline OvMem::OvMem() {
     mAllocType = 0;
     mBufSz = 0;
     mNumBuffers = 0;
+    mAllocSz = 0;
+    mIsSecure = false;
     mAlloc = gralloc::IAllocController::getInstance();
 }
 
@@ -162,6 +180,8 @@ inline bool OvMem::open(uint32_t numbufs,
     mFd = data.fd;
     mBaseAddr = data.base;
     mAllocType = data.allocType;
+    mAllocSz = data.size;
+    mIsSecure = isSecure;
 
     return true;
 }
@@ -175,7 +195,7 @@ inline bool OvMem::close()
     }
 
     IMemAlloc* memalloc = mAlloc->getAllocator(mAllocType);
-    ret = memalloc->free_buffer(mBaseAddr, mBufSz * mNumBuffers, 0, mFd);
+    ret = memalloc->free_buffer(mBaseAddr, mAllocSz, 0, mFd);
     if (ret != 0) {
         ALOGE("OvMem: error freeing buffer");
         return false;
@@ -186,6 +206,8 @@ inline bool OvMem::close()
     mAllocType = 0;
     mBufSz = 0;
     mNumBuffers = 0;
+    mAllocSz = 0;
+    mIsSecure = false;
     return true;
 }
 
@@ -214,10 +236,32 @@ inline uint32_t OvMem::numBufs() const
     return mNumBuffers;
 }
 
+inline uint32_t OvMem::allocSz() const
+{
+    return mAllocSz;
+}
+
+inline bool OvMem::isSecure() const
+{
+    return mIsSecure;
+}
+
+inline bool OvMem::reshape(uint32_t numbufs, uint32_t bufSz)
+{
+    if(!valid() || (numbufs * bufSz) > mAllocSz) {
+        ALOGE("OvMem: cannot reshape %u to %u x %u", mAllocSz, numbufs, bufSz);
+        return false;
+    }
+    mNumBuffers = numbufs;
+    mBufSz = bufSz;
+    return true;
+}
+
 inline void OvMem::dump() const
 {
     ALOGE("== Dump OvMem start ==");
-    ALOGE("fd=%d addr=%p type=%d bufsz=%u", mFd, mBaseAddr, mAllocType, mBufSz);
+    ALOGE("fd=%d addr=%p type=%d bufsz=%u allocsz=%u", mFd, mBaseAddr,
+            mAllocType, mBufSz, mAllocSz);
     ALOGE("== Dump OvMem end ==");
 }
 
@@ -34,6 +34,10 @@
 #include "overlayRotator.h"
 #include "overlayUtils.h"
 
+#include <cutils/properties.h>
+#include <sync/sync.h>
+#include <sys/prctl.h>
+
 #include "mdp_version.h"
 #include "gr.h"
 
@@ -48,6 +52,23 @@ int IRotatorHw::getRotatorHwType() {
 
 //============Rotator=========================
 
+Rotator::Rotator() : mRemapCount(0), mNumBufs(RotMem::Mem::ROT_NUM_BUFS),
+        mConfigChanged(true), mFixedBufs(0), mLastSrcHandle(NULL),
+        mSrcHandle(NULL), mSrcChanged(false), mLastSrcFd(-1),
+        mLastSrcOffset(0), mSkipped(false), mStaticFrames(0),
+        mWindowFrames(0), mWindowStalls(0), mCalmWindows(0), mGrowCount(0),
+        mShrinkCount(0), mSkipCount(0), mPeakRingBytes(0) {
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.rotator.bufs", property, NULL) > 0) {
+        uint32_t bufs = atoi(property);
+        if(bufs >= RotMem::Mem::ROT_MIN_BUFS &&
+                bufs <= RotMem::Mem::ROT_MAX_BUFS) {
+            mFixedBufs = bufs;
+            mNumBufs = bufs;
+        }
+    }
+}
+
 Rotator::~Rotator() {}
 
 Rotator* Rotator::getRotator() {
@@ -71,6 +92,120 @@ uint32_t Rotator::calcOutputBufSize(const utils::Whf& destWhf) {
             destWhf.w, destWhf.h, halFormat, alW, alH);
 }
 
+void Rotator::resetStats() {
+    mCommitStats.reset();
+    mRotateStats.reset();
+    mRemapCount = 0;
+    mStallStats.reset();
+    mGrowCount = 0;
+    mShrinkCount = 0;
+    mSkipCount = 0;
+    mPeakRingBytes = 0;
+}
+
+void Rotator::setSrcBuffer(const void *handle, bool changed) {
+    mSrcHandle = handle;
+    mSrcChanged = changed;
+}
+
+bool Rotator::skipRotate(int fd, uint32_t offset) {
+    //A source never identified through setSrcBuffer is always rotated
+    const bool same = !mConfigChanged && !mSrcChanged && mSrcHandle &&
+            mSrcHandle == mLastSrcHandle && fd == mLastSrcFd &&
+            offset == mLastSrcOffset;
+    mLastSrcHandle = mSrcHandle;
+    mLastSrcFd = fd;
+    mLastSrcOffset = offset;
+    mConfigChanged = false;
+    mSrcHandle = NULL;
+    mSrcChanged = false;
+    mSkipped = false;
+
+    if(!same) {
+        mStaticFrames = 0;
+        //New content, a single buffer would be written while on screen
+        if(!mFixedBufs && mNumBufs < RotMem::Mem::ROT_NUM_BUFS) {
+            mNumBufs = RotMem::Mem::ROT_NUM_BUFS;
+            mGrowCount++;
+        }
+        return false;
+    }
+
+    //The only buffer already holds this source, rotated. Nothing to do.
+    if(mNumBufs == RotMem::Mem::ROT_MIN_BUFS &&
+            mMem.curr().m.numBufs() == RotMem::Mem::ROT_MIN_BUFS) {
+        mSkipped = true;
+        mSkipCount++;
+        return true;
+    }
+
+    //Paused video and the like. The next rotate goes into a new single
+    //buffer, which is not on screen, and later frames are skipped.
+    if(!mFixedBufs && mNumBufs > RotMem::Mem::ROT_MIN_BUFS &&
+            ++mStaticFrames >= RING_STATIC_FRAMES) {
+        mNumBufs = RotMem::Mem::ROT_MIN_BUFS;
+        mShrinkCount++;
+    }
+    return false;
+}
+
+void Rotator::setReleaseFd(const int& fence) {
+    //A skipped frame did not write its buffer, no need to wait for it
+    nsecs_t stall = mMem.setReleaseFd(fence, !mSkipped);
+    if(stall) {
+        mStallStats.addUs((uint32_t)ns2us(stall), true);
+    }
+    uint32_t bytes = mMem.curr().m.numBufs() * mMem.curr().size();
+    if(bytes > mPeakRingBytes) {
+        mPeakRingBytes = bytes;
+    }
+    if(!mSkipped) {
+        adaptRing(stall != 0);
+    }
+}
+
+void Rotator::adaptRing(bool stalled) {
+    if(mFixedBufs || mNumBufs == RotMem::Mem::ROT_MIN_BUFS)
+        return;
+    mWindowFrames++;
+    if(stalled)
+        mWindowStalls++;
+    if(mWindowFrames < RING_WINDOW)
+        return;
+
+    //The display holds on to our buffers longer than the ring covers,
+    //e.g. external or wfd retiring late. One more buffer hides it.
+    if(mWindowStalls >= RING_GROW_STALLS) {
+        mCalmWindows = 0;
+        if(mNumBufs < RotMem::Mem::ROT_MAX_BUFS) {
+            mNumBufs++;
+            mGrowCount++;
+        }
+    } else if(mWindowStalls) {
+        mCalmWindows = 0;
+    } else if(mNumBufs > RotMem::Mem::ROT_NUM_BUFS &&
+            ++mCalmWindows >= RING_CALM_WINDOWS) {
+        mCalmWindows = 0;
+        mNumBufs--;
+        mShrinkCount++;
+    }
+    mWindowFrames = 0;
+    mWindowStalls = 0;
+}
+
+void Rotator::getStatsDump(char *buf, size_t len) const {
+    ovutils::getDump(buf, len, "\tsession", mCommitStats);
+    ovutils::getDump(buf, len, "\trotate", mRotateStats);
+    ovutils::getDump(buf, len, "\trelease stall", mStallStats);
+    char str[128] = {'\0'};
+    snprintf(str, 128, "\tring bufs=%u%s bytes=%u peak=%u remaps=%u "
+            "grows=%u shrinks=%u skipped=%u\n", mNumBufs,
+            mFixedBufs ? "(fixed)" : "",
+            mMem.curr().m.numBufs() * mMem.curr().size(), mPeakRingBytes,
+            mRemapCount, mGrowCount, mShrinkCount, mSkipCount);
+    strlcat(buf, str, len);
+}
+
 int Rotator::getRotatorHwType() {
     int mdpVersion = qdutils::MDPVersion::getInstance().getMDPVersion();
     if (mdpVersion == qdutils::MDSS_V5)
@@ -289,34 +424,233 @@ void MdpRot::dump() const {
 }
 RotMem::Mem::Mem() : mCurrOffset(0) {
     utils::memset0(mRotOffset);
-    for(int i = 0; i < ROT_NUM_BUFS; i++) {
+    for(int i = 0; i < ROT_MAX_BUFS; i++) {
         mRelFence[i] = -1;
     }
 }
 
 RotMem::Mem::~Mem() {
-    for(int i = 0; i < ROT_NUM_BUFS; i++) {
+    for(int i = 0; i < ROT_MAX_BUFS; i++) {
         ::close(mRelFence[i]);
         mRelFence[i] = -1;
     }
 }
 
-void RotMem::Mem::setReleaseFd(const int& fence) {
-    int ret = 0;
+bool RotMem::Mem::close() {
+    if(!m.valid()) {
+        return true;
+    }
+    bool ret = RotBufPool::getInstance()->put(m, mRelFence, ROT_MAX_BUFS);
+    utils::memset0(mRotOffset);
+    mCurrOffset = 0;
+    return ret;
+}
+
+nsecs_t RotMem::Mem::setReleaseFd(const int& fence, bool wait) {
+    nsecs_t stall = 0;
 
     if(mRelFence[mCurrOffset] >= 0) {
         //Wait for previous usage of this buffer to be over.
         //Can happen if rotation takes > vsync and a fast producer. i.e queue
         //happens in subsequent vsyncs either because content is 60fps or
         //because the producer is hasty sometimes.
-        ret = sync_wait(mRelFence[mCurrOffset], 1000);
-        if(ret < 0) {
-            ALOGE("%s: sync_wait error!! error no = %d err str = %s",
-                __FUNCTION__, errno, strerror(errno));
+        if(wait && sync_wait(mRelFence[mCurrOffset], 0) < 0) {
+            nsecs_t start = systemTime();
+            if(sync_wait(mRelFence[mCurrOffset], 1000) < 0) {
+                ALOGE("%s: sync_wait error!! error no = %d err str = %s",
+                    __FUNCTION__, errno, strerror(errno));
+            }
+            stall = systemTime() - start;
+            if(!stall)
+                stall = 1;
         }
         ::close(mRelFence[mCurrOffset]);
     }
     mRelFence[mCurrOffset] = fence;
+    return stall;
+}
+
+//============RotBufPool=====================
+
+RotBufPool *RotBufPool::sInstance = 0;
+
+RotBufPool* RotBufPool::getInstance() {
+    if(sInstance == NULL) {
+        sInstance = new RotBufPool();
+    }
+    return sInstance;
+}
+
+RotBufPool::RotBufPool() : mNumEntries(0), mPooledBytes(0),
+        mCapBytes(24 << 20), mIdleFrames(60), mHits(0), mMisses(0),
+        mTrims(0), mDrops(0), mBusy(0) {
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.rotator.pool.mb", property, NULL) > 0) {
+        //0 disables the pool; the cap is kept well below 4GB
+        int mb = atoi(property);
+        if(mb > 1024)
+            mb = 1024;
+        if(mb >= 0)
+            mCapBytes = (uint32_t)mb << 20;
+    }
+    if(property_get("debug.rotator.pool.idle", property, NULL) > 0) {
+        mIdleFrames = atoi(property);
+    }
+}
+
+uint32_t RotBufPool::sizeClass(uint32_t size) {
+    const uint32_t page = getpagesize();
+    size = utils::alignup(size, page);
+    //Highest power of 2 not above size, then round up in quarters of it.
+    //Keeps the waste under 25% while letting close sizes share buffers.
+    uint32_t step = (1U << (31 - __builtin_clz(size))) >> 2;
+    if(step < page)
+        step = page;
+    return utils::alignup(size, step);
+}
+
+bool RotBufPool::isIdle(const Entry& e) {
+    for(int j = 0; j < RotMem::Mem::ROT_MAX_BUFS; j++) {
+        if(e.relFence[j] >= 0 && sync_wait(e.relFence[j], 0) < 0)
+            return false;
+    }
+    return true;
+}
+
+bool RotBufPool::get(OvMem& mem, uint32_t numbufs, uint32_t bufSz,
+        bool isSecure) {
+    const uint32_t cls = sizeClass(numbufs * bufSz);
+    Entry taken;
+    bool hit = false;
+    {
+        android::Mutex::Autolock _l(mLock);
+        for(uint32_t i = 0; i < mNumEntries; i++) {
+            Entry& e = mEntry[i];
+            if(e.secure != isSecure || e.mem.allocSz() != cls)
+                continue;
+            //The previous owner may still have the buffer on screen, a
+            //fresh allocation beats waiting for it
+            if(!isIdle(e)) {
+                mBusy++;
+                continue;
+            }
+            takeEntry(i, taken);
+            hit = true;
+            mHits++;
+            break;
+        }
+        if(!hit)
+            mMisses++;
+    }
+
+    if(hit) {
+        //Signaled already, only the fds are left to close
+        for(int j = 0; j < RotMem::Mem::ROT_MAX_BUFS; j++) {
+            if(taken.relFence[j] >= 0)
+                ::close(taken.relFence[j]);
+        }
+        mem = taken.mem;
+        return mem.reshape(numbufs, bufSz);
+    }
+
+    if(!mem.open(1, cls, isSecure)) {
+        //Memory is tight, give back what is cached and retry once
+        clear();
+        if(!mem.open(1, cls, isSecure)) {
+            return false;
+        }
+    }
+    return mem.reshape(numbufs, bufSz);
+}
+
+bool RotBufPool::put(OvMem& mem, int *relFence, uint32_t numFences) {
+    const uint32_t size = mem.allocSz();
+    {
+        android::Mutex::Autolock _l(mLock);
+        if(mNumEntries < MAX_POOL_BUFS && mPooledBytes + size <= mCapBytes) {
+            Entry& e = mEntry[mNumEntries++];
+            e.mem = mem;
+            e.secure = mem.isSecure();
+            e.idleFrames = 0;
+            for(int j = 0; j < RotMem::Mem::ROT_MAX_BUFS; j++) {
+                e.relFence[j] = -1;
+                if((uint32_t)j < numFences) {
+                    e.relFence[j] = relFence[j];
+                    relFence[j] = -1;
+                }
+            }
+            mPooledBytes += size;
+            mem = OvMem();
+            return true;
+        }
+        mDrops++;
+    }
+
+    for(uint32_t j = 0; j < numFences; j++) {
+        if(relFence[j] >= 0) {
+            ::close(relFence[j]);
+            relFence[j] = -1;
+        }
+    }
+    return mem.close();
+}
+
+void RotBufPool::takeEntry(uint32_t index, Entry& out) {
+    out = mEntry[index];
+    mPooledBytes -= out.mem.allocSz();
+    mEntry[index] = mEntry[--mNumEntries];
+}
+
+void RotBufPool::freeEntry(Entry& e) {
+    for(int j = 0; j < RotMem::Mem::ROT_MAX_BUFS; j++) {
+        if(e.relFence[j] >= 0) {
+            ::close(e.relFence[j]);
+            e.relFence[j] = -1;
+        }
+    }
+    if(!e.mem.close()) {
+        ALOGE("%s error in closing pooled rot mem", __FUNCTION__);
+    }
+}
+
+void RotBufPool::tick() {
+    Entry expired[MAX_POOL_BUFS];
+    uint32_t count = 0;
+    {
+        android::Mutex::Autolock _l(mLock);
+        for(uint32_t i = mNumEntries; i > 0; i--) {
+            if(++mEntry[i - 1].idleFrames > mIdleFrames) {
+                takeEntry(i - 1, expired[count++]);
+                mTrims++;
+            }
+        }
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        freeEntry(expired[i]);
+    }
+}
+
+void RotBufPool::clear() {
+    Entry all[MAX_POOL_BUFS];
+    uint32_t count = 0;
+    {
+        android::Mutex::Autolock _l(mLock);
+        while(mNumEntries) {
+            takeEntry(mNumEntries - 1, all[count++]);
+        }
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        freeEntry(all[i]);
+    }
+}
+
+void RotBufPool::getDump(char *buf, size_t len) {
+    android::Mutex::Autolock _l(mLock);
+    char str[128] = {'\0'};
+    snprintf(str, 128, "RotBufPool bufs=%u bytes=%u cap=%u hits=%u "
+            "misses=%u busy=%u trims=%u drops=%u\n", mNumEntries,
+            mPooledBytes, mCapBytes, mHits, mMisses, mBusy, mTrims, mDrops);
+    strlcat(buf, str, len);
 }
 
 //============RotMgr=========================
@@ -327,9 +661,27 @@ RotMgr::RotMgr() {
     }
     mUseCount = 0;
     mRotDevFd = -1;
+    mNumPending = 0;
+    mNumWarm = 0;
+    mHaveLastKey = false;
+    mGeneration = 0;
+    mThreadStarted = false;
+    mExit = false;
+    mWarmRequests = 0;
+    mWarmed = 0;
+    mAdopted = 0;
+    mExpired = 0;
+    mWarmFailed = 0;
 }
 
 RotMgr::~RotMgr() {
+    if(mThreadStarted) {
+        mWarmLock.lock();
+        mExit = true;
+        mWarmCond.signal();
+        mWarmLock.unlock();
+        pthread_join(mThread, NULL);
+    }
     clear();
 }
 
@@ -340,12 +692,34 @@ void RotMgr::configBegin() {
 
 void RotMgr::configDone() {
     //Remove the top most unused objects. Videos come and go.
+    //Their memory goes back to the buffer pool.
     for(int i = mUseCount; i < MAX_ROT_SESS; i++) {
         if(mRot[i]) {
             delete mRot[i];
             mRot[i] = 0;
         }
     }
+
+    //Age the warm sessions, nobody asked for the oldest ones
+    Rotator *expired[MAX_ROT_SESS];
+    int numExpired = 0;
+    mWarmLock.lock();
+    for(int i = 0; i < mNumWarm;) {
+        if(++mWarm[i].age < PREWARM_EXPIRE_FRAMES) {
+            i++;
+            continue;
+        }
+        expired[numExpired++] = mWarm[i].rot;
+        for(int j = i; j < mNumWarm - 1; j++)
+            mWarm[j] = mWarm[j + 1];
+        mNumWarm--;
+        mExpired++;
+    }
+    mWarmLock.unlock();
+    for(int i = 0; i < numExpired; i++)
+        delete expired[i];
+
+    RotBufPool::getInstance()->tick();
 }
 
 Rotator* RotMgr::getNext() {
@@ -361,6 +735,165 @@ Rotator* RotMgr::getNext() {
     return rot;
 }
 
+Rotator* RotMgr::getNext(const utils::Whf& whf,
+        const utils::eMdpFlags& flags, const utils::eTransform& orient,
+        const int& downscale) {
+    if(mUseCount < MAX_ROT_SESS && mRot[mUseCount] == NULL)
+        mRot[mUseCount] = adoptWarm(makeKey(whf, flags, orient, downscale));
+    return getNext();
+}
+
+//The caller's flags also carry pipe and blending bits the prewarm cannot
+//know. The session itself only depends on the secure bit, the rest is
+//applied when the adopted rotator is configured.
+RotMgr::WarmKey RotMgr::makeKey(const utils::Whf& whf,
+        const utils::eMdpFlags& flags, const utils::eTransform& orient,
+        const int& downscale) {
+    WarmKey key;
+    key.whf = whf;
+    key.flags = utils::OV_MDP_FLAGS_NONE;
+    if(flags & utils::OV_MDP_SECURE_OVERLAY_SESSION)
+        utils::setMdpFlags(key.flags, utils::OV_MDP_SECURE_OVERLAY_SESSION);
+    key.orient = orient;
+    key.downscale = downscale;
+    return key;
+}
+
+bool RotMgr::prewarm(const utils::Whf& whf, const utils::eMdpFlags& flags,
+        const utils::eTransform& orient, const int& downscale) {
+    WarmKey key = makeKey(whf, flags, orient, downscale);
+    {
+        android::Mutex::Autolock _l(mWarmLock);
+        mLastKey = key;
+        mHaveLastKey = true;
+    }
+    return queuePrewarm(key);
+}
+
+bool RotMgr::prewarmSecure() {
+    WarmKey key;
+    {
+        android::Mutex::Autolock _l(mWarmLock);
+        if(!mHaveLastKey)
+            return false;
+        key = mLastKey;
+    }
+    utils::setMdpFlags(key.flags, utils::OV_MDP_SECURE_OVERLAY_SESSION);
+    return queuePrewarm(key);
+}
+
+bool RotMgr::queuePrewarm(const WarmKey& key) {
+    android::Mutex::Autolock _l(mWarmLock);
+    for(int i = 0; i < mNumPending; i++) {
+        if(mPending[i] == key)
+            return false;
+    }
+    for(int i = 0; i < mNumWarm; i++) {
+        if(mWarm[i].key == key)
+            return false;
+    }
+    if(mNumPending + mNumWarm >= MAX_ROT_SESS) {
+        ALOGD_IF(DEBUG_OVERLAY, "%s: no room for more sessions", __func__);
+        return false;
+    }
+
+    if(!mThreadStarted) {
+        if(pthread_create(&mThread, NULL, prewarmThread, this)) {
+            ALOGE("%s: failed to start the prewarm thread", __func__);
+            return false;
+        }
+        mThreadStarted = true;
+    }
+    mPending[mNumPending++] = key;
+    mWarmRequests++;
+    mWarmCond.signal();
+    return true;
+}
+
+void *RotMgr::prewarmThread(void *arg) {
+    prctl(PR_SET_NAME, (unsigned long) "RotPrewarm", 0, 0, 0);
+    static_cast<RotMgr*>(arg)->prewarmLoop();
+    return NULL;
+}
+
+void RotMgr::prewarmLoop() {
+    mWarmLock.lock();
+    while(!mExit) {
+        if(mNumPending == 0) {
+            mWarmCond.wait(mWarmLock);
+            continue;
+        }
+        WarmKey key = mPending[0];
+        uint32_t gen = mGeneration;
+        mWarmLock.unlock();
+
+        //Same steps hwc takes for a new rotator, minus the buffer
+        Rotator *rot = Rotator::getRotator();
+        bool ok = (rot != NULL);
+        if(ok) {
+            rot->setSource(key.whf);
+            rot->setFlags(key.flags);
+            rot->setTransform(key.orient);
+            rot->setDownscale(key.downscale);
+            ok = rot->commit() && rot->prepare();
+        }
+
+        mWarmLock.lock();
+        if(gen == mGeneration && mNumPending) {
+            for(int i = 0; i < mNumPending - 1; i++)
+                mPending[i] = mPending[i + 1];
+            mNumPending--;
+        }
+        if(!ok) {
+            mWarmFailed++;
+        } else if(gen == mGeneration && !mExit &&
+                mNumWarm < MAX_ROT_SESS) {
+            mWarm[mNumWarm].key = key;
+            mWarm[mNumWarm].rot = rot;
+            mWarm[mNumWarm].age = 0;
+            mNumWarm++;
+            mWarmed++;
+            rot = NULL;
+        }
+        if(rot) {
+            //Failed, or dropped by a clear() while it was being built
+            mWarmLock.unlock();
+            delete rot;
+            mWarmLock.lock();
+        }
+    }
+    mWarmLock.unlock();
+}
+
+Rotator* RotMgr::adoptWarm(const WarmKey& key) {
+    android::Mutex::Autolock _l(mWarmLock);
+    for(int i = 0; i < mNumWarm; i++) {
+        if(!(mWarm[i].key == key))
+            continue;
+        Rotator *rot = mWarm[i].rot;
+        for(int j = i; j < mNumWarm - 1; j++)
+            mWarm[j] = mWarm[j + 1];
+        mNumWarm--;
+        mAdopted++;
+        return rot;
+    }
+    return NULL;
+}
+
+void RotMgr::dropWarm() {
+    Rotator *drop[MAX_ROT_SESS];
+    int numDrop = 0;
+    mWarmLock.lock();
+    mGeneration++;
+    mNumPending = 0;
+    for(int i = 0; i < mNumWarm; i++)
+        drop[numDrop++] = mWarm[i].rot;
+    mNumWarm = 0;
+    mWarmLock.unlock();
+    for(int i = 0; i < numDrop; i++)
+        delete drop[i];
+}
+
 void RotMgr::clear() {
     //Brute force obj destruction, helpful in suspend.
     for(int i = 0; i < MAX_ROT_SESS; i++) {
@@ -370,7 +903,10 @@ void RotMgr::clear() {
         }
     }
     mUseCount = 0;
-    ::close(mRotDevFd);
+    dropWarm();
+    RotBufPool::getInstance()->clear();
+    if(mRotDevFd >= 0)
+        mdp_wrapper::getBackend()->close(mRotDevFd);
     mRotDevFd = -1;
 }
 
@@ -380,15 +916,39 @@ void RotMgr::getDump(char *buf, size_t len) {
             mRot[i]->getDump(buf, len);
         }
     }
-    char str[32] = {'\0'};
-    snprintf(str, 32, "\n================\n");
-    strncat(buf, str, strlen(str));
+    RotBufPool::getInstance()->getDump(buf, len);
+    char str[128] = {'\0'};
+    mWarmLock.lock();
+    snprintf(str, 128, "RotMgr prewarm requested=%u warmed=%u adopted=%u "
+            "expired=%u failed=%u warm=%d\n", mWarmRequests, mWarmed,
+            mAdopted, mExpired, mWarmFailed, mNumWarm);
+    mWarmLock.unlock();
+    strlcat(buf, str, len);
+    snprintf(str, 128, "\n================\n");
+    strlcat(buf, str, len);
+}
+
+void RotMgr::resetStats() {
+    for(int i = 0; i < MAX_ROT_SESS; i++) {
+        if(mRot[i]) {
+            mRot[i]->resetStats();
+        }
+    }
+    mWarmLock.lock();
+    mWarmRequests = 0;
+    mWarmed = 0;
+    mAdopted = 0;
+    mExpired = 0;
+    mWarmFailed = 0;
+    mWarmLock.unlock();
 }
 
 int RotMgr::getRotDevFd() {
+    android::Mutex::Autolock _l(mDevLock);
     //2nd check just in case
     if(mRotDevFd < 0 && Rotator::getRotatorHwType() == Rotator::TYPE_MDP) {
-        mRotDevFd = ::open("/dev/msm_rotator", O_RDWR, 0);
+        mRotDevFd = mdp_wrapper::getBackend()->open("/dev/msm_rotator",
+                O_RDWR);
         if(mRotDevFd < 0) {
             ALOGE("%s failed to open rotator device", __FUNCTION__);
         }
@@ -34,6 +34,7 @@
 #define OVERlAY_ROTATOR_H
 
 #include <stdlib.h>
+#include <utils/threads.h>
 
 #include "mdpWrapper.h"
 #include "overlayUtils.h"
@@ -191,14 +192,19 @@ struct RotMem {
         Mem();
         ~Mem();
         bool valid() { return m.valid(); }
-        bool close() { return m.close(); }
+        /* Hands the memory back to the RotBufPool */
+        bool close();
         uint32_t size() const { return m.bufSz(); }
-        void setReleaseFd(const int& fence);                       
-        // Max rotator buffers
-        enum { ROT_NUM_BUFS = 2 };
+        /* Stores the release fence of the current slot. If wait is set and
+         * the fence the slot held is still pending, waits for it first.
+         * Returns how long that wait took, 0 if it did not wait */
+        nsecs_t setReleaseFd(const int& fence, bool wait);
+        // Rotator buffers per session. ROT_NUM_BUFS is the default, the
+        // ring adapts between ROT_MIN_BUFS and ROT_MAX_BUFS
+        enum { ROT_MIN_BUFS = 1, ROT_NUM_BUFS = 2, ROT_MAX_BUFS = 3 };
         // rotator data info dst offset
-        uint32_t mRotOffset[ROT_NUM_BUFS];
-        int mRelFence[ROT_NUM_BUFS];
+        uint32_t mRotOffset[ROT_MAX_BUFS];
+        int mRelFence[ROT_MAX_BUFS];
         // current offset slot from mRotOffset
         uint32_t mCurrOffset;
         OvMem m;
@@ -209,12 +215,71 @@ struct RotMem {
     const Mem& curr() const { return m[_curr % MAX_ROT_MEM]; }
     Mem& prev() { return m[(_curr+1) % MAX_ROT_MEM]; }
     RotMem& operator++() { ++_curr; return *this; }
-    void setReleaseFd(const int& fence) { curr().setReleaseFd(fence); }
+    nsecs_t setReleaseFd(const int& fence, bool wait) {
+        return curr().setReleaseFd(fence, wait);
+    }
     bool close();
     uint32_t _curr;
     Mem m[MAX_ROT_MEM];
 };
 
+/*
+ * Pool of rotator output buffers shared by all rotator sessions. Buffers are
+ * allocated in size classes (power of 2 in quarter steps), so a session whose
+ * output size changes can usually pick up a buffer another session returned,
+ * instead of hitting ION on the composition thread.
+ * The pool holds at most mCapBytes, buffers idle for mIdleFrames are trimmed.
+ */
+class RotBufPool {
+public:
+    enum { MAX_POOL_BUFS = 8 };
+    static RotBufPool* getInstance();
+    /* Hands out a buffer of at least numbufs * bufSz, reusing a pooled one of
+     * the same size class if possible */
+    bool get(OvMem& mem, uint32_t numbufs, uint32_t bufSz, bool isSecure);
+    /* Takes back mem and the pending release fences. mem is invalid after */
+    bool put(OvMem& mem, int *relFence, uint32_t numFences);
+    /* Ages pooled buffers, frees the ones idle for too long. Once a frame */
+    void tick();
+    /* Frees all pooled buffers */
+    void clear();
+    void getDump(char *buf, size_t len);
+
+private:
+    struct Entry {
+        OvMem mem;
+        bool secure;
+        uint32_t idleFrames;
+        int relFence[RotMem::Mem::ROT_MAX_BUFS];
+    };
+
+    RotBufPool();
+    static uint32_t sizeClass(uint32_t size);
+    /* Moves an entry out of the pool, with mLock held */
+    void takeEntry(uint32_t index, Entry& out);
+    /* Closes the fences and frees the memory of a taken entry. Called
+     * without mLock, ION frees are not cheap */
+    static void freeEntry(Entry& e);
+    /* All release fences of the entry signaled, with mLock held */
+    static bool isIdle(const Entry& e);
+    Entry mEntry[MAX_POOL_BUFS];
+    uint32_t mNumEntries;
+    uint32_t mPooledBytes;
+    /* Tunables, debug.rotator.pool.mb and debug.rotator.pool.idle */
+    uint32_t mCapBytes;
+    uint32_t mIdleFrames;
+    /* Stats */
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mTrims;
+    uint32_t mDrops;
+    uint32_t mBusy; //pooled buffers passed over, still on screen
+    /* Guards the entries only, no waits or ION calls are made under it */
+    android::Mutex mLock;
+
+    static RotBufPool *sInstance;
+};
+
 =======
 class Rotator
 {
@@ -231,20 +296,74 @@ public:
     virtual uint32_t getDstFormat() const = 0;
     virtual uint32_t getSessId() const = 0;
     virtual bool queueBuffer(int fd, uint32_t offset) = 0;
+    /* Identifies the source of the next queueBuffer beyond its fd and
+     * offset, which are reused once a buffer is freed: the buffer handle,
+     * and whether the caller saw new content or geometry under it since the
+     * last frame. Either one changing rotates again. */
+    void setSrcBuffer(const void *handle, bool changed);
+    /* Maps the output buffers for the committed config ahead of the first
+     * queueBuffer */
+    virtual bool prepare() = 0;
     virtual void dump() const = 0;
     virtual void getDump(char *buf, size_t len) const = 0;
-    void setReleaseFd(const int& fence) { mMem.setReleaseFd(fence); }
+    /* Stores the release fence of the buffer just rotated into and adapts
+     * the ring depth to how often the rotator had to wait for the display */
+    void setReleaseFd(const int& fence);
+    /* Clears the session and rotate counters */
+    void resetStats();
     static Rotator *getRotator();
 
 protected:
     /* Rotator memory manager */
     RotMem mMem;
-    explicit Rotator() {}
+    /* Session config (START / rot only SET) and rotate counters, times the
+     * output buffers were remapped */
+    utils::OpStats mCommitStats;
+    utils::OpStats mRotateStats;
+    uint32_t mRemapCount;
+    /* Ring depth the next remap sizes the output for */
+    uint32_t mNumBufs;
+    /* Set by commit when the session config changed */
+    bool mConfigChanged;
+    explicit Rotator();
     static uint32_t calcOutputBufSize(const utils::Whf& destWhf);
+    /* Appends the counters to a dump */
+    void getStatsDump(char *buf, size_t len) const;
+    /* Called by queueBuffer with the source buffer. Returns true if the
+     * output of the previous rotate is still valid, i.e. the source buffer,
+     * its content and the config did not change and the ring is down to a
+     * single buffer */
+    bool skipRotate(int fd, uint32_t offset);
 
 private:
+    /* Frames per evaluation of the ring depth, stalls in a window that grow
+     * the ring, calm windows before it shrinks back, and frames with an
+     * unchanged source before a single buffer is enough */
+    enum { RING_WINDOW = 30, RING_GROW_STALLS = 2, RING_CALM_WINDOWS = 4,
+           RING_STATIC_FRAMES = 30 };
+    void adaptRing(bool stalled);
     /*Returns rotator h/w type */
     static int getRotatorHwType();
+
+    /* Fixed ring depth from debug.rotator.bufs, 0 adapts */
+    uint32_t mFixedBufs;
+    /* Last source buffer, and whether its rotate was skipped */
+    const void *mLastSrcHandle;
+    const void *mSrcHandle;
+    bool mSrcChanged;
+    int mLastSrcFd;
+    uint32_t mLastSrcOffset;
+    bool mSkipped;
+    uint32_t mStaticFrames;
+    uint32_t mWindowFrames;
+    uint32_t mWindowStalls;
+    uint32_t mCalmWindows;
+    /* Waits on release fences before reusing a buffer */
+    utils::OpStats mStallStats;
+    uint32_t mGrowCount;
+    uint32_t mShrinkCount;
+    uint32_t mSkipCount;
+    uint32_t mPeakRingBytes;
     friend class RotMgr;
 };
 
@@ -288,6 +407,7 @@ public:
     virtual uint32_t getDstFormat() const;
     virtual uint32_t getSessId() const;
     virtual bool queueBuffer(int fd, uint32_t offset);
+    virtual bool prepare();
     virtual void dump() const;
     virtual void getDump(char *buf, size_t len) const;
 
@@ -460,6 +580,7 @@ public:
     virtual uint32_t getDstFormat() const;
     virtual uint32_t getSessId() const;
     virtual bool queueBuffer(int fd, uint32_t offset);
+    virtual bool prepare();
     virtual void dump() const;
     virtual void getDump(char *buf, size_t len) const;
 
@@ -490,6 +611,8 @@ private:
     OvFD mFd;
     /* Enable/Disable Mdss Rot*/
     bool mEnabled;
+    /* Last committed rot info, to tell config changes apart */
+    mdp_overlay   mLSRotInfo;
 
     friend Rotator* Rotator::getRotator();
 };
@@ -500,21 +623,82 @@ public:
     //Maximum sessions based on VG pipes, since rotator is used only for videos.
     //Even though we can have 4 mixer stages, that much may be unnecessary.
     enum { MAX_ROT_SESS = 3 };
+    //Warm sessions nobody adopted within this many frames are dropped
+    enum { PREWARM_EXPIRE_FRAMES = 60 };
     RotMgr();
     ~RotMgr();
     void configBegin();
     void configDone();
     overlay::Rotator *getNext();
+    /* Same, but a new session is taken from the prewarmed ones if one was
+     * built for this config */
+    overlay::Rotator *getNext(const utils::Whf& whf,
+            const utils::eMdpFlags& flags, const utils::eTransform& orient,
+            const int& downscale);
     void clear(); //Removes all instances
+    /* Opens, starts and sizes a rotator session for the config on a worker
+     * thread. The next getNext() for the same config adopts it, so a new
+     * video does not pay START and buffer allocation while composing.
+     * Returns false if the request was dropped or is already pending */
+    bool prewarm(const utils::Whf& whf, const utils::eMdpFlags& flags,
+            const utils::eTransform& orient, const int& downscale);
+    /* Prewarms the last requested config again as a secure session */
+    bool prewarmSecure();
     /* Returns rot dump.
      * Expects a NULL terminated buffer of big enough size.
      */
     void getDump(char *buf, size_t len);
+    /* Clears the counters of all sessions and of prewarm */
+    void resetStats();
     int getRotDevFd(); //Called on A-fam only
 private:
+    struct WarmKey {
+        utils::Whf whf;
+        utils::eMdpFlags flags; //only the bits the session depends on
+        utils::eTransform orient;
+        int downscale;
+        bool operator==(const WarmKey& k) const {
+            return whf == k.whf && flags == k.flags && orient == k.orient &&
+                    downscale == k.downscale;
+        }
+    };
+    static WarmKey makeKey(const utils::Whf& whf,
+            const utils::eMdpFlags& flags, const utils::eTransform& orient,
+            const int& downscale);
+    struct WarmEntry {
+        WarmKey key;
+        overlay::Rotator *rot;
+        uint32_t age;
+    };
+    static void *prewarmThread(void *arg);
+    void prewarmLoop();
+    bool queuePrewarm(const WarmKey& key);
+    overlay::Rotator *adoptWarm(const WarmKey& key);
+    void dropWarm();
+
     overlay::Rotator *mRot[MAX_ROT_SESS];
     int mUseCount;
     int mRotDevFd; //A-fam
+    android::Mutex mDevLock; //displays may be set from different threads
+
+    //Prewarm state, shared with the worker under mWarmLock
+    WarmKey mPending[MAX_ROT_SESS];
+    int mNumPending;
+    WarmEntry mWarm[MAX_ROT_SESS];
+    int mNumWarm;
+    WarmKey mLastKey;
+    bool mHaveLastKey;
+    uint32_t mGeneration; //bumped by clear() to drop in flight work
+    bool mThreadStarted;
+    bool mExit;
+    pthread_t mThread;
+    uint32_t mWarmRequests;
+    uint32_t mWarmed;
+    uint32_t mAdopted;
+    uint32_t mExpired;
+    uint32_t mWarmFailed;
+    android::Mutex mWarmLock;
+    android::Condition mWarmCond;
 };
 
 } // overlay
@@ -41,6 +41,7 @@
 #include "overlayUtils.h"
 #include "mdpWrapper.h"
 #include "mdp_version.h"
+#include "mdp_bw_model.h"
 
 // just a helper static thingy
 namespace {
@@ -86,6 +87,13 @@ const char* const Res::barrierFile =
         "/sys/devices/platform/mipi_novatek.0/enable_3d_barrier";
 //--------------------------------------------------------
 
+namespace mdp_wrapper {
+IoctlStats& getIoctlStats() {
+    static IoctlStats sStats;
+    return sStats;
+}
+}
+
 
 
 namespace utils {
@@ -262,7 +270,7 @@ int getHALFormat(int mdpFormat) {
     return -1;
 }
 
-int getDownscaleFactor(const int& src_w, const int& src_h,
+static int getAreaDownscaleFactor(const int& src_w, const int& src_h,
         const int& dst_w, const int& dst_h) {
     int dscale_factor = utils::ROT_DS_NONE;
     // We need this check to engage the rotator whenever possible to assist MDP
@@ -298,6 +306,52 @@ int getDownscaleFactor(const int& src_w, const int& src_h,
     return dscale_factor;
 }
 
+enum { ROT_DS_POLICY_MODEL = 0, ROT_DS_POLICY_MDP, ROT_DS_POLICY_AREA };
+
+int getDownscaleFactor(const int& src_w, const int& src_h,
+        const int& dst_w, const int& dst_h, const int& mdpFormat,
+        const bool& isRotated) {
+    static int sPolicy = -1;
+    static qdutils::MDPBwModel *sModel = NULL;
+    if(sPolicy < 0) {
+        char property[PROPERTY_VALUE_MAX];
+        sPolicy = ROT_DS_POLICY_MODEL;
+        if(property_get("debug.rotator.downscale", property, NULL) > 0) {
+            sPolicy = atoi(property);
+        }
+        ALOGD_IF(DEBUG_OVERLAY, "%s: policy %d", __FUNCTION__, sPolicy);
+    }
+
+    switch(sPolicy) {
+    case ROT_DS_POLICY_MDP:
+        return utils::ROT_DS_NONE;
+    case ROT_DS_POLICY_AREA:
+        return getAreaDownscaleFactor(src_w, src_h, dst_w, dst_h);
+    default:
+        break;
+    }
+
+    if(src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0)
+        return utils::ROT_DS_NONE;
+
+    if(sModel == NULL) {
+        sModel = new qdutils::MDPBwModel(
+                qdutils::MDPVersion::getInstance().getMDPVersion());
+    }
+    FrameBufferInfo *fbInfo = FrameBufferInfo::getInstance();
+    sModel->begin(fbInfo->getWidth(), fbInfo->getHeight(), 60);
+
+    qdutils::MDPBwModel::Pipe pipe;
+    pipe.srcW = src_w;
+    pipe.srcH = src_h;
+    pipe.dstW = dst_w;
+    pipe.dstH = dst_h;
+    pipe.bpp = qdutils::MDPBwModel::getFormatBpp(getHALFormat(mdpFormat));
+    pipe.rotDownscale = 0;
+    pipe.rotated = isRotated;
+    return sModel->getRotDownscale(pipe);
+}
+
 static inline int compute(const uint32_t& x, const uint32_t& y,
         const uint32_t& z) {
     return x - ( y + z );
@@ -411,7 +465,7 @@ void getDump(char *buf, size_t len, const char *prefix,
             "%s id=%d z=%d fg=%d alpha=%d mask=%d flags=0x%x\n",
             prefix, ov.id, ov.z_order, ov.is_fg, ov.alpha,
             ov.transp_mask, ov.flags);
-    strncat(buf, str, strlen(str));
+    strlcat(buf, str, len);
     getDump(buf, len, "\tsrc(msmfb_img)", ov.src);
     getDump(buf, len, "\tsrc_rect(mdp_rect)", ov.src_rect);
     getDump(buf, len, "\tdst_rect(mdp_rect)", ov.dst_rect);
@@ -424,7 +478,7 @@ void getDump(char *buf, size_t len, const char *prefix,
             "%s w=%d h=%d format=%d %s\n",
             prefix, ov.width, ov.height, ov.format,
             overlay::utils::getFormatString(ov.format));
-    strncat(buf, str_src, strlen(str_src));
+    strlcat(buf, str_src, len);
 }
 
 void getDump(char *buf, size_t len, const char *prefix,
@@ -433,7 +487,7 @@ void getDump(char *buf, size_t len, const char *prefix,
     snprintf(str_rect, 256,
             "%s x=%d y=%d w=%d h=%d\n",
             prefix, ov.x, ov.y, ov.w, ov.h);
-    strncat(buf, str_rect, strlen(str_rect));
+    strlcat(buf, str_rect, len);
 }
 
 void getDump(char *buf, size_t len, const char *prefix,
@@ -442,7 +496,7 @@ void getDump(char *buf, size_t len, const char *prefix,
     snprintf(str, 256,
             "%s id=%d\n",
             prefix, ov.id);
-    strncat(buf, str, strlen(str));
+    strlcat(buf, str, len);
     getDump(buf, len, "\tdata(msmfb_data)", ov.data);
 }
 
@@ -453,7 +507,7 @@ void getDump(char *buf, size_t len, const char *prefix,
             "%s offset=%d memid=%d id=%d flags=0x%x priv=%d\n",
             prefix, ov.offset, ov.memory_id, ov.id, ov.flags,
             ov.priv);
-    strncat(buf, str_data, strlen(str_data));
+    strlcat(buf, str_data, len);
 }
 
 void getDump(char *buf, size_t len, const char *prefix,
@@ -462,7 +516,7 @@ void getDump(char *buf, size_t len, const char *prefix,
     snprintf(str, 256, "%s sessid=%u rot=%d, enable=%d downscale=%d\n",
             prefix, rot.session_id, rot.rotations, rot.enable,
             rot.downscale_ratio);
-    strncat(buf, str, strlen(str));
+    strlcat(buf, str, len);
     getDump(buf, len, "\tsrc", rot.src);
     getDump(buf, len, "\tdst", rot.dst);
     getDump(buf, len, "\tsrc_rect", rot.src_rect);
@@ -474,13 +528,27 @@ void getDump(char *buf, size_t len, const char *prefix,
     snprintf(str, 256,
             "%s sessid=%u verkey=%d\n",
             prefix, rot.session_id, rot.version_key);
-    strncat(buf, str, strlen(str));
+    strlcat(buf, str, len);
     getDump(buf, len, "\tsrc", rot.src);
     getDump(buf, len, "\tdst", rot.dst);
     getDump(buf, len, "\tsrc_chroma", rot.src_chroma);
     getDump(buf, len, "\tdst_chroma", rot.dst_chroma);
 }
 
+void getDump(char *buf, size_t len, const char *prefix,
+        const OpStats& st) {
+    if(!st.count)
+        return;
+    char str[256] = {'\0'};
+    snprintf(str, 256,
+            "%s n=%u fail=%u avg=%uus max=%uus "
+            "<64/128/256/512us/1/2/4ms/more: %u/%u/%u/%u/%u/%u/%u/%u\n",
+            prefix, st.count, st.fails, (uint32_t)(st.totalUs / st.count),
+            st.maxUs, st.hist[0], st.hist[1], st.hist[2], st.hist[3],
+            st.hist[4], st.hist[5], st.hist[6], st.hist[7]);
+    strlcat(buf, str, len);
+}
+
 } // utils
 
 } // overlay
@@ -44,7 +44,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
 #include "gralloc_priv.h" //for interlace
+#include "mdpBackend.h"
 
 // Older platforms do not support Venus.
 #ifndef VENUS_COLOR_FORMAT
@@ -444,16 +446,19 @@ struct PipeArgs {
         zorder(Z_SYSTEM_ALLOC),
         isFg(IS_FG_OFF),
         rotFlags(ROT_FLAG_DISABLED){
-        rotFlags(ROT_FLAGS_NONE){
+        rotFlags(ROT_FLAGS_NONE),
+        rotDownscale(ROT_DS_NONE){
     }
 
     PipeArgs(eMdpFlags f, Whf _whf,
-            eZorder z, eIsFg fg, eRotFlags r) :
+            eZorder z, eIsFg fg, eRotFlags r,
+            int ds = ROT_DS_NONE) :
         mdpFlags(f),
         whf(_whf),
         zorder(z),
         isFg(fg),
-        rotFlags(r) {
+        rotFlags(r),
+        rotDownscale(ds) {
     }
 
     eMdpFlags mdpFlags; // for mdp_overlay flags
@@ -461,6 +466,7 @@ struct PipeArgs {
     eZorder zorder; // stage number
     eIsFg isFg; // control alpha & transp
     eRotFlags rotFlags;
+    int rotDownscale; // eRotDownscale applied by an upstream rotator
 };
 
 enum eOverlayState{
@@ -567,8 +573,14 @@ struct ScreenInfo {
 int getMdpFormat(int format);
 int getRotOutFmt(uint32_t format);
 int getHALFormat(int mdpFormat);
+/* Rotator pre-downscale (eRotDownscale) for a source of the given mdp format.
+ * src is in the destination's orientation. isRotated tells whether the
+ * source passes through the rotator anyway. debug.rotator.downscale picks the
+ * policy: 0 cost model (default), 1 never, MDP scales alone, 2 the legacy
+ * area ratio rule */
 int getDownscaleFactor(const int& src_w, const int& src_h,
-        const int& dst_w, const int& dst_h);
+        const int& dst_w, const int& dst_h, const int& mdpFormat,
+        const bool& isRotated);
 
 /* flip is upside down and such. V, H flip
  * rotation is 90, 180 etc
@@ -947,6 +959,44 @@ inline void even_floor(T& value) {
         value--;
 }
 
+/* Call, failure and latency counters of one driver operation. Latencies are
+ * kept in power of 2 buckets starting at 64us, the last bucket takes all
+ * above 4ms. Cheap enough to update on every call in the composition path */
+struct OpStats {
+    enum { NUM_BUCKETS = 8, FIRST_BUCKET_US = 64 };
+    OpStats() { reset(); }
+    void reset() { memset(this, 0, sizeof(*this)); }
+    /* Accounts a call that started at start (systemTime) */
+    void add(nsecs_t start, bool ok);
+    /* Accounts a call that took us microseconds */
+    void addUs(uint32_t us, bool ok);
+
+    uint32_t count;
+    uint32_t fails;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t hist[NUM_BUCKETS];
+};
+
+inline void OpStats::add(nsecs_t start, bool ok) {
+    addUs((uint32_t)ns2us(systemTime() - start), ok);
+}
+
+inline void OpStats::addUs(uint32_t us, bool ok) {
+    int b = 0;
+    for(uint32_t lim = FIRST_BUCKET_US; us >= lim && b < NUM_BUCKETS - 1;
+            lim <<= 1) {
+        b++;
+    }
+    hist[b]++;
+    count++;
+    if(!ok)
+        fails++;
+    totalUs += us;
+    if(us > maxUs)
+        maxUs = us;
+}
+
 void preRotateSource(const eTransform& tr, Whf& whf, Dim& srcCrop);
 void getDump(char *buf, size_t len, const char *prefix, const mdp_overlay& ov);
 void getDump(char *buf, size_t len, const char *prefix, const msmfb_img& ov);
@@ -958,6 +1008,7 @@ void getDump(char *buf, size_t len, const char *prefix,
         const msm_rotator_img_info& ov);
 void getDump(char *buf, size_t len, const char *prefix,
         const msm_rotator_data_info& ov);
+void getDump(char *buf, size_t len, const char *prefix, const OpStats& st);
 
 } // namespace utils ends
 
@@ -1050,7 +1101,7 @@ inline OvFD::~OvFD() {
 
 inline bool OvFD::open(const char* const dev, int flags)
 {
-    mFD = ::open(dev, flags, 0);
+    mFD = mdp_wrapper::getBackend()->open(dev, flags);
     if (mFD < 0) {
         // FIXME errno, strerror in bionic?
         ALOGE("Cant open device %s err=%d", dev, errno);
@@ -1069,7 +1120,7 @@ inline bool OvFD::close()
 {
     int ret = 0;
     if(valid()) {
-        ret = ::close(mFD);
+        ret = mdp_wrapper::getBackend()->close(mFD);
         mFD = INVAL;
     }
     return (ret == 0);
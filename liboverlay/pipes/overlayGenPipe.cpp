@@ -34,7 +34,9 @@
 namespace overlay {
 
 GenericPipe::GenericPipe(int dpy) : mFbNum(dpy), mRot(0), mRotUsed(false),
-        mRotDownscaleOpt(false), mPreRotated(false), pipeState(CLOSED) {
+        mRotDownscaleOpt(false), mPreRotated(false),
+        mRotDownscale(utils::ROT_DS_NONE), mSrcFormat(0), mRot90(false),
+        pipeState(CLOSED) {
     init();
 }
 
@@ -48,6 +50,9 @@ bool GenericPipe::init()
     mRotUsed = false;
     mRotDownscaleOpt = false;
     mPreRotated = false;
+    mRotDownscale = utils::ROT_DS_NONE;
+    mSrcFormat = 0;
+    mRot90 = false;
     if(mFbNum)
         mFbNum = Overlay::getInstance()->getExtFbNum();
 
@@ -88,12 +93,24 @@ bool GenericPipe::close() {
     return ret;
 }
 
+bool GenericPipe::park() {
+    bool ret = true;
+    if(!mCtrlData.ctrl.unset()) {
+        ALOGE("GenericPipe failed to unset ctrl");
+        ret = false;
+    }
+    setClosed();
+    return ret;
+}
+
 void GenericPipe::setSource(const utils::PipeArgs& args) {
     //Cache if user wants 0-rotation
     mRotUsed = args.rotFlags & utils::ROT_0_ENABLED;
     mRotDownscaleOpt = args.rotFlags & utils::ROT_DOWNSCALE_ENABLED;
     mPreRotated = args.rotFlags & utils::ROT_PREROTATED;
     if(mPreRotated) mRotUsed = false;
+    mRotDownscale = args.rotDownscale;
+    mSrcFormat = args.whf.format;
     mRot->setSource(args.whf);
     mRot->setFlags(args.mdpFlags);
     mCtrlData.ctrl.setSource(args);
@@ -106,7 +123,8 @@ void GenericPipe::setCrop(const overlay::utils::Dim& d) {
 void GenericPipe::setTransform(const utils::eTransform& orient) {
     //Rotation could be enabled by user for zero-rot or the layer could have
     //some transform. Mark rotation enabled in either case.
-    mRotUsed |= ((orient & utils::OVERLAY_TRANSFORM_ROT_90) && !mPreRotated);
+    mRot90 = (orient & utils::OVERLAY_TRANSFORM_ROT_90);
+    mRotUsed |= (mRot90 && !mPreRotated);
     mRot->setTransform(orient);
     mCtrlData.ctrl.setTransform(orient);
 }
@@ -119,12 +137,17 @@ bool GenericPipe::commit() {
     bool ret = false;
     int downscale_factor = utils::ROT_DS_NONE;
 
-    if(mRotDownscaleOpt) {
+    if(mRotDownscaleOpt && mPreRotated) {
+        //Decided upstream, the source already is the rotator output
+        downscale_factor = mRotDownscale;
+    } else if(mRotDownscaleOpt) {
         ovutils::Dim src(mCtrlData.ctrl.getCrop());
         ovutils::Dim dst(mCtrlData.ctrl.getPosition());
+        if(mRot90)
+            ovutils::swap(src.w, src.h);
         downscale_factor = ovutils::getDownscaleFactor(
-                src.w, src.h, dst.w, dst.h);
-        mRotUsed |= (downscale_factor && !mPreRotated);
+                src.w, src.h, dst.w, dst.h, mSrcFormat, mRotUsed);
+        mRotUsed |= (downscale_factor != utils::ROT_DS_NONE);
     }
 
 
@@ -161,6 +184,14 @@ bool GenericPipe::commit() {
     return ret;
 }
 
+bool GenericPipe::validate() const {
+    if(mRot == NULL) {
+        ALOGE("GenericPipe has no rotator object");
+        return false;
+    }
+    return mCtrlData.ctrl.validate();
+}
+
 bool GenericPipe::queueBuffer(int fd, uint32_t offset) {
     //TODO Move pipe-id transfer to CtrlData class. Make ctrl and data private.
     OVASSERT(isOpen(), "State is closed, cannot queueBuffer");
@@ -218,6 +249,13 @@ void GenericPipe::getDump(char *buf, size_t len) {
         mRot->getDump(buf, len);
 }
 
+void GenericPipe::resetStats() {
+    mCtrlData.ctrl.resetStats();
+    mCtrlData.data.resetStats();
+    if(mRot)
+        mRot->resetStats();
+}
+
 bool GenericPipe::isClosed() const  {
     return (pipeState == CLOSED);
 }
@@ -101,6 +101,9 @@ public:
     ~GenericPipe();
     bool init();
     bool close();
+    /* Detach from the mixer (UNSET) but keep fds, rotator session and
+     * rotator memory around, so a later commit can re-acquire cheaply */
+    bool park();
     /* Control APIs */
     /* set source using whf, orient and wait flag */
     void setSource(const utils::PipeArgs& args);
@@ -112,6 +115,8 @@ public:
     void setPosition(const utils::Dim& dim);
     /* commit changes to the overlay "set"*/
     bool commit();
+    /* check the staged config, no driver calls */
+    bool validate() const;
     /* Data APIs */
     /* queue buffer to the overlay */
     bool queueBuffer(int fd, uint32_t offset);
@@ -129,6 +134,8 @@ public:
     void dump() const;
     /* Return the dump in the specified buffer */
     void getDump(char *buf, size_t len);
+    /* Clear the ctrl, data and rotator counters */
+    void resetStats();
 
 private:
     /* set Closed pipe */
@@ -155,6 +162,11 @@ private:
     bool mRotDownscaleOpt;
     //Whether the source is prerotated.
     bool mPreRotated;
+    //Downscale the upstream rotator applied to a prerotated source
+    int mRotDownscale;
+    //Source format and 90 rotation, for the downscale decision
+    uint32_t mSrcFormat;
+    bool mRot90;
     /* Pipe open or closed */
     enum ePipeState {
         CLOSED,
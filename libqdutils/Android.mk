@@ -38,3 +38,27 @@ LOCAL_MODULE_TAGS               := optional
 LOCAL_MODULE                    := libqdMetaData
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_PATH               := $(TARGET_OUT_SHARED_LIBRARIES)
+LOCAL_SHARED_LIBRARIES          := $(common_libs) libqdutils
+LOCAL_C_INCLUDES                := $(common_includes) $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES   := $(common_deps)
+LOCAL_SRC_FILES                 := mdp_bw_model.cpp
+LOCAL_CFLAGS                    := $(common_flags)
+LOCAL_CFLAGS                    += -DLOG_TAG=\"qdbwmodel\"
+LOCAL_MODULE_TAGS               := optional
+LOCAL_MODULE                    := libqdbwmodel
+include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES          := $(common_libs) libqdutils libqdbwmodel
+LOCAL_C_INCLUDES                := $(common_includes) $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES   := $(common_deps)
+LOCAL_SRC_FILES                 := mdp_bw_model_test.cpp
+LOCAL_CFLAGS                    := $(common_flags)
+LOCAL_CFLAGS                    += -DLOG_TAG=\"qdbwmodel_test\"
+LOCAL_MODULE_TAGS               := tests
+LOCAL_MODULE                    := mdp_bw_model_test
+include $(BUILD_EXECUTABLE)
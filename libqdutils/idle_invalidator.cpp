@@ -50,13 +50,14 @@ int IdleInvalidator::init(InvalidatorHandler reg_handler, void* user_data,
     /* store registered handler */
     mHandler = reg_handler;
     mHwcContext = user_data;
-    mSleepTime = idleSleepTime; //Time in millis
+    //Time in millis
+    android_atomic_release_store((int32_t)idleSleepTime, &mSleepTime);
     return 0;
 }
 
 bool IdleInvalidator::threadLoop() {
     ALOGD_IF(II_DEBUG, "%s", __func__);
-    usleep(mSleepTime * 500);
+    usleep(android_atomic_acquire_load(&mSleepTime) * 500);
     if(mSleepAgain) {
         //We need to sleep again!
         mSleepAgain = false;
@@ -82,6 +83,11 @@ void IdleInvalidator::markForSleep() {
     run(threadName, android::PRIORITY_AUDIO);
 }
 
+void IdleInvalidator::setSleepTime(unsigned int idleSleepTime) {
+    ALOGD_IF(II_DEBUG, "%s: %u ms", __func__, idleSleepTime);
+    android_atomic_release_store((int32_t)idleSleepTime, &mSleepTime);
+}
+
 IdleInvalidator *IdleInvalidator::getInstance() {
     ALOGD_IF(II_DEBUG, "%s", __func__);
     if(sInstance.get() == NULL)
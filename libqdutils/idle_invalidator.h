@@ -33,6 +33,7 @@
 #define INCLUDE_IDLEINVALIDATOR
 
 #include <cutils/log.h>
+#include <cutils/atomic.h>
 #include <utils/threads.h>
 
 typedef void (*InvalidatorHandler)(void*);
@@ -40,7 +41,8 @@ typedef void (*InvalidatorHandler)(void*);
 class IdleInvalidator : public android::Thread {
     void *mHwcContext;
     bool mSleepAgain;
-    unsigned int mSleepTime;
+    /* Written by hwc, read by threadLoop; accessed atomically */
+    volatile int32_t mSleepTime;
     static InvalidatorHandler mHandler;
     static android::sp<IdleInvalidator> sInstance;
 
@@ -50,6 +52,8 @@ class IdleInvalidator : public android::Thread {
     int init(InvalidatorHandler reg_handler, void* user_data, unsigned int
              idleSleepTime);
     void markForSleep();
+    /* idle time in millis, taken from the next sleep on */
+    void setSleepTime(unsigned int idleSleepTime);
     /*Overrides*/
     virtual bool        threadLoop();
     virtual int         readyToRun();
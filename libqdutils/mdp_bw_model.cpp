@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <gralloc_priv.h>
+#include "mdp_version.h"
+#include "mdp_bw_model.h"
+
+#define BW_MODEL_DEBUG 0
+
+namespace qdutils {
+
+//Nominal figures per MDP revision. Scale ratios are the ones the overlay
+//drivers check, bus figures sit above every configuration recorded in
+//mdp_bw_model_test. Targets that know better should set the properties.
+MDPBwModel::Limits MDPBwModel::getLimits(int mdpVersion) {
+    Limits l;
+    l.maxDownscale = 4;
+    l.maxUpscale = 8;
+    l.clkFudgePct = 20;
+    l.rotPixPerSec = 0;
+    l.enforceClk = false;
+    if(mdpVersion >= MDSS_V5) {
+        //MAX_DOWNSCALE_RATIO, MAX_UPSCALE_RATIO of mdss_mdp
+        l.maxAbBps = 4800ULL * 1000000;
+        l.maxIbBps = 6400ULL * 1000000;
+        l.maxClkHz = 320000000;
+        l.maxUpscale = 20;
+        l.clkFudgePct = 15;
+    } else if(mdpVersion >= MDP_V4_2) {
+        //mdp4_overlay_req2pipe: 8x down, 20x up
+        l.maxAbBps = 2400ULL * 1000000;
+        l.maxIbBps = 3200ULL * 1000000;
+        l.maxClkHz = 200000000;
+        l.maxDownscale = 8;
+        l.maxUpscale = 20;
+        l.rotPixPerSec = 250000000;
+    } else if(mdpVersion >= MDP_V4_0) {
+        l.maxAbBps = 1600ULL * 1000000;
+        l.maxIbBps = 2400ULL * 1000000;
+        l.maxClkHz = 160000000;
+        l.maxDownscale = 8;
+        l.maxUpscale = 20;
+        l.rotPixPerSec = 125000000;
+    } else {
+        l.maxAbBps = 800ULL * 1000000;
+        l.maxIbBps = 1200ULL * 1000000;
+        l.maxClkHz = 128000000;
+    }
+    return l;
+}
+
+MDPBwModel::MDPBwModel(int mdpVersion) {
+    mLimits = getLimits(mdpVersion);
+
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.mdp.bw.max_mbps", property, NULL) > 0) {
+        if(atoi(property) > 0) {
+            mLimits.maxAbBps = atoi(property) * 1000000ULL;
+            mLimits.maxIbBps = mLimits.maxAbBps;
+        }
+    }
+    if(property_get("debug.mdp.clk.max_mhz", property, NULL) > 0) {
+        if(atoi(property) > 0) {
+            mLimits.maxClkHz = atoi(property) * 1000000;
+            mLimits.enforceClk = true;
+        }
+    }
+    begin(0, 0, 60);
+}
+
+void MDPBwModel::begin(uint32_t panelW, uint32_t panelH, uint32_t fps) {
+    mPanelW = panelW;
+    mPanelH = panelH;
+    mFps = fps ? fps : 60;
+    mNumPipes = 0;
+    mLastVerdict = VERDICT_OK;
+    mTotal.abBps = 0;
+    mTotal.ibBps = 0;
+    mTotal.clkHz = 0;
+    mTotal.verdict = VERDICT_OK;
+}
+
+MDPBwModel::Estimate MDPBwModel::getPipeCost(const Pipe& pipe) const {
+    Estimate cost;
+    cost.abBps = 0;
+    cost.ibBps = 0;
+    cost.clkHz = 0;
+    cost.verdict = VERDICT_OK;
+
+    //What the MDP fetches, after the rotator downscaled it
+    uint64_t srcW = pipe.srcW >> pipe.rotDownscale;
+    uint64_t srcH = pipe.srcH >> pipe.rotDownscale;
+    uint64_t dstW = pipe.dstW;
+    uint64_t dstH = pipe.dstH;
+    if(!srcW || !srcH || !dstW || !dstH) {
+        cost.verdict = VERDICT_SCALE;
+        return cost;
+    }
+
+    if(srcW > dstW * mLimits.maxDownscale ||
+            srcH > dstH * mLimits.maxDownscale ||
+            dstW > srcW * mLimits.maxUpscale ||
+            dstH > srcH * mLimits.maxUpscale) {
+        cost.verdict = VERDICT_SCALE;
+        return cost;
+    }
+
+    //Average fetch is the whole source once per refresh. The fetch only
+    //happens while the panel scans the dst lines though, so a smaller dst
+    //raises the instantaneous vote by panel/dst height.
+    uint64_t frameBytes = srcW * srcH * pipe.bpp / 8;
+    cost.abBps = frameBytes * mFps;
+    cost.ibBps = cost.abBps;
+    if(dstH < mPanelH)
+        cost.ibBps = cost.abBps * mPanelH / dstH;
+
+    //The rotator reads the full source and writes what the MDP fetches
+    if(pipe.rotated) {
+        uint64_t rotRead = (uint64_t)pipe.srcW * pipe.srcH * pipe.bpp / 8;
+        cost.abBps += (rotRead + frameBytes) * mFps;
+    }
+
+    //The core runs at the panel pixel rate, sped up by vertical downscale
+    //since more source lines are consumed per panel line.
+    uint64_t clk = (uint64_t)mPanelW * mPanelH * mFps;
+    if(srcH > dstH)
+        clk = clk * srcH / dstH;
+    clk = clk * (100 + mLimits.clkFudgePct) / 100;
+    cost.clkHz = (uint32_t)(clk > 0xFFFFFFFFULL ? 0xFFFFFFFFULL : clk);
+    return cost;
+}
+
+bool MDPBwModel::addPipe(const Pipe& pipe) {
+    Estimate cost = getPipeCost(pipe);
+    Estimate next = mTotal;
+    next.abBps += cost.abBps;
+    next.ibBps += cost.ibBps;
+    if(cost.clkHz > next.clkHz)
+        next.clkHz = cost.clkHz;
+
+    int verdict = cost.verdict;
+    if(verdict == VERDICT_OK) {
+        if(mNumPipes >= MAX_PIPES)
+            verdict = VERDICT_PIPES;
+        else if(next.abBps > mLimits.maxAbBps || next.ibBps > mLimits.maxIbBps)
+            verdict = VERDICT_BW;
+        else if(mLimits.enforceClk && next.clkHz > mLimits.maxClkHz)
+            verdict = VERDICT_CLK;
+    }
+
+    if(verdict != VERDICT_OK) {
+        mLastVerdict = verdict;
+        ALOGD_IF(BW_MODEL_DEBUG, "%s: rejected %ux%u -> %ux%u: %s", __FUNCTION__,
+                pipe.srcW, pipe.srcH, pipe.dstW, pipe.dstH,
+                getVerdictStr(verdict));
+        return false;
+    }
+
+    mTotal = next;
+    mNumPipes++;
+    return true;
+}
+
+uint32_t MDPBwModel::getRotDownscale(const Pipe& pipe) const {
+    enum { MAX_ROT_DOWNSCALE = 3 }; //eighth
+    //The rotator has to keep up with the source at the refresh rate
+    uint64_t rotPixRate = (uint64_t)pipe.srcW * pipe.srcH * mFps;
+    if(!mLimits.rotPixPerSec || rotPixRate > mLimits.rotPixPerSec)
+        return 0;
+
+    Pipe p = pipe;
+    p.rotDownscale = 0;
+    Estimate base = getPipeCost(p);
+    bool mdpAlone = (base.verdict == VERDICT_OK &&
+            base.ibBps <= mLimits.maxIbBps && base.clkHz <= mLimits.maxClkHz);
+    uint64_t bestBytes = mdpAlone ? base.abBps : ~0ULL;
+    uint32_t best = 0;
+
+    //Every shift costs a rotator pass, read the source, write it shrunk
+    p.rotated = true;
+    for(uint32_t shift = 1; shift <= MAX_ROT_DOWNSCALE; shift++) {
+        if((pipe.srcW >> shift) < pipe.dstW ||
+                (pipe.srcH >> shift) < pipe.dstH)
+            break;
+        p.rotDownscale = shift;
+        Estimate cost = getPipeCost(p);
+        if(cost.verdict != VERDICT_OK || cost.ibBps > mLimits.maxIbBps ||
+                cost.clkHz > mLimits.maxClkHz)
+            continue;
+        if(cost.abBps < bestBytes) {
+            bestBytes = cost.abBps;
+            best = shift;
+        }
+    }
+
+    ALOGD_IF(BW_MODEL_DEBUG, "%s: %ux%u -> %ux%u rotated %d, mdp alone %d, "
+            "shift %u", __FUNCTION__, pipe.srcW, pipe.srcH, pipe.dstW,
+            pipe.dstH, pipe.rotated, mdpAlone, best);
+    return best;
+}
+
+uint32_t MDPBwModel::getFormatBpp(int halFormat) {
+    switch(halFormat) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 32;
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_YCbCr_444_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_444_SP:
+            return 24;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_422_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        case HAL_PIXEL_FORMAT_RG_88:
+            return 16;
+        case HAL_PIXEL_FORMAT_YV12:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_NV12_ENCODEABLE:
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP_TILED:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP_ADRENO:
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP_VENUS:
+            return 12;
+        case HAL_PIXEL_FORMAT_R_8:
+            return 8;
+        default:
+            return 32;
+    }
+}
+
+const char* MDPBwModel::getVerdictStr(int verdict) {
+    switch(verdict) {
+        case VERDICT_OK: return "OK";
+        case VERDICT_PIPES: return "PIPES";
+        case VERDICT_SCALE: return "SCALE";
+        case VERDICT_BW: return "BW";
+        case VERDICT_CLK: return "CLK";
+        default: return "Invalid";
+    }
+}
+
+}; //namespace qdutils
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQCOMUTILS_MDP_BW_MODEL
+#define INCLUDE_LIBQCOMUTILS_MDP_BW_MODEL
+
+#include <stdint.h>
+
+/* Coarse cost model of the MDP. Estimates the bus bandwidth and the MDP core
+ * clock a set of pipes needs on a display, so a composition strategy can be
+ * rejected or reshaped before the driver is asked to program it.
+ * Limits are picked per MDP revision and can be overridden with
+ * debug.mdp.bw.max_mbps and debug.mdp.clk.max_mhz. The drivers clamp the
+ * core clock rather than fail, so the clock only rejects pipes once a
+ * target set its real limit. mdp_bw_model_test checks the limits against
+ * configurations recorded per revision.
+ */
+namespace qdutils {
+
+class MDPBwModel {
+public:
+    enum { MAX_PIPES = 8 };
+
+    enum eVerdict {
+        VERDICT_OK = 0,
+        VERDICT_PIPES,  //too many pipes
+        VERDICT_SCALE,  //scale ratio outside of what the pipe supports
+        VERDICT_BW,     //bus bandwidth exceeded
+        VERDICT_CLK,    //MDP core clock exceeded
+    };
+
+    struct Limits {
+        uint64_t maxAbBps;      //average bus bandwidth, bytes/sec
+        uint64_t maxIbBps;      //instantaneous bus bandwidth, bytes/sec
+        uint32_t maxClkHz;      //MDP core clock
+        uint32_t maxDownscale;  //max src/dst ratio
+        uint32_t maxUpscale;    //max dst/src ratio
+        uint32_t clkFudgePct;   //overhead over the raw pixel rate
+        uint64_t rotPixPerSec;  //rotator throughput, 0 if it cannot scale
+        bool enforceClk;        //maxClkHz rejects pipes, not only steers
+    };
+
+    struct Pipe {
+        uint32_t srcW;          //source crop
+        uint32_t srcH;
+        uint32_t dstW;          //destination on the panel
+        uint32_t dstH;
+        uint32_t bpp;           //bits per pixel of the source
+        uint32_t rotDownscale;  //rotator pre-downscale shift, 0 for none
+        bool rotated;           //source goes through the rotator first
+    };
+
+    struct Estimate {
+        uint64_t abBps;
+        uint64_t ibBps;
+        uint32_t clkHz;
+        int verdict;
+    };
+
+    explicit MDPBwModel(int mdpVersion);
+
+    /* Starts a new configuration for a panel of w x h refreshing at fps */
+    void begin(uint32_t panelW, uint32_t panelH, uint32_t fps);
+    /* Accounts a pipe. If the pipe would break a limit, false is returned and
+     * the running estimate is left untouched, so the caller can reshape the
+     * configuration, e.g. by sending the layer to the framebuffer */
+    bool addPipe(const Pipe& pipe);
+    /* Running estimate of the current configuration */
+    const Estimate& getEstimate() const { return mTotal; }
+    /* Cost of a single pipe in the current configuration */
+    Estimate getPipeCost(const Pipe& pipe) const;
+    /* Rotator pre-downscale shift (0-3) that moves the fewest bytes over the
+     * bus for a pipe on its own. A shift is only picked when it saves more
+     * than the rotator pass costs, or when the MDP cannot fetch and scale the
+     * pipe alone within the limits. The rotator output is never made smaller
+     * than the destination, so the MDP is not left upscaling lost detail */
+    uint32_t getRotDownscale(const Pipe& pipe) const;
+    /* Verdict of the last rejected pipe, VERDICT_OK if none */
+    int getLastVerdict() const { return mLastVerdict; }
+    const Limits& getLimits() const { return mLimits; }
+    /* For targets, and tests, that know their limits better */
+    void setLimits(const Limits& limits) { mLimits = limits; }
+
+    /* Nominal limits of an MDP revision */
+    static Limits getLimits(int mdpVersion);
+    /* Bits per pixel for a HAL pixel format, 32 if unknown */
+    static uint32_t getFormatBpp(int halFormat);
+    static const char* getVerdictStr(int verdict);
+
+private:
+    Limits mLimits;
+    uint32_t mPanelW;
+    uint32_t mPanelH;
+    uint32_t mFps;
+    uint32_t mNumPipes;
+    int mLastVerdict;
+    Estimate mTotal;
+};
+
+}; //namespace qdutils
+#endif //INCLUDE_LIBQCOMUTILS_MDP_BW_MODEL
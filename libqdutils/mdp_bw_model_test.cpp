@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks MDPBwModel against recorded overlay configurations. Known good
+ * ones are what the HWC stages on each MDP revision and the driver takes,
+ * the model must never send them to the GPU. Known bad ones break a driver
+ * check (pipes, scale) or the bus budget and must be turned down with the
+ * matching verdict. Exits non zero if any configuration mismatches. */
+
+#include <stdio.h>
+#include "mdp_version.h"
+#include "mdp_bw_model.h"
+
+using namespace qdutils;
+
+#define MAX_TEST_PIPES 10
+
+struct TestPipe {
+    uint32_t srcW, srcH, dstW, dstH, bpp;
+    bool rotated;
+};
+
+struct TestConfig {
+    const char *name;
+    int mdpVersion;
+    uint32_t panelW, panelH, fps;
+    int verdict; //of the whole configuration, VERDICT_OK if all pipes fit
+    int numPipes;
+    TestPipe pipes[MAX_TEST_PIPES];
+};
+
+#define RGBA(w, h) { w, h, w, h, 32, false }
+#define NV12(sw, sh, dw, dh) { sw, sh, dw, dh, 12, false }
+
+static const TestConfig sConfigs[] = {
+    //MDP3, WVGA phones
+    { "mdp3 launcher", MDP_V3_0_3, 480, 800, 60, MDPBwModel::VERDICT_OK,
+        3, { RGBA(480, 800), RGBA(480, 800), RGBA(480, 38) } },
+    { "mdp3 video", MDP_V3_0_3, 480, 800, 60, MDPBwModel::VERDICT_OK,
+        2, { NV12(1280, 720, 480, 270), RGBA(480, 800) } },
+    { "mdp3 720p 4 layers", MDP_V3_0_3, 1280, 720, 60,
+        MDPBwModel::VERDICT_BW, 4, { RGBA(1280, 720), RGBA(1280, 720),
+        RGBA(1280, 720), RGBA(1280, 720) } },
+
+    //MDP4.0, qHD
+    { "mdp40 ui 4 layers", MDP_V4_0, 540, 960, 60, MDPBwModel::VERDICT_OK,
+        4, { RGBA(540, 960), RGBA(540, 960), RGBA(540, 960),
+        RGBA(540, 38) } },
+    { "mdp40 1080p video", MDP_V4_0, 540, 960, 60, MDPBwModel::VERDICT_OK,
+        2, { NV12(1920, 1080, 540, 304), RGBA(540, 960) } },
+    { "mdp40 6 full 1080p", MDP_V4_0, 1920, 1080, 60,
+        MDPBwModel::VERDICT_BW, 6, { RGBA(1920, 1080), RGBA(1920, 1080),
+        RGBA(1920, 1080), RGBA(1920, 1080), RGBA(1920, 1080),
+        RGBA(1920, 1080) } },
+
+    //MDP4.2, 720p
+    { "mdp42 video + ui", MDP_V4_2, 1280, 720, 60, MDPBwModel::VERDICT_OK,
+        4, { NV12(1920, 1080, 1280, 720), RGBA(1280, 720), RGBA(1280, 720),
+        RGBA(1280, 48) } },
+    { "mdp42 rotated video", MDP_V4_2, 720, 1280, 60,
+        MDPBwModel::VERDICT_OK, 2, { { 1920, 1080, 720, 405, 12, true },
+        RGBA(720, 1280) } },
+    { "mdp42 8x thumbnail", MDP_V4_2, 1280, 720, 60, MDPBwModel::VERDICT_OK,
+        2, { NV12(1920, 1080, 240, 135), RGBA(1280, 720) } },
+    { "mdp42 20x upscale", MDP_V4_2, 1280, 720, 60, MDPBwModel::VERDICT_OK,
+        1, { NV12(64, 36, 1280, 720) } },
+    //Past the pipe's 8x, the rotator pre-downscale takes the rest
+    { "mdp42 9x downscale", MDP_V4_2, 1280, 720, 60,
+        MDPBwModel::VERDICT_OK, 1, { NV12(1920, 1080, 213, 120) } },
+    { "mdp42 21x upscale", MDP_V4_2, 1280, 720, 60,
+        MDPBwModel::VERDICT_SCALE, 1, { NV12(60, 34, 1280, 720) } },
+
+    //MDSS, 1080p
+    { "mdss 4 layers + video", MDSS_V5, 1920, 1080, 60,
+        MDPBwModel::VERDICT_OK, 5, { NV12(1920, 1080, 1920, 1080),
+        RGBA(1920, 1080), RGBA(1920, 1080), RGBA(1920, 1080),
+        RGBA(1920, 72) } },
+    //The core clock this needs is over the nominal 320MHz, mdss clamps it
+    { "mdss 4x vertical downscale", MDSS_V5, 1920, 1080, 60,
+        MDPBwModel::VERDICT_OK, 2, { NV12(1920, 1080, 1920, 270),
+        RGBA(1920, 1080) } },
+    { "mdss 8 pipes", MDSS_V5, 1920, 1080, 60, MDPBwModel::VERDICT_OK,
+        8, { RGBA(1920, 1080), RGBA(1920, 540), RGBA(1920, 540),
+        RGBA(960, 540), RGBA(960, 540), RGBA(480, 270), RGBA(480, 270),
+        RGBA(1920, 72) } },
+    { "mdss 9 pipes", MDSS_V5, 1920, 1080, 60, MDPBwModel::VERDICT_PIPES,
+        9, { RGBA(64, 64), RGBA(64, 64), RGBA(64, 64), RGBA(64, 64),
+        RGBA(64, 64), RGBA(64, 64), RGBA(64, 64), RGBA(64, 64),
+        RGBA(64, 64) } },
+    { "mdss 5x downscale", MDSS_V5, 1920, 1080, 60,
+        MDPBwModel::VERDICT_SCALE, 1, { NV12(1920, 1080, 384, 216) } },
+    { "mdss wqxga 5 layers", MDSS_V5, 2560, 1600, 60,
+        MDPBwModel::VERDICT_BW, 5, { RGBA(2560, 1600), RGBA(2560, 1600),
+        RGBA(2560, 1600), RGBA(2560, 1600), RGBA(2560, 1600) } },
+};
+
+//"mdss 4x vertical downscale"
+#define MDSS_DOWNSCALE_CONFIG 13
+
+static int runConfig(const TestConfig& cfg, bool enforceClk) {
+    MDPBwModel model(cfg.mdpVersion);
+    MDPBwModel::Limits limits = model.getLimits();
+    limits.enforceClk = enforceClk;
+    model.setLimits(limits);
+    model.begin(cfg.panelW, cfg.panelH, cfg.fps);
+
+    int verdict = MDPBwModel::VERDICT_OK;
+    for(int i = 0; i < cfg.numPipes && verdict == MDPBwModel::VERDICT_OK;
+            i++) {
+        const TestPipe& tp = cfg.pipes[i];
+        MDPBwModel::Pipe pipe;
+        pipe.srcW = tp.srcW;
+        pipe.srcH = tp.srcH;
+        pipe.dstW = tp.dstW;
+        pipe.dstH = tp.dstH;
+        pipe.bpp = tp.bpp;
+        pipe.rotated = tp.rotated;
+        pipe.rotDownscale = model.getRotDownscale(pipe);
+        if(!model.addPipe(pipe))
+            verdict = model.getLastVerdict();
+    }
+    return verdict;
+}
+
+int main(int argc, char **argv) {
+    int failures = 0;
+    const int count = sizeof(sConfigs) / sizeof(sConfigs[0]);
+    for(int i = 0; i < count; i++) {
+        const TestConfig& cfg = sConfigs[i];
+        int verdict = runConfig(cfg, false);
+        bool ok = (verdict == cfg.verdict);
+        printf("%s %-28s expected %-5s got %s\n", ok ? "PASS" : "FAIL",
+                cfg.name, MDPBwModel::getVerdictStr(cfg.verdict),
+                MDPBwModel::getVerdictStr(verdict));
+        if(!ok)
+            failures++;
+    }
+
+    //A target that sets its clock limit gets the clock check back
+    const TestConfig& downscale = sConfigs[MDSS_DOWNSCALE_CONFIG];
+    int verdict = runConfig(downscale, true);
+    bool ok = (verdict == MDPBwModel::VERDICT_CLK);
+    printf("%s %-28s expected %-5s got %s\n", ok ? "PASS" : "FAIL",
+            "mdss clock enforced", "CLK", MDPBwModel::getVerdictStr(verdict));
+    if(!ok)
+        failures++;
+
+    printf("%d of %d configurations failed\n", failures, count + 1);
+    return failures ? 1 : 0;
+}
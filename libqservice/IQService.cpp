@@ -71,6 +71,18 @@ public:
         status_t result = reply.readInt32();
         return result;
     }
+
+    virtual void resetPerfStats() {
+        Parcel data, reply;
+        data.writeInterfaceToken(IQService::getInterfaceDescriptor());
+        remote()->transact(RESET_PERF_STATS, data, &reply);
+    }
+
+    virtual void refreshProperties() {
+        Parcel data, reply;
+        data.writeInterfaceToken(IQService::getInterfaceDescriptor());
+        remote()->transact(REFRESH_PROPERTIES, data, &reply);
+    }
 };
 
 IMPLEMENT_META_INTERFACE(QService, "android.display.IQService");
@@ -141,6 +153,30 @@ status_t BnQService::onTransact(
             }
             return screenRefresh();
         } break;
+        case RESET_PERF_STATS: {
+            CHECK_INTERFACE(IQService, data, reply);
+            if(callerUid != AID_SYSTEM && callerUid != AID_SHELL &&
+                    callerUid != AID_ROOT) {
+                ALOGE("display.qservice RESET_PERF_STATS access denied: \
+                      pid=%d uid=%d process=%s",callerPid,
+                      callerUid, callingProcName);
+                return PERMISSION_DENIED;
+            }
+            resetPerfStats();
+            return NO_ERROR;
+        } break;
+        case REFRESH_PROPERTIES: {
+            CHECK_INTERFACE(IQService, data, reply);
+            if(callerUid != AID_SYSTEM && callerUid != AID_SHELL &&
+                    callerUid != AID_ROOT) {
+                ALOGE("display.qservice REFRESH_PROPERTIES access denied: \
+                      pid=%d uid=%d process=%s",callerPid,
+                      callerUid, callingProcName);
+                return PERMISSION_DENIED;
+            }
+            refreshProperties();
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
@@ -41,6 +41,8 @@ public:
         UNSECURING, // Hardware unsecuring start/end notification
         CONNECT,
         SCREEN_REFRESH,
+        RESET_PERF_STATS, // Clear the overlay and rotator counters
+        REFRESH_PROPERTIES, // Re-read the system properties HWC caches
     };
     enum {
         END = 0,
@@ -50,6 +52,8 @@ public:
     virtual void unsecuring(uint32_t startEnd) = 0;
     virtual void connect(const android::sp<qClient::IQClient>& client) = 0;
     virtual android::status_t screenRefresh() = 0;
+    virtual void resetPerfStats() = 0;
+    virtual void refreshProperties() = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -71,6 +71,18 @@ android::status_t QService::screenRefresh() {
     return result;
 }
 
+void QService::resetPerfStats() {
+    if(mClient.get()) {
+        mClient->notifyCallback(RESET_PERF_STATS, 0);
+    }
+}
+
+void QService::refreshProperties() {
+    if(mClient.get()) {
+        mClient->notifyCallback(REFRESH_PROPERTIES, 0);
+    }
+}
+
 void QService::init()
 {
     if(!sQService) {